@@ -0,0 +1,374 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Geotags a JPEG with InsertExifGeotag and reads the tags back: the segment
+// chain up to the scan, the TIFF header, the IFD0 pointers to the Exif and
+// GPS IFDs, the offsets of values that don't fit an entry and the
+// position as DMS rationals. If exiftool is installed it reads the
+// position back as well, and the time of tagging an image is compared with
+// running exiftool -overwrite_original on it, as the plugin did before.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "exif_geotag.h"
+
+static const int kNativeRuns = 1000;
+static const int kExiftoolRuns = 20;
+
+static int g_failures = 0;
+
+static void Check(bool _ok, const std::string &_what)
+{
+  if (!_ok) {
+    printf("FAIL: %s\n", _what.c_str());
+    ++g_failures;
+  }
+}
+
+static bool ReadFile(const std::string &_path, std::vector<unsigned char> &_data)
+{
+  FILE *file = fopen(_path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  unsigned char buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    _data.insert(_data.end(), buffer, buffer + n);
+  }
+  fclose(file);
+  return true;
+}
+
+static bool WriteFile(const std::string &_path, const std::vector<unsigned char> &_data)
+{
+  FILE *file = fopen(_path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  const bool ok = fwrite(_data.data(), 1, _data.size(), file) == _data.size();
+  return fclose(file) == 0 && ok;
+}
+
+/// \brief Reads the little endian TIFF data of the Exif segment.
+class TiffReader {
+ public:
+  struct Entry {
+    uint16_t type;
+    uint32_t count;
+    std::vector<unsigned char> data;
+  };
+
+  explicit TiffReader(const std::vector<unsigned char> &_tiff) : tiff_(_tiff) {}
+
+  uint16_t U16(uint32_t _offset) const
+  {
+    return tiff_[_offset] | (tiff_[_offset + 1] << 8);
+  }
+
+  uint32_t U32(uint32_t _offset) const
+  {
+    return U16(_offset) | (static_cast<uint32_t>(U16(_offset + 2)) << 16);
+  }
+
+  /// \brief Entries of the IFD at _offset by tag, checks the layout on the way.
+  bool ReadIfd(uint32_t _offset, const std::string &_name, std::map<uint16_t, Entry> &_entries) const
+  {
+    if (_offset % 2 || _offset + 2 > tiff_.size()) {
+      Check(false, _name + " offset " + std::to_string(_offset) + " out of the TIFF data");
+      return false;
+    }
+    const uint16_t count = U16(_offset);
+    if (_offset + 2 + 12 * count + 4 > tiff_.size()) {
+      Check(false, _name + " entries out of the TIFF data");
+      return false;
+    }
+    Check(U32(_offset + 2 + 12 * count) == 0, _name + " has a next IFD");
+    int previous = -1;
+    for (uint16_t i = 0; i < count; ++i) {
+      const uint32_t entry = _offset + 2 + 12 * i;
+      const uint16_t tag = U16(entry);
+      Check(tag > previous, _name + " tags not ascending at " + std::to_string(tag));
+      previous = tag;
+
+      Entry value{U16(entry + 2), U32(entry + 4), {}};
+      static const uint32_t kTypeSize[] = {0, 1, 1, 2, 4, 8, 1, 1};
+      if (value.type == 0 || value.type > 7) {
+        Check(false, _name + " tag " + std::to_string(tag) + " has unknown type");
+        return false;
+      }
+      const uint32_t size = kTypeSize[value.type] * value.count;
+      uint32_t data = entry + 8;
+      if (size > 4) {
+        data = U32(entry + 8);
+        if (data % 2 || data + size > tiff_.size()) {
+          Check(false, _name + " tag " + std::to_string(tag) + " value offset " +
+                std::to_string(data) + " out of the TIFF data");
+          return false;
+        }
+      }
+      value.data.assign(tiff_.begin() + data, tiff_.begin() + data + size);
+      _entries[tag] = value;
+    }
+    return true;
+  }
+
+ private:
+  const std::vector<unsigned char> &tiff_;
+};
+
+static uint32_t Le32(const std::vector<unsigned char> &_data, size_t _offset)
+{
+  return _data[_offset] | (_data[_offset + 1] << 8) | (_data[_offset + 2] << 16) |
+      (static_cast<uint32_t>(_data[_offset + 3]) << 24);
+}
+
+static std::string Ascii(const TiffReader::Entry &_entry)
+{
+  if (_entry.type != 2 || _entry.data.empty() || _entry.data.back() != 0) {
+    return "<not a terminated ASCII value>";
+  }
+  return std::string(_entry.data.begin(), _entry.data.end() - 1);
+}
+
+/// \brief Rationals of an entry as numerator/denominator pairs.
+static std::vector<std::pair<uint32_t, uint32_t>> Rationals(const TiffReader::Entry &_entry)
+{
+  std::vector<std::pair<uint32_t, uint32_t>> values;
+  if (_entry.type == 5) {
+    for (uint32_t i = 0; i < _entry.count; ++i) {
+      values.push_back(std::make_pair(Le32(_entry.data, 8 * i), Le32(_entry.data, 8 * i + 4)));
+    }
+  }
+  return values;
+}
+
+/// \brief Angle from deg/1, min/1, sec/10000 as the GPS IFD stores it.
+static bool DegMinSec(const TiffReader::Entry &_entry, const std::string &_name, double &_angle)
+{
+  const std::vector<std::pair<uint32_t, uint32_t>> dms = Rationals(_entry);
+  if (dms.size() != 3 || dms[0].second != 1 || dms[1].second != 1 || dms[2].second != 10000) {
+    Check(false, _name + " is not deg/1 min/1 sec/10000");
+    return false;
+  }
+  Check(dms[1].first < 60 && dms[2].first < 600000, _name + " minutes or seconds not below 60");
+  _angle = dms[0].first + dms[1].first / 60.0 + dms[2].first / 10000.0 / 3600.0;
+  return true;
+}
+
+static void CheckGeotag(const std::vector<unsigned char> &_original, const std::vector<unsigned char> &_jpeg,
+                        const ExifGeotag &_tag)
+{
+  // the segments, the Exif one and the XMP one right after it go after the
+  // JFIF APP0, a later XMP segment is the image's own
+  std::vector<unsigned char> exif;
+  std::string xmp;
+  size_t position = 2;
+  size_t inserted = 0;
+  bool after_exif = false;
+  while (true) {
+    if (position + 4 > _jpeg.size() || _jpeg[position] != 0xff) {
+      Check(false, "broken segment chain at " + std::to_string(position));
+      return;
+    }
+    const unsigned char marker = _jpeg[position + 1];
+    const size_t length = (_jpeg[position + 2] << 8) | _jpeg[position + 3];
+    if (marker == 0xda) {
+      break;
+    }
+    if (marker == 0xe1 && exif.empty() && length > 8 && memcmp(&_jpeg[position + 4], "Exif\0\0", 6) == 0) {
+      exif.assign(_jpeg.begin() + position + 10, _jpeg.begin() + position + 2 + length);
+      inserted += 2 + length;
+      after_exif = true;
+    } else if (marker == 0xe1 && after_exif && length > 31 &&
+               memcmp(&_jpeg[position + 4], "http://ns.adobe.com/xap/1.0/\0", 29) == 0) {
+      xmp.assign(_jpeg.begin() + position + 33, _jpeg.begin() + position + 2 + length);
+      inserted += 2 + length;
+      after_exif = false;
+    } else {
+      Check(!exif.empty() || marker == 0xe0, "segment before the Exif one is not APP0");
+      after_exif = false;
+    }
+    position += 2 + length;
+  }
+  Check(_jpeg.size() == _original.size() + inserted, "image size is not the original plus the segments");
+  if (exif.size() < 8) {
+    Check(false, "no Exif segment");
+    return;
+  }
+  Check(exif[0] == 'I' && exif[1] == 'I' && exif[2] == 42 && exif[3] == 0, "TIFF header is not II 42");
+
+  TiffReader tiff(exif);
+  std::map<uint16_t, TiffReader::Entry> ifd0, exif_ifd, gps;
+  if (!tiff.ReadIfd(tiff.U32(4), "IFD0", ifd0) || !ifd0.count(0x8769) || !ifd0.count(0x8825)) {
+    Check(false, "IFD0 has no Exif or GPS IFD pointer");
+    return;
+  }
+  if (!tiff.ReadIfd(Le32(ifd0[0x8769].data, 0), "Exif IFD", exif_ifd) ||
+      !tiff.ReadIfd(Le32(ifd0[0x8825].data, 0), "GPS IFD", gps)) {
+    return;
+  }
+
+  const char *required[] = {"GPSLatitudeRef", "GPSLatitude", "GPSLongitudeRef", "GPSLongitude",
+                            "GPSAltitudeRef", "GPSAltitude", "GPSTimeStamp"};
+  for (uint16_t tag = 1; tag <= 7; ++tag) {
+    if (!gps.count(tag)) {
+      Check(false, std::string("no ") + required[tag - 1]);
+      return;
+    }
+  }
+  Check(Ascii(exif_ifd[0x9003]) == "2023:11:14 22:13:20", "DateTimeOriginal is " + Ascii(exif_ifd[0x9003]));
+  Check(Ascii(gps[0x001D]) == "2023:11:14", "GPSDateStamp is " + Ascii(gps[0x001D]));
+
+  // 1/10000 s of arc
+  const double tolerance = 0.5 / 10000.0 / 3600.0 + 1e-12;
+  double latitude, longitude;
+  if (DegMinSec(gps[2], "GPSLatitude", latitude)) {
+    if (Ascii(gps[1]) == "S") {
+      latitude = -latitude;
+    }
+    Check(std::fabs(latitude - _tag.latitude) <= tolerance, "latitude reads back as " + std::to_string(latitude));
+  }
+  if (DegMinSec(gps[4], "GPSLongitude", longitude)) {
+    if (Ascii(gps[3]) == "W") {
+      longitude = -longitude;
+    }
+    Check(std::fabs(longitude - _tag.longitude) <= tolerance, "longitude reads back as " + std::to_string(longitude));
+  }
+  const std::vector<std::pair<uint32_t, uint32_t>> altitude = Rationals(gps[6]);
+  if (altitude.size() == 1 && altitude[0].second && gps[5].data.size() == 1) {
+    const double value = (gps[5].data[0] ? -1.0 : 1.0) * altitude[0].first / altitude[0].second;
+    Check(std::fabs(value - _tag.altitude) <= 0.0005, "altitude reads back as " + std::to_string(value));
+  } else {
+    Check(false, "GPSAltitude is not one rational");
+  }
+  const std::vector<std::pair<uint32_t, uint32_t>> time = Rationals(gps[7]);
+  Check(time.size() == 3 && time[0] == std::make_pair(22u, 1u) && time[1] == std::make_pair(13u, 1u) &&
+        time[2] == std::make_pair(20250u, 1000u), "GPSTimeStamp is not 22:13:20.25");
+
+  if (_tag.has_attitude) {
+    const std::vector<std::pair<uint32_t, uint32_t>> direction = Rationals(gps[0x0011]);
+    Check(Ascii(gps[0x0010]) == "T" && direction.size() == 1 && direction[0].second &&
+          std::fabs(static_cast<double>(direction[0].first) / direction[0].second - _tag.yaw) <= 0.005,
+          "GPSImgDirection is not the yaw");
+    char attitude[128];
+    snprintf(attitude, sizeof(attitude), "Camera:Yaw=\"%.2f\" Camera:Pitch=\"%.2f\" Camera:Roll=\"%.2f\"",
+             _tag.yaw, _tag.pitch + 90.0, _tag.roll);
+    Check(xmp.find(attitude) != std::string::npos, std::string("XMP has no ") + attitude);
+  } else {
+    Check(!gps.count(0x0011) && xmp.empty(), "attitude tags without attitude");
+  }
+}
+
+static bool HaveExiftool()
+{
+  return system("exiftool -ver >/dev/null 2>&1") == 0;
+}
+
+/// \brief The position exiftool reads from _path, numeric.
+static bool ExiftoolPosition(const std::string &_path, double _position[3])
+{
+  const std::string command = "exiftool -n -s3 -GPSLatitude -GPSLongitude -GPSAltitude " + _path;
+  FILE *pipe = popen(command.c_str(), "r");
+  if (!pipe) {
+    return false;
+  }
+  const int read = fscanf(pipe, "%lf %lf %lf", &_position[0], &_position[1], &_position[2]);
+  pclose(pipe);
+  return read == 3;
+}
+
+int main(int _argc, char **_argv)
+{
+  const std::string image_file = _argc > 1 ? _argv[1] : "image.jpg";
+  std::vector<unsigned char> original;
+  if (!ReadFile(image_file, original)) {
+    printf("FAIL: could not read %s\n", image_file.c_str());
+    return 1;
+  }
+
+  // 2023-11-14 22:13:20.25 UTC, south and east, then north, west and below sea level
+  const ExifGeotag tags[] = {
+    {-47.3977419, 8.5455938, 488.123, 1700000000.25, 0.8, 13, true, 123.45, -90.0, 1.5},
+    {37.4133, -121.9989, -12.5, 1700000000.25, 1.2, 9, false, 0.0, 0.0, 0.0},
+  };
+  for (const ExifGeotag &tag : tags) {
+    std::vector<unsigned char> jpeg(original);
+    Check(InsertExifGeotag(jpeg, tag), "InsertExifGeotag rejected the image");
+    CheckGeotag(original, jpeg, tag);
+  }
+  std::vector<unsigned char> not_jpeg = {'P', 'N', 'G', 0};
+  Check(!InsertExifGeotag(not_jpeg, tags[0]) && not_jpeg.size() == 4, "tagged something that is not a JPEG");
+
+  const std::string tagged_file = "exif_geotag_check.jpg";
+  const bool exiftool = HaveExiftool();
+  if (exiftool) {
+    std::vector<unsigned char> jpeg(original);
+    InsertExifGeotag(jpeg, tags[0]);
+    double position[3];
+    if (WriteFile(tagged_file, jpeg) && ExiftoolPosition(tagged_file, position)) {
+      Check(std::fabs(position[0] - tags[0].latitude) < 1e-6 && std::fabs(position[1] - tags[0].longitude) < 1e-6 &&
+            std::fabs(position[2] - tags[0].altitude) < 0.001, "exiftool reads a different position");
+    } else {
+      Check(false, "exiftool could not read the tagged image");
+    }
+  }
+
+  // tagging in memory and writing the image once, as the plugin does now
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kNativeRuns; ++i) {
+    std::vector<unsigned char> jpeg(original);
+    InsertExifGeotag(jpeg, tags[0]);
+    WriteFile(tagged_file, jpeg);
+  }
+  const double native_us = std::chrono::duration<double, std::micro>(
+      std::chrono::steady_clock::now() - start).count() / kNativeRuns;
+  printf("InsertExifGeotag and write   %10.1f us/image\n", native_us);
+
+  if (exiftool) {
+    // the command the plugin ran on every written image
+    char command[512];
+    snprintf(command, sizeof(command),
+             "exiftool -gpslatituderef=S -gpslongituderef=E -gpsaltituderef=above"
+             " -gpslatitude=%.9lf -gpslongitude=%.9lf -datetimeoriginal=now -gpsdop=0.8"
+             " -gpsmeasuremode=3-d -gpssatellites=13 -gpsaltitude=%.3lf -overwrite_original %s >/dev/null 2>&1",
+             std::fabs(tags[0].latitude), tags[0].longitude, tags[0].altitude, tagged_file.c_str());
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kExiftoolRuns; ++i) {
+      WriteFile(tagged_file, original);
+      Check(system(command) == 0, "exiftool failed");
+    }
+    const double exiftool_us = std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start).count() / kExiftoolRuns;
+    printf("write and exiftool           %10.1f us/image\n", exiftool_us);
+    Check(native_us < exiftool_us, "InsertExifGeotag is slower than exiftool");
+  } else {
+    printf("exiftool not found, no read back or comparison with it\n");
+  }
+  remove(tagged_file.c_str());
+
+  if (g_failures == 0) {
+    printf("Exif geotags OK\n");
+  }
+  return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks GeoMagField::Evaluate against the test values of the WMM2015
+// report (epoch 2015.0, height above the ellipsoid 0 and 100 km).
+
+#include <cmath>
+#include <cstdio>
+
+#include "geo_mag_field.h"
+
+struct KnownAnswer {
+  double alt_km;
+  double lat_deg;
+  double lon_deg;
+  double field[3];  ///< north, east, down [nT]
+};
+
+static const KnownAnswer kKnownAnswers[] = {
+  {  0.0,  80.0,   0.0, { 6627.1,  -445.9,  54432.3}},
+  {  0.0,   0.0, 120.0, {39518.2,   392.9, -11252.4}},
+  {  0.0, -80.0, 240.0, { 5797.3, 15761.1, -52919.1}},
+  {100.0,  80.0,   0.0, { 6314.3,  -471.6,  52269.8}},
+  {100.0,   0.0, 120.0, {37535.6,   364.4, -10773.4}},
+  {100.0, -80.0, 240.0, { 5613.1, 14791.5, -50378.6}},
+};
+
+// the report rounds to 0.1 nT
+static const double kTolerance = 0.1;
+
+int main()
+{
+  int failures = 0;
+
+  for (const KnownAnswer &kat : kKnownAnswers) {
+    double field[3];
+    GeoMagField::Evaluate(kat.lat_deg * M_PI / 180.0, kat.lon_deg * M_PI / 180.0,
+                          kat.alt_km, kWmmEpoch, field);
+    for (int i = 0; i < 3; ++i) {
+      if (!(std::fabs(field[i] - kat.field[i]) <= kTolerance)) {
+        printf("FAIL: %g km %g N %g E component %d is %.1f nT, expected %.1f nT\n",
+               kat.alt_km, kat.lat_deg, kat.lon_deg, i, field[i], kat.field[i]);
+        ++failures;
+      }
+    }
+  }
+
+  if (failures == 0) {
+    printf("WMM2015 known answers OK\n");
+  }
+  return failures == 0 ? 0 : 1;
+}
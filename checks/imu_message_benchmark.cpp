@@ -0,0 +1,123 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Counts the heap allocations of filling the IMU message, the way the IMU
+// plugin did before (set_allocated_* with fresh sub-messages) and the way
+// it does now (FillImuMessage into a reused message). Fails if the reused
+// message allocates after the first fill.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "imu_message.h"
+
+static std::atomic<unsigned long> g_allocations(0);
+
+void *operator new(size_t _size)
+{
+  ++g_allocations;
+  void *p = std::malloc(_size ? _size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *_p) noexcept
+{
+  std::free(_p);
+}
+
+void operator delete(void *_p, size_t) noexcept
+{
+  std::free(_p);
+}
+
+static const int kFills = 100000;
+
+static ImuSample Sample(int _i)
+{
+  ImuSample sample;
+  sample.orientation[0] = 1.0;
+  sample.orientation[1] = 0.0;
+  sample.orientation[2] = 0.0;
+  sample.orientation[3] = 0.0;
+  for (int j = 0; j < 3; ++j) {
+    sample.angular_velocity[j] = 0.01 * j + _i * 1e-6;
+    sample.linear_acceleration[j] = 9.81 * (j == 2) + _i * 1e-6;
+  }
+  return sample;
+}
+
+// GazeboImuPlugin::OnUpdate before it reused the sub-messages
+static void FillAllocated(const ImuSample &_sample, sensor_msgs::msgs::Imu *_msg)
+{
+  gazebo::msgs::Quaternion *orientation = new gazebo::msgs::Quaternion();
+  orientation->set_w(_sample.orientation[0]);
+  orientation->set_x(_sample.orientation[1]);
+  orientation->set_y(_sample.orientation[2]);
+  orientation->set_z(_sample.orientation[3]);
+
+  gazebo::msgs::Vector3d *linear_acceleration = new gazebo::msgs::Vector3d();
+  linear_acceleration->set_x(_sample.linear_acceleration[0]);
+  linear_acceleration->set_y(_sample.linear_acceleration[1]);
+  linear_acceleration->set_z(_sample.linear_acceleration[2]);
+
+  gazebo::msgs::Vector3d *angular_velocity = new gazebo::msgs::Vector3d();
+  angular_velocity->set_x(_sample.angular_velocity[0]);
+  angular_velocity->set_y(_sample.angular_velocity[1]);
+  angular_velocity->set_z(_sample.angular_velocity[2]);
+
+  _msg->set_allocated_orientation(orientation);
+  _msg->set_allocated_linear_acceleration(linear_acceleration);
+  _msg->set_allocated_angular_velocity(angular_velocity);
+}
+
+template <typename Fill>
+static unsigned long Run(const char *_name, Fill _fill)
+{
+  sensor_msgs::msgs::Imu msg;
+  _fill(Sample(0), &msg);  // first fill allocates the sub-messages
+
+  const unsigned long allocations = g_allocations;
+  const auto start = std::chrono::steady_clock::now();
+  double sum = 0.0;
+  for (int i = 1; i <= kFills; ++i) {
+    _fill(Sample(i), &msg);
+    sum += msg.linear_acceleration().z();
+  }
+  const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  const unsigned long count = g_allocations - allocations;
+
+  printf("%-14s %8.2f allocations/fill %8.1f ns/fill (%g)\n", _name,
+         static_cast<double>(count) / kFills, ns / kFills, sum);
+  return count;
+}
+
+int main()
+{
+  Run("set_allocated", FillAllocated);
+  const unsigned long reused = Run("reused", FillImuMessage);
+
+  if (reused != 0) {
+    printf("FAIL: %lu allocations filling a reused message\n", reused);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Per rotor cost of GazeboMotorModel::OnUpdate. Runs
+// motor_model_benchmark.world, iris geometry with one motor model per rotor,
+// for kSteps physics steps and reports the OnUpdate probes of the motor
+// models. Then times, on the same rotor links, the lookups OnUpdate did
+// every step before the parent link and rotor axis were cached at Load
+// (GetParentJointsLinks and the CoG pose difference to the parent), so
+// before = after + removed lookups. Fails if the motor models did not run.
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+#include <gazebo/transport/transport.hh>
+
+#include "actuator_commands.h"
+#include "sensor_bus.h"
+#include "step_profiler.h"
+
+using namespace gazebo;
+
+static const int kSteps = 5000;
+static const int kLookups = 100000;
+static const int kRotors = 4;
+
+// Lookups of the old OnUpdate, per call
+static double RemovedLookupsNs(const physics::LinkPtr &_link)
+{
+  math::Vector3 sum;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kLookups; ++i) {
+    physics::LinkPtr parent = _link->GetParentJointsLinks().at(0);
+    math::Pose pose_difference = _link->GetWorldCoGPose() - parent->GetWorldCoGPose();
+    sum += pose_difference.rot.RotateVector(math::Vector3(0, 0, 1));
+  }
+  const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  if (sum.z == 0.0) {
+    printf("unexpected rotor axis\n");
+  }
+  return ns / kLookups;
+}
+
+int main(int _argc, char **_argv)
+{
+  const std::string world_file = _argc > 1 ? _argv[1] : "motor_model_benchmark.world";
+
+  gazebo::setupServer();
+  physics::WorldPtr world = gazebo::loadWorld(world_file);
+  if (!world) {
+    printf("FAIL: could not load %s\n", world_file.c_str());
+    return 1;
+  }
+  physics::ModelPtr model = world->GetModel("quad");
+
+  // spin the rotors through the same buffer the mavlink interface writes
+  transport::NodePtr node(new transport::Node());
+  node->Init();
+  std::shared_ptr<ActuatorCommands> commands = SensorBus::Instance().GetShared<ActuatorCommands>(
+      node->DecodeTopicName("~/" + model->GetName() + "/gazebo/command/motor_speed"));
+  const double speeds[kRotors] = {400.0, 400.0, 400.0, 400.0};
+
+  for (int i = 0; i < kSteps; ++i) {
+    commands->Write(world->GetSimTime().Double(), speeds, kRotors);
+    gazebo::runWorld(world, 1);
+  }
+
+  uint64_t count = 0;
+  uint64_t total_ns = 0;
+  for (const ProfileProbePtr &probe : StepProfiler::Instance().Probes()) {
+    const std::string &name = probe->Name();
+    if (name.compare(0, model->GetName().size() + 1, model->GetName() + "/") != 0 ||
+        name.find("_motor_model/OnUpdate") == std::string::npos) {
+      continue;
+    }
+    const LatencyStats stats = probe->Snapshot();
+    printf("%-36s %8lu calls  p50 %6lu ns  p99 %6lu ns  mean %8.1f ns\n", name.c_str(),
+           static_cast<unsigned long>(stats.count),
+           static_cast<unsigned long>(stats.Percentile(0.5)),
+           static_cast<unsigned long>(stats.Percentile(0.99)),
+           stats.count ? static_cast<double>(stats.total_ns) / stats.count : 0.0);
+    count += stats.count;
+    total_ns += stats.total_ns;
+  }
+
+  double removed_ns = 0.0;
+  for (int i = 0; i < kRotors; ++i) {
+    removed_ns += RemovedLookupsNs(model->GetLink("rotor_" + std::to_string(i)));
+  }
+  removed_ns /= kRotors;
+
+  gazebo::shutdown();
+
+  if (count == 0) {
+    printf("FAIL: no motor model updates, is GAZEBO_PLUGIN_PATH set?\n");
+    return 1;
+  }
+  const double after_ns = static_cast<double>(total_ns) / count;
+  printf("per rotor and step: after %.1f ns, removed lookups %.1f ns, before %.1f ns\n",
+         after_ns, removed_ns, after_ns + removed_ns);
+  return 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks Philox4x32::Generate against the Philox4x32-10 known answer
+// vectors of Random123 (kat_vectors), and that a world seed set through
+// NoiseStream::SetWorldSeed keys the streams of that world only.
+
+#include <cstdio>
+
+#include "noise_stream.h"
+
+struct KnownAnswer {
+  uint32_t counter[4];
+  uint32_t key[2];
+  uint32_t out[4];
+};
+
+static const KnownAnswer kKnownAnswers[] = {
+  {{0x00000000, 0x00000000, 0x00000000, 0x00000000},
+   {0x00000000, 0x00000000},
+   {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}},
+  {{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+   {0xffffffff, 0xffffffff},
+   {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}},
+  // digits of pi
+  {{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+   {0xa4093822, 0x299f31d0},
+   {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}},
+};
+
+int main()
+{
+  int failures = 0;
+
+  for (const KnownAnswer &kat : kKnownAnswers) {
+    uint32_t out[4];
+    Philox4x32::Generate(kat.counter, kat.key, out);
+    for (int i = 0; i < 4; ++i) {
+      if (out[i] != kat.out[i]) {
+        printf("FAIL: counter %08x... word %d is %08x, expected %08x\n",
+               kat.counter[0], i, out[i], kat.out[i]);
+        ++failures;
+      }
+    }
+  }
+
+  NoiseStream::SetWorldSeed("seeded", 42);
+  NoiseStream seeded("seeded", "iris/imu");
+  NoiseStream expected(42, NoiseStream::Hash("seeded/iris/imu"));
+  if (seeded.Gaussian() != expected.Gaussian()) {
+    printf("FAIL: world seed is not used by the streams of its world\n");
+    ++failures;
+  }
+  if (NoiseStream::WorldSeed("other") != NoiseStream::Seed()) {
+    printf("FAIL: world without a seed does not fall back to PX4_SIM_SEED\n");
+    ++failures;
+  }
+
+  if (failures == 0) {
+    printf("philox4x32-10 known answers and world seeds OK\n");
+  }
+  return failures == 0 ? 0 : 1;
+}
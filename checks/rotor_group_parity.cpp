@@ -0,0 +1,219 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Compares the summed force and torque of RotorGroupKernel with four
+// GazeboMotorModel instances on the iris geometry for one pose and velocity
+// state. GazeboMotorModel::UpdateForcesAndMoments is replayed step by step
+// in world frame: thrust along the rotor link z axis and rotor drag on the
+// rotor link, drag torque and rolling moment on the parent. The rotor link
+// velocity is the rigid body velocity v + w x r at the rotor origin. The
+// rotor forces are then moved to the parent CoG, as the joint does in the
+// physics step, and compared with the group which applies the sum at the
+// CoG plus r x F.
+//
+// The motor model projects the velocity onto the rotor plane with
+// math::Vector3's elementwise operator*, which is only the true projection
+// while the rotor axis is a world axis. The state is therefore level, with
+// yaw and all linear and angular velocity components set.
+
+#include <cmath>
+#include <cstdio>
+
+#include "rotor_group_kernel.h"
+
+namespace {
+
+// iris.xacro
+const double kMotorConstant = 8.54858e-06;
+const double kMomentConstant = 0.06;
+const double kRotorDragCoefficient = 8.06428e-04;
+const double kRollingMomentCoefficient = 0.000001;
+const double kSlowdown = 10.0;
+const double kRotorOffsetTop = 0.023;
+
+struct IrisRotor {
+  double x;
+  double y;
+  double direction;
+};
+
+const IrisRotor kIrisRotors[] = {
+  { 0.13, -0.22,  1.0},  // front right, ccw
+  {-0.13,  0.20,  1.0},  // back left, ccw
+  { 0.13,  0.22, -1.0},  // front left, cw
+  {-0.13, -0.20, -1.0},  // back right, cw
+};
+const int kRotors = 4;
+
+// joint velocities [rad/s], the rotors spin at 10 times this
+const double kRotorVelocity[kRotors] = {62.0, 64.5, -66.0, -61.5};
+
+// parent state, world frame
+const double kYaw = 0.7;
+const double kLinearVel[3] = {3.0, -1.5, 0.8};
+const double kAngularVel[3] = {0.4, -0.3, 0.9};
+
+const double kTolerance = 1e-9;
+
+void Cross(const double _a[3], const double _b[3], double _out[3])
+{
+  _out[0] = _a[1] * _b[2] - _a[2] * _b[1];
+  _out[1] = _a[2] * _b[0] - _a[0] * _b[2];
+  _out[2] = _a[0] * _b[1] - _a[1] * _b[0];
+}
+
+// rotation about z by kYaw, and back
+void ToWorld(const double _v[3], double _out[3])
+{
+  _out[0] = cos(kYaw) * _v[0] - sin(kYaw) * _v[1];
+  _out[1] = sin(kYaw) * _v[0] + cos(kYaw) * _v[1];
+  _out[2] = _v[2];
+}
+
+void ToParent(const double _v[3], double _out[3])
+{
+  _out[0] = cos(kYaw) * _v[0] + sin(kYaw) * _v[1];
+  _out[1] = -sin(kYaw) * _v[0] + cos(kYaw) * _v[1];
+  _out[2] = _v[2];
+}
+
+// GazeboMotorModel::UpdateForcesAndMoments for every rotor, summed about
+// the parent CoG in world frame
+void MotorModels(double _force[3], double _torque[3])
+{
+  for (int j = 0; j < 3; ++j) {
+    _force[j] = 0.0;
+    _torque[j] = 0.0;
+  }
+
+  for (int i = 0; i < kRotors; ++i) {
+    const double r_parent[3] = {kIrisRotors[i].x, kIrisRotors[i].y, kRotorOffsetTop};
+    double r[3];
+    ToWorld(r_parent, r);
+
+    // link_->GetWorldLinearVel()
+    double w_x_r[3];
+    Cross(kAngularVel, r, w_x_r);
+    double body_velocity[3];
+    for (int j = 0; j < 3; ++j) {
+      body_velocity[j] = kLinearVel[j] + w_x_r[j];
+    }
+
+    const double real_motor_velocity = kRotorVelocity[i] * kSlowdown;
+    const double force = real_motor_velocity * real_motor_velocity * kMotorConstant;
+    const double vel = sqrt(body_velocity[0] * body_velocity[0] + body_velocity[1] * body_velocity[1] +
+                            body_velocity[2] * body_velocity[2]);
+    const double scalar = std::fmin(std::fmax(1 - vel / 25.0, 0.0), 1.0);
+
+    // link_->AddRelativeForce(math::Vector3(0, 0, force * scalar))
+    const double thrust_link[3] = {0.0, 0.0, force * scalar};
+    double rotor_force[3];
+    ToWorld(thrust_link, rotor_force);
+
+    // link_->AddForce(air_drag), operator* of math::Vector3 is elementwise
+    const double joint_axis_parent[3] = {0.0, 0.0, 1.0};
+    double joint_axis[3];
+    ToWorld(joint_axis_parent, joint_axis);
+    double perpendicular[3];
+    for (int j = 0; j < 3; ++j) {
+      perpendicular[j] = body_velocity[j] - (body_velocity[j] * joint_axis[j]) * joint_axis[j];
+      rotor_force[j] += -std::abs(real_motor_velocity) * kRotorDragCoefficient * perpendicular[j];
+    }
+
+    // parent_link_->AddRelativeTorque(drag_torque_parent_frame)
+    const double drag_torque_parent[3] = {0.0, 0.0, -kIrisRotors[i].direction * force * kMomentConstant};
+    double drag_torque[3];
+    ToWorld(drag_torque_parent, drag_torque);
+
+    // the rotor force acts on the rotor link, about the parent CoG it adds r x F
+    double moment[3];
+    Cross(r, rotor_force, moment);
+
+    for (int j = 0; j < 3; ++j) {
+      // parent_link_->AddTorque(rolling_moment)
+      const double rolling_moment = -std::abs(real_motor_velocity) * kRollingMomentCoefficient * perpendicular[j];
+      _force[j] += rotor_force[j];
+      _torque[j] += moment[j] + drag_torque[j] + rolling_moment;
+    }
+  }
+}
+
+void RotorGroup(double _force[3], double _torque[3])
+{
+  RotorGroupKernel kernel;
+  for (int i = 0; i < kRotors; ++i) {
+    RotorGroupRotor rotor;
+    rotor.direction = kIrisRotors[i].direction;
+    rotor.max_rot_velocity = 1100.0;
+    rotor.motor_constant = kMotorConstant;
+    rotor.moment_constant = kMomentConstant;
+    rotor.rotor_drag_coefficient = kRotorDragCoefficient;
+    rotor.rolling_moment_coefficient = kRollingMomentCoefficient;
+    rotor.rotor_velocity_slowdown_sim = kSlowdown;
+    rotor.time_constant_up = 0.0125;
+    rotor.time_constant_down = 0.025;
+    rotor.position[0] = kIrisRotors[i].x;
+    rotor.position[1] = kIrisRotors[i].y;
+    rotor.position[2] = kRotorOffsetTop;
+    rotor.thrust_axis[0] = 0.0;
+    rotor.thrust_axis[1] = 0.0;
+    rotor.thrust_axis[2] = 1.0;
+    rotor.joint_axis[0] = 0.0;
+    rotor.joint_axis[1] = 0.0;
+    rotor.joint_axis[2] = 1.0;
+    kernel.AddRotor(rotor);
+    kernel.SetRotorVelocity(i, kRotorVelocity[i]);
+  }
+  kernel.SetSamplingTime(0.004);
+
+  // GazeboRotorGroupPlugin::OnUpdate hands the kernel parent frame velocities
+  double linear_vel[3];
+  double angular_vel[3];
+  ToParent(kLinearVel, linear_vel);
+  ToParent(kAngularVel, angular_vel);
+
+  double force[3];
+  double torque[3];
+  kernel.Update(linear_vel, angular_vel, force, torque);
+  ToWorld(force, _force);
+  ToWorld(torque, _torque);
+}
+
+}  // namespace
+
+int main()
+{
+  double motor_force[3], motor_torque[3];
+  double group_force[3], group_torque[3];
+  MotorModels(motor_force, motor_torque);
+  RotorGroup(group_force, group_torque);
+
+  int failures = 0;
+  for (int j = 0; j < 3; ++j) {
+    printf("%c force %12.6f %12.6f N   torque %12.6f %12.6f Nm\n", "xyz"[j],
+           motor_force[j], group_force[j], motor_torque[j], group_torque[j]);
+    if (!(std::abs(motor_force[j] - group_force[j]) <= kTolerance) ||
+        !(std::abs(motor_torque[j] - group_torque[j]) <= kTolerance)) {
+      ++failures;
+    }
+  }
+
+  if (failures != 0) {
+    printf("FAIL: rotor group and motor models differ\n");
+    return 1;
+  }
+  printf("rotor group matches the motor models\n");
+  return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_ACTUATOR_COMMANDS_H_
+#define SITL_GAZEBO_ACTUATOR_COMMANDS_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+
+/**
+ * \brief Motor speed commands of one vehicle shared between plugins.
+ *
+ * The mavlink interface writes the commands of a step and every rotor
+ * plugin reads its own index, replacing one CommandMotorSpeed message per
+ * step that every rotor deserialized in full. Obtained from the SensorBus
+ * under the name of the gazebo command topic it replaces.
+ *
+ * Double buffered by sim time: a read at time t returns the newest commands
+ * written before t. Rotors therefore always act on the previous step's
+ * commands, no matter whether the writer or the reader is updated first.
+ */
+class ActuatorCommands {
+ public:
+  static const size_t kMaxActuators = 16;
+
+  ActuatorCommands() : latest_(0), written_(false) {
+    for (Slot &slot : slots_) {
+      slot.sim_time = 0.0;
+      slot.count = 0;
+      std::fill(slot.values, slot.values + kMaxActuators, 0.0);
+    }
+  }
+
+  /// \brief Sets the commands for _sim_time, extra values are dropped.
+  void Write(double _sim_time, const double *_values, size_t _count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // a second write in the same step replaces the first one
+    if (!written_ || slots_[latest_].sim_time != _sim_time) {
+      latest_ ^= 1;
+    }
+    Slot &slot = slots_[latest_];
+    slot.sim_time = _sim_time;
+    slot.count = _count < kMaxActuators ? _count : kMaxActuators;
+    std::copy(_values, _values + slot.count, slot.values);
+    written_ = true;
+  }
+
+  /// \brief Command _index of the newest step before _sim_time.
+  /// \return false if there is no such command.
+  bool Read(double _sim_time, size_t _index, double *_value) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!written_) {
+      return false;
+    }
+    const Slot *slot = &slots_[latest_];
+    if (slot->sim_time >= _sim_time) {
+      slot = &slots_[latest_ ^ 1];
+      if (slot->count == 0 || slot->sim_time >= _sim_time) {
+        return false;
+      }
+    }
+    if (_index >= slot->count) {
+      return false;
+    }
+    *_value = slot->values[_index];
+    return true;
+  }
+
+  /// \brief Whether a writer is feeding this buffer.
+  bool Written() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return written_;
+  }
+
+ private:
+  struct Slot {
+    double sim_time;
+    size_t count;
+    double values[kMaxActuators];
+  };
+
+  mutable std::mutex mutex_;
+  Slot slots_[2];
+  int latest_;
+  bool written_;
+};
+
+#endif  // SITL_GAZEBO_ACTUATOR_COMMANDS_H_
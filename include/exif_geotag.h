@@ -0,0 +1,58 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_EXIF_GEOTAG_H_
+#define SITL_GAZEBO_EXIF_GEOTAG_H_
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Geotags for JPEG images
+ *
+ * Written into the encoded image in memory, so an image is written to disk
+ * once and no external tool runs per picture. Two APP1 segments are
+ * inserted after the JFIF header:
+ *
+ *   Exif  IFD0 with the Exif IFD (DateTimeOriginal) and the GPS IFD
+ *         (position, altitude, UTC date and time, satellites, measure mode,
+ *         DOP and the true heading of the camera as GPSImgDirection).
+ *   XMP   the camera attitude as Camera:Yaw, Camera:Pitch and Camera:Roll
+ *         of the http://pix4d.com/camera/1.0/ namespace. The camera looks
+ *         down at 0/0/0 with the top of the image pointing north, pitch 90
+ *         is the horizon.
+ */
+
+struct ExifGeotag {
+  double latitude;    ///< [deg], north positive
+  double longitude;   ///< [deg], east positive
+  double altitude;    ///< [m] above mean sea level
+  double utc_time;    ///< [s] since the epoch
+  double dop;
+  int satellites;
+  bool has_attitude;  ///< whether the angles below are set
+  double yaw;         ///< heading of the optical axis [deg], clockwise from north
+  double pitch;       ///< elevation of the optical axis [deg], -90 is nadir
+  double roll;        ///< about the optical axis [deg], right side down positive
+};
+
+/**
+ * \brief Inserts the tags into the JPEG image _jpeg.
+ * \return false if _jpeg is not a JPEG image, it is left unchanged then.
+ */
+bool InsertExifGeotag(std::vector<unsigned char> &_jpeg, const ExifGeotag &_tag);
+
+#endif  // SITL_GAZEBO_EXIF_GEOTAG_H_
@@ -0,0 +1,273 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_FLIGHT_RECORD_H_
+#define SITL_GAZEBO_FLIGHT_RECORD_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+/**
+ * Flight record files
+ *
+ * One file per stream of fixed size records, e.g. the ground truth of a
+ * vehicle. The file is a 4 kB header followed by a ring of `capacity`
+ * records. `written` counts all records ever appended, the ring holds the
+ * last min(written, capacity) of them, the oldest at index written %
+ * capacity once it wrapped. All values are in host byte order.
+ *
+ * The header carries the record layout as text, "name:type[xcount];...",
+ * with type f8 (double), u4 (uint32) or u1 (uint8), so readers don't need
+ * this header.
+ */
+
+static const char kFlightRecordMagic[8] = {'S', 'I', 'T', 'L', 'R', 'E', 'C', '1'};
+static const uint32_t kFlightRecordVersion = 1;
+static const uint32_t kFlightRecordHeaderSize = 4096;
+
+struct FlightRecordHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;  ///< offset of the first record
+  uint32_t record_type;
+  uint32_t record_size;
+  uint64_t capacity;     ///< records in the ring
+  uint64_t written;      ///< records appended so far
+  char stream[64];
+  char format[512];
+};
+
+/// \brief Ground truth of a model, world frame (ENU), body angular rate.
+struct TruthRecord {
+  static const uint32_t kType = 1;
+  static const char *Format() {
+    return "sim_time:f8;position:f8x3;orientation:f8x4;linear_velocity:f8x3;"
+           "angular_velocity:f8x3;linear_acceleration:f8x3";
+  }
+
+  double sim_time;
+  double position[3];             ///< [m]
+  double orientation[4];          ///< w, x, y, z
+  double linear_velocity[3];      ///< [m/s]
+  double angular_velocity[3];     ///< body frame [rad/s]
+  double linear_acceleration[3];  ///< [m/s^2]
+};
+
+/// \brief IMU sample before and after the noise model, body frame.
+struct ImuRecord {
+  static const uint32_t kType = 2;
+  static const char *Format() {
+    return "sim_time:f8;linear_acceleration_true:f8x3;angular_velocity_true:f8x3;"
+           "linear_acceleration:f8x3;angular_velocity:f8x3;accelerometer_bias:f8x3;"
+           "gyroscope_bias:f8x3";
+  }
+
+  double sim_time;
+  double linear_acceleration_true[3];  ///< specific force [m/s^2]
+  double angular_velocity_true[3];     ///< [rad/s]
+  double linear_acceleration[3];       ///< as sent to the autopilot
+  double angular_velocity[3];
+  double accelerometer_bias[3];        ///< random walk plus turn on bias
+  double gyroscope_bias[3];
+};
+
+/// \brief GPS sample, true position and the error model state.
+struct GpsRecord {
+  static const uint32_t kType = 3;
+  static const char *Format() {
+    return "sim_time:f8;latitude:f8;longitude:f8;altitude:f8;velocity_ned:f8x3;"
+           "bias:f8x3;noise:f8x3";
+  }
+
+  double sim_time;
+  double latitude;         ///< true [deg]
+  double longitude;        ///< true [deg]
+  double altitude;         ///< true AMSL [m]
+  double velocity_ned[3];  ///< true [m/s]
+  double bias[3];          ///< north, east [m] and up [mm], as applied
+  double noise[3];         ///< white noise of this sample, same units
+};
+
+/// \brief Rotor velocities and the commands they follow.
+struct MotorRecord {
+  static const uint32_t kType = 4;
+  static const int kMaxMotors = 16;
+  static const char *Format() {
+    return "sim_time:f8;count:u4;reserved:u4;velocity:f8x16;command:f8x16";
+  }
+
+  double sim_time;
+  uint32_t count;
+  uint32_t reserved;
+  double velocity[kMaxMotors];  ///< joint velocity times the slowdown [rad/s]
+  double command[kMaxMotors];   ///< NaN if no command was received
+};
+
+/// \brief One MAVLink packet as sent to the autopilot.
+struct MavlinkRecord {
+  static const uint32_t kType = 5;
+  static const int kMaxPacketLen = 280;  ///< MAVLINK_MAX_PACKET_LEN of MAVLink 2
+  static const char *Format() {
+    return "sim_time:f8;msgid:u4;len:u4;packet:u1x280";
+  }
+
+  double sim_time;
+  uint32_t msgid;
+  uint32_t len;
+  uint8_t packet[kMaxPacketLen];  ///< encoded packet, len bytes used
+};
+
+/**
+ * \brief Writer of one record file.
+ *
+ * The whole file is allocated on disk and mapped when it is created, so
+ * Append() is a copy into memory and the kernel writes the pages back in
+ * the background, the simulation thread never waits for the disk.
+ */
+class FlightRecordFile {
+ public:
+  /// \brief Creates (or truncates) _path, nullptr on failure.
+  template <typename R>
+  static std::unique_ptr<FlightRecordFile> Create(const std::string &_path,
+                                                  const std::string &_stream,
+                                                  uint64_t _capacity) {
+    return Create(_path, _stream, R::kType, sizeof(R), R::Format(), _capacity);
+  }
+
+  static std::unique_ptr<FlightRecordFile> Create(const std::string &_path,
+                                                  const std::string &_stream,
+                                                  uint32_t _record_type,
+                                                  uint32_t _record_size,
+                                                  const char *_format,
+                                                  uint64_t _capacity);
+
+  ~FlightRecordFile();
+
+  uint32_t RecordType() const { return header_->record_type; }
+
+  void Append(const void *_record) {
+    const uint64_t written = header_->written;
+    std::memcpy(records_ + (written % capacity_) * record_size_, _record, record_size_);
+    // publish the record to readers of the live file
+    __atomic_store_n(&header_->written, written + 1, __ATOMIC_RELEASE);
+  }
+
+ private:
+  FlightRecordFile(int _fd, void *_map, size_t _map_size);
+
+  int fd_;
+  void *map_;
+  size_t map_size_;
+  FlightRecordHeader *header_;
+  char *records_;
+  uint64_t capacity_;
+  size_t record_size_;
+};
+
+/**
+ * \brief Named point where a plugin appends the records of one stream.
+ *
+ * Shared through SensorBus::GetShared() under FlightRecordStreamName(), so
+ * the sensor plugins write their records without knowing whether a
+ * recorder is loaded. The recorder attaches a file, until then Append() is
+ * a single load and compare.
+ * Attach and Append are expected from the simulation thread.
+ */
+class FlightRecordStream {
+ public:
+  FlightRecordStream() : file_(nullptr) {}
+
+  bool Active() const { return file_.load(std::memory_order_relaxed) != nullptr; }
+
+  template <typename R>
+  void Append(const R &_record) {
+    FlightRecordFile *file = file_.load(std::memory_order_relaxed);
+    if (file && file->RecordType() == R::kType) {
+      file->Append(&_record);
+    }
+  }
+
+  /// \brief Attaches _file, nullptr detaches. The caller keeps ownership.
+  void Attach(FlightRecordFile *_file) { file_.store(_file, std::memory_order_relaxed); }
+
+ private:
+  std::atomic<FlightRecordFile *> file_;
+};
+
+/// \brief Name of the FlightRecordStream _stream of _model.
+inline std::string FlightRecordStreamName(const std::string &_model, const std::string &_stream) {
+  return _model + "/record/" + _stream;
+}
+
+/**
+ * \brief Read only view of a record file, also of one still being written.
+ *
+ *   FlightRecordReader reader;
+ *   if (reader.Open("iris.truth.rec")) {
+ *     for (uint64_t i = 0; i < reader.Size(); ++i) {
+ *       const TruthRecord *truth = reader.Get<TruthRecord>(i);
+ *       ...
+ */
+class FlightRecordReader {
+ public:
+  FlightRecordReader();
+  ~FlightRecordReader();
+
+  bool Open(const std::string &_path);
+  void Close();
+
+  const FlightRecordHeader &Header() const { return *header_; }
+
+  /// \brief Takes in the records appended since Open() or the last Refresh().
+  void Refresh();
+
+  /// \brief Records available, at most the capacity.
+  uint64_t Size() const { return size_; }
+
+  /// \brief Records lost because the ring wrapped.
+  uint64_t Overwritten() const { return first_; }
+
+  /// \brief The _index-th oldest record.
+  const void *Record(uint64_t _index) const {
+    return records_ + ((first_ + _index) % header_->capacity) * header_->record_size;
+  }
+
+  /// \brief The _index-th oldest record, nullptr if the file holds another type.
+  template <typename R>
+  const R *Get(uint64_t _index) const {
+    if (header_->record_type != R::kType || header_->record_size != sizeof(R)) {
+      return nullptr;
+    }
+    return static_cast<const R *>(Record(_index));
+  }
+
+ private:
+  FlightRecordReader(const FlightRecordReader &) = delete;
+  FlightRecordReader &operator=(const FlightRecordReader &) = delete;
+
+  void *map_;
+  size_t map_size_;
+  const FlightRecordHeader *header_;
+  const char *records_;
+  uint64_t first_;
+  uint64_t size_;
+};
+
+#endif  // SITL_GAZEBO_FLIGHT_RECORD_H_
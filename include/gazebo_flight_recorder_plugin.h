@@ -0,0 +1,109 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_FLIGHT_RECORDER_PLUGIN_H_
+#define SITL_GAZEBO_FLIGHT_RECORDER_PLUGIN_H_
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <gazebo/common/common.hh>
+#include <gazebo/common/Plugin.hh>
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+#include "gazebo/transport/transport.hh"
+
+#include "actuator_commands.h"
+#include "common.h"
+#include "flight_record.h"
+#include "sensor_bus.h"
+#include "step_profiler.h"
+
+namespace gazebo {
+
+static const std::string kDefaultRecordDir = ".";
+static constexpr double kDefaultRecordDuration = 300.0;  // [s] of sim time kept per stream
+static const std::string kDefaultRecordLinkName = "base_link";
+static const std::string kDefaultRecordCommandTopic = "/gazebo/command/motor_speed";
+static constexpr double kDefaultRecordRotorVelocitySlowdownSim = 10.0;
+
+/**
+ * \brief Records the simulator side truth of a vehicle.
+ *
+ * Writes one record file per stream to <output_dir>/<model>.<stream>.rec:
+ *
+ *   truth   pose, velocities and acceleration of the link, every step
+ *   motors  rotor velocities and commands, every step
+ *   imu     clean and noisy IMU samples and the bias states (IMU plugin)
+ *   gps     true GPS position and the error model state (GPS plugin)
+ *
+ * The files are rings holding the last `duration` seconds of sim time.
+ * See flight_record.h for the format and scripts/flight_record.py to read
+ * them.
+ *
+ *   <plugin name='flight_recorder' filename='libgazebo_flight_recorder_plugin.so'>
+ *     <robotNamespace></robotNamespace>
+ *     <output_dir>/tmp/records</output_dir>
+ *     <duration>300</duration>
+ *     <linkName>base_link</linkName>
+ *   </plugin>
+ */
+class GazeboFlightRecorderPlugin : public ModelPlugin {
+ public:
+  GazeboFlightRecorderPlugin();
+  ~GazeboFlightRecorderPlugin();
+
+ protected:
+  void Load(physics::ModelPtr _model, sdf::ElementPtr _sdf);
+
+ private:
+  void OnUpdate(const common::UpdateInfo &_info);
+
+  template <typename R>
+  std::unique_ptr<FlightRecordFile> CreateFile(const std::string &_stream);
+
+  std::string namespace_;
+  std::string output_dir_;
+  std::string link_name_;
+  std::string command_sub_topic_;
+  double duration_;
+  double rotor_velocity_slowdown_sim_;
+  uint64_t capacity_;
+
+  transport::NodePtr node_handle_;
+  physics::ModelPtr model_;
+  physics::LinkPtr link_;
+  event::ConnectionPtr update_connection_;
+  ProfileProbePtr update_probe_;
+
+  /// \brief Rotor joints ordered by motor number.
+  std::vector<std::pair<int, physics::JointPtr> > motors_;
+  std::shared_ptr<ActuatorCommands> actuator_commands_;
+
+  std::unique_ptr<FlightRecordFile> truth_file_;
+  std::unique_ptr<FlightRecordFile> motor_file_;
+  std::unique_ptr<FlightRecordFile> imu_file_;
+  std::unique_ptr<FlightRecordFile> gps_file_;
+  std::shared_ptr<FlightRecordStream> imu_stream_;
+  std::shared_ptr<FlightRecordStream> gps_stream_;
+};
+
+}
+
+#endif  // SITL_GAZEBO_FLIGHT_RECORDER_PLUGIN_H_
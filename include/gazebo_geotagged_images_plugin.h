@@ -16,7 +16,13 @@
 */
 #pragma once
 
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <gazebo/common/Plugin.hh>
 #include <gazebo/sensors/CameraSensor.hh>
@@ -29,13 +35,31 @@
 #include <gazebo/physics/physics.hh>
 #include <gazebo/rendering/rendering.hh>
 
+#include "common.h"
 #include "mavlink/v2.0/common/mavlink.h"
+#include "mavlink_multiplexer.h"
+#include "sim_scheduler.h"
 
 namespace gazebo
 {
+// camera commands are not time critical, no need to poll them every step
+static constexpr double kGeotagCommandPollInterval = 0.02;  // [s]
+static const int kGeotagDefaultWriterThreads = 2;
+// frames captured but not written yet, further captures fail
+static const int kGeotagDefaultMaxPendingImages = 8;
+// fixed GPS quality reported in the geotags
+static constexpr double kGeotagDop = 0.8;
+static const int kGeotagSatellites = 13;
+
 /**
  * @class GeotaggedImagesPlugin
  * Gazebo plugin that saves geotagged camera images to disk.
+ *
+ * The rendering thread only copies a captured frame into a pooled buffer,
+ * color conversion, scaling, JPEG encoding and geotagging (exif_geotag.h)
+ * are done by
+ * `writer_threads` workers. CAMERA_IMAGE_CAPTURED is sent once the image is
+ * on disk, with the sequence number the capture got.
  */
 class GAZEBO_VISIBLE GeotaggedImagesPlugin : public SensorPlugin
 {
@@ -44,7 +68,7 @@ class GAZEBO_VISIBLE GeotaggedImagesPlugin : public SensorPlugin
   public: virtual ~GeotaggedImagesPlugin();
 
   public: virtual void Load(sensors::SensorPtr sensor, sdf::ElementPtr sdf);
-  public: void OnUpdate(const common::UpdateInfo& /*_info*/);
+  public: void OnCommandPoll(double _due);
   void send_mavlink_message(const mavlink_message_t *message, const int destination_port=0);
   void handle_message(mavlink_message_t *msg);
   void pollForMAVLinkMessages(double _dt, uint32_t _timeoutMs);
@@ -53,13 +77,29 @@ class GAZEBO_VISIBLE GeotaggedImagesPlugin : public SensorPlugin
   public: void OnNewGpsPosition(ConstVector3dPtr& v);
   public: void TakePicture();
 
+  /// \brief A captured frame on its way to disk.
+  private: struct ImageJob {
+    std::vector<unsigned char> rgb;  ///< pooled, width_ * height_ * 3
+    int sequence;
+    double simTime;
+    double latitude, longitude, altitude;
+    double utcTime;  ///< wall clock [s]
+    double roll, pitch, yaw;  ///< of the camera, FRD and NED [deg]
+    std::string fileName;
+    bool success;
+  };
+
+  private: void WriterThread();
+  private: bool WriteImage(ImageJob &job);
+  /// \brief Reports the images written since the last call, physics thread.
+  private: void SendCaptureResults();
+
   protected: float storeIntervalSec_;
   private: int imageCounter_;
   common::Time lastImageTime_{};
-  common::Time last_time_{};
 
-  /// \brief Pointer to the update event connection.
-  event::ConnectionPtr updateConnection_;
+  /// \brief Polls the MAVLink channel for commands.
+  SimTimerPtr pollTimer_;
 
   protected: sensors::CameraSensorPtr parentSensor_;
   protected: rendering::CameraPtr camera_;
@@ -77,14 +117,21 @@ class GAZEBO_VISIBLE GeotaggedImagesPlugin : public SensorPlugin
   protected: std::string format_;
   protected: bool capture_;
 
-  private: int _fd;
-  private: struct sockaddr_in _myaddr;    ///< The locally bound address
+  private: MavlinkMultiplexer::ChannelPtr mavlink_channel_;
   private: struct sockaddr_in _srcaddr;   ///< SITL instance
-  private: socklen_t _addrlen;
-  private: unsigned char _buf[65535];
-  private: struct pollfd fds[1];
   private: in_addr_t mavlink_addr_;
   private: int mavlink_udp_port_ = 14558;
+  private: int mavlink_cam_udp_port_ = 14530;
+
+  // image writer pool
+  private: std::vector<std::thread> writers_;
+  private: std::mutex jobMutex_;
+  private: std::condition_variable jobReady_;
+  private: std::deque<ImageJob> pendingJobs_;   ///< captured, not written yet
+  private: std::deque<ImageJob> finishedJobs_;  ///< written, not reported yet
+  private: std::vector<std::vector<unsigned char> > freeBuffers_;
+  private: bool stopWriters_ = false;
+  private: unsigned droppedImages_ = 0;
 };
 
 } /* namespace gazebo */
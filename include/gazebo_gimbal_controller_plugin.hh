@@ -31,6 +31,8 @@
 #include <gazebo/util/system.hh>
 #include <gazebo/sensors/sensors.hh>
 
+#include "sim_scheduler.h"
+
 namespace gazebo
 {
   class GAZEBO_VISIBLE GimbalControllerPlugin : public ModelPlugin
@@ -44,6 +46,9 @@ namespace gazebo
 
     private: void OnUpdate();
 
+    /// \brief Publishes the joint angles, every 100 physics steps.
+    private: void OnStatusTimer(double _due);
+
 #if GAZEBO_MAJOR_VERSION >= 7 && GAZEBO_MINOR_VERSION >= 4
     /// only gazebo 7.4 and above support Any
     private: void OnPitchStringMsg(ConstAnyPtr &_msg);
@@ -108,6 +113,9 @@ namespace gazebo
     private: common::PID yawPid;
     private: common::Time lastUpdateTime;
 
+    private: double statusInterval;
+    private: SimTimerPtr statusTimer;
+
     private: ignition::math::Vector3d ThreeAxisRot(
       double r11, double r12, double r21, double r31, double r32);
     private: ignition::math::Vector3d QtoZXY(
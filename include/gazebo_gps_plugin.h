@@ -0,0 +1,118 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_GPS_PLUGIN_H_
+#define SITL_GAZEBO_GPS_PLUGIN_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <gazebo/common/common.hh>
+#include <gazebo/common/Plugin.hh>
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+#include "gazebo/transport/transport.hh"
+#include "gazebo/msgs/msgs.hh"
+
+#include "common.h"
+#include "flight_record.h"
+#include "geo_projection.h"
+#include "noise_stream.h"
+#include "sensor_bus.h"
+#include "sim_scheduler.h"
+#include "step_profiler.h"
+#include "throttled_publisher.h"
+
+namespace gazebo {
+
+static const std::string kDefaultGpsTopic = "/gps";
+static constexpr double kDefaultGpsUpdateRate = 5.0;  // [Hz]
+static constexpr double kDefaultGpsDelay = 0.12;  // [s]
+static constexpr double kDefaultGpsNoiseDensity = 2e-4;  // (m) / sqrt(hz)
+static constexpr double kDefaultGpsRandomWalk = 1.0;  // (m/s) / sqrt(hz)
+static constexpr double kDefaultGpsCorrelationTime = 30.0;  // [s]
+// The GPS position is only published at the GPS rate anyway.
+static constexpr double kDefaultGpsPositionPubRate = kUnlimitedPubRate;  // [Hz]
+// scale of the unit normal samples, tuned together with the defaults above
+static constexpr double kGpsNoiseStdDev = 0.01;
+
+/**
+ * \brief GPS receiver of a vehicle.
+ *
+ * Takes a fix of the model position every 1/update_rate seconds of sim time
+ * and publishes it gps_delay seconds later on the SensorBus, where the
+ * mavlink interface turns it into HIL_GPS. Fixes taken but not yet due wait
+ * in a ring. Both run from SimScheduler timers, the plugin does nothing on
+ * the steps in between.
+ *
+ *   <plugin name='gps_plugin' filename='libgazebo_gps_plugin.so'>
+ *     <robotNamespace></robotNamespace>
+ *     <gpsTopic>/gps</gpsTopic>
+ *     <update_rate>5</update_rate>
+ *     <gps_delay>0.12</gps_delay>
+ *   </plugin>
+ */
+class GazeboGpsPlugin : public ModelPlugin {
+ public:
+  GazeboGpsPlugin();
+  ~GazeboGpsPlugin();
+
+ protected:
+  void Load(physics::ModelPtr _model, sdf::ElementPtr _sdf);
+
+ private:
+  void OnFix(double _due);
+  void OnPublish(double _due);
+  /// \brief Samples the model state and the error model into a fix.
+  void TakeFix(double _sim_time, GpsSample *_fix);
+
+  std::string namespace_;
+  std::string gps_topic_;
+  double update_interval_;
+  double delay_;
+  double noise_density_;
+  double random_walk_;
+  double correlation_time_;
+
+  transport::NodePtr node_handle_;
+  physics::ModelPtr model_;
+  SimTimerPtr fix_timer_;
+  SimTimerPtr publish_timer_;  ///< armed for the oldest pending fix
+  ProfileProbePtr fix_probe_;
+  ProfileProbePtr publish_probe_;
+
+  std::shared_ptr<SensorTopic<GpsSample> > gps_bus_topic_;
+  ThrottledPublisher<msgs::Vector3d> gps_position_pub_;
+  std::shared_ptr<FlightRecordStream> gps_record_;
+
+  GeoProjection geo_projection_;
+  double alt_home_;
+  NoiseStream noise_;
+  double bias_[3];
+
+  double last_fix_time_;
+
+  /// \brief Fixes taken but not published yet, oldest at pending_head_.
+  std::vector<GpsSample> pending_;
+  size_t pending_head_;
+  size_t pending_count_;
+};
+
+}
+
+#endif  // SITL_GAZEBO_GPS_PLUGIN_H_
@@ -16,8 +16,13 @@
 */
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <mutex>
+#include <vector>
 
 #include "gazebo/common/Plugin.hh"
 #include "gazebo/sensors/CameraSensor.hh"
@@ -28,15 +33,57 @@
 #include "gazebo/transport/transport.hh"
 #include "gazebo/msgs/msgs.hh"
 
+#include <pthread.h>
 #include <gst/gst.h>
 
+#include "common.h"
+#include "video_shm.h"
+
+struct GstEncoderInfo;
+
 namespace gazebo
 {
+/// \brief Frame buffers per camera, enough for the encoder to hold one
+/// while another waits in the slot and the next is rendered.
+static const unsigned kGstFramePoolSize = 4;
+
+static const std::string kGstDefaultOutput = "udp";
+static const int kGstDefaultShmSlots = 3;
+static const std::string kGstDefaultUdpHost = "127.0.0.1";
+static const std::string kGstDefaultCodec = "h264";
+static const std::string kGstDefaultEncoder = "auto";
+static const int kGstDefaultBitrate = 800;  // [kbit/s]
+static const int kGstDefaultGop = 0;  // [frames], 0 leaves the encoder default
+static const std::string kGstDefaultSpeedPreset = "superfast";
+static const int kGstDefaultJpegQuality = 85;
+
 /**
  * @class GstCameraPlugin
  * A Gazebo plugin that can be attached to a camera and then streams the video data using gstreamer.
  * It streams to a configurable UDP port, default is 5600.
  *
+ * Rendered frames are copied into buffers of a preallocated pool and handed
+ * to the encoder through a single slot, a frame the encoder hasn't taken by
+ * the time the next one is rendered is replaced. Buffers are stamped with
+ * the sim time they were rendered at.
+ *
+ * The stream is configured in the SDF, all elements are optional:
+ *
+ *   <output>udp</output>         udp streams RTP, shm writes raw frames to a
+ *                                shared memory ring (see video_shm.h)
+ *   <shmName>/sitl_camera_...</shmName>  default from the sensor's scoped name
+ *   <shmSlots>3</shmSlots>
+ *   <udpHost>127.0.0.1</udpHost>
+ *   <udpPort>5600</udpPort>
+ *   <codec>h264</codec>          h264, h265, mjpeg or raw (RTP payloaded frames)
+ *   <encoder>auto</encoder>      encoder element, auto prefers hardware ones
+ *   <bitrate>800</bitrate>       [kbit/s]
+ *   <gop>0</gop>                 frames between key frames, 0 for the default
+ *   <zerolatency>true</zerolatency>  no frame reordering or lookahead, no sink sync
+ *   <threads>0</threads>         encoder threads, 0 for the default
+ *   <speedPreset>superfast</speedPreset>  x264enc / x265enc speed-preset
+ *   <jpegQuality>85</jpegQuality>
+ *
  * Connect to the stream via command line with:
  * gst-launch-1.0  -v udpsrc port=5600 caps='application/x-rtp, media=(string)video, clock-rate=(int)90000, encoding-name=(string)H264' \
  *  ! rtph264depay ! avdec_h264 ! videoconvert ! autovideosink fps-update-interval=1000 sync=false
@@ -56,11 +103,40 @@ class GAZEBO_VISIBLE GstCameraPlugin : public SensorPlugin
   public: void startGstThread();
   public: void gstCallback(GstElement *appsrc);
 
+  /// \brief Frames rendered by the camera.
+  public: uint64_t FramesRendered() const { return framesRendered; }
+  /// \brief Frames not streamed because all pool buffers were in the pipeline.
+  public: uint64_t FramesDropped() const { return framesDropped; }
+  /// \brief Frames replaced by a newer one before the encoder took them.
+  public: uint64_t FramesOverwritten() const { return framesOverwritten; }
+
+  /// \brief Caps of the raw frames, the caller owns the reference.
+  private: GstCaps *frameCaps() const;
+
+  /// \brief Appends encoder, parser and payloader of the codec.
+  private: bool addEncoder(std::vector<GstElement*> *elements) const;
+
+  /// \brief The configured encoder or the first usable one for the codec,
+  /// *info is nullptr for an encoder there are no tuning properties for.
+  private: GstElement *createEncoder(const std::string &codec, const GstEncoderInfo **info) const;
+
   protected: unsigned int width, height, depth;
   float rate;
   protected: std::string format;
 
+  protected: std::string output;
   protected: int udpPort;
+  protected: std::string udpHost;
+
+  // encoder settings, see the class description
+  protected: std::string codec;
+  protected: std::string encoderName;
+  protected: int bitrate;
+  protected: int gop;
+  protected: bool zeroLatency;
+  protected: int threads;
+  protected: std::string speedPreset;
+  protected: int jpegQuality;
 
   protected: sensors::CameraSensorPtr parentSensor;
   protected: rendering::CameraPtr camera;
@@ -71,11 +147,32 @@ class GAZEBO_VISIBLE GstCameraPlugin : public SensorPlugin
   private: std::string namespace_;
   private: const std::string topicName = "gst_video";
 
-  GstBuffer *frameBuffer;
-  std::mutex frameBufferMutex;
+  /// \brief Output of the shm mode, nullptr when streaming.
+  std::unique_ptr<VideoShmWriter> shmRing;
+
+  /// \brief Buffers frames are rendered into, returned to it by the pipeline.
+  GstBufferPool *framePool;
+  /// \brief Newest frame not taken by the encoder yet.
+  std::atomic<GstBuffer *> pendingFrame;
+  /// \brief Only to sleep on while the slot is empty.
+  std::mutex frameMutex;
+  std::condition_variable frameReady;
+  std::atomic<bool> stopping;
   GMainLoop *mainLoop;
+  /// \brief Runs mainLoop, joined before the members it uses go away.
+  pthread_t gstThread;
+  bool gstThreadStarted;
+
+  /// \brief Sim time of the first frame, the stream starts at 0.
+  common::Time firstFrameTime;
+  bool haveFirstFrame;
+  /// \brief Timestamp of the last frame.
   GstClockTime gstTimestamp;
 
+  std::atomic<uint64_t> framesRendered;
+  std::atomic<uint64_t> framesDropped;
+  std::atomic<uint64_t> framesOverwritten;
+
 };
 
 } /* namespace gazebo */
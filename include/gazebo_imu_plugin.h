@@ -18,8 +18,6 @@
  * limitations under the License.
  */
 
-#include <random>
-
 #include <Eigen/Core>
 #include "SensorImu.pb.h"
 #include <gazebo/common/common.hh>
@@ -30,6 +28,11 @@
 #include "gazebo/msgs/msgs.hh"
 
 #include "common.h"
+#include "flight_record.h"
+#include "imu_message.h"
+#include "noise_stream.h"
+#include "sensor_bus.h"
+#include "step_profiler.h"
 
 namespace gazebo {
 //typedef const boost::shared_ptr<const sensor_msgs::msgs::Imu> ImuPtr;
@@ -118,11 +121,12 @@ class GazeboImuPlugin : public ModelPlugin {
   std::string imu_topic_;
   transport::NodePtr node_handle_;
   transport::PublisherPtr imu_pub_;
+  std::shared_ptr<SensorTopic<ImuSample> > imu_bus_topic_;
+  std::shared_ptr<FlightRecordStream> imu_record_;
   std::string frame_id_;
   std::string link_name_;
 
-  std::default_random_engine random_generator_;
-  std::normal_distribution<double> standard_normal_distribution_;
+  NoiseStream noise_;
 
   // Pointer to the world
   physics::WorldPtr world_;
@@ -132,6 +136,7 @@ class GazeboImuPlugin : public ModelPlugin {
   physics::LinkPtr link_;
   // Pointer to the update event connection
   event::ConnectionPtr updateConnection_;
+  ProfileProbePtr update_probe_;
 
   common::Time last_time_;
 
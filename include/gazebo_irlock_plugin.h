@@ -14,6 +14,7 @@
 #include "gazebo/math/gzmath.hh"
 
 #include "irlock.pb.h"
+#include "sensor_bus.h"
 
 #include <iostream>
 
@@ -35,6 +36,7 @@ namespace gazebo
     private:
       event::ConnectionPtr updateConnection;
       transport::PublisherPtr irlock_pub_;
+      std::shared_ptr<SensorTopic<IRLockSample> > irlock_bus_topic_;
       transport::NodePtr node_handle_;
       irlock_msgs::msgs::irlock irlock_message;
       std::string namespace_;
@@ -28,6 +28,7 @@
 #include "gazebo/util/system.hh"
 
 #include "lidar.pb.h"
+#include "sensor_bus.h"
 
 namespace gazebo
 {
@@ -55,6 +56,7 @@ namespace gazebo
       sensors::RaySensorPtr parentSensor;
       transport::NodePtr node_handle_;
       transport::PublisherPtr lidar_pub_;
+      std::shared_ptr<SensorTopic<RangeSample> > lidar_bus_topic_;
       std::string namespace_;
 
 
@@ -39,28 +39,45 @@
 #include <irlock.pb.h>
 #include <boost/bind.hpp>
 
+#include <atomic>
 #include <iostream>
 #include <math.h>
 #include <deque>
-#include <random>
+#include <memory>
+#include <mutex>
 #include <sdf/sdf.hh>
+#include <thread>
 
 #include "mavlink/v2.0/common/mavlink.h"
+#include "actuator_commands.h"
+#include "flight_record.h"
+#include "geo_mag_field.h"
+#include "geo_projection.h"
+#include "mavlink_io_worker.h"
+#include "mavlink_multiplexer.h"
+#include "noise_stream.h"
+#include "sensor_bus.h"
+#include "sim_scheduler.h"
+#include "step_profiler.h"
+#include "throttled_publisher.h"
 
 #include "gazebo/math/Vector3.hh"
 #include <sys/socket.h>
 #include <netinet/in.h>
 
 static const uint32_t kDefaultMavlinkUdpPort = 14560;
+static const uint32_t kDefaultLockstepTimeoutMs = 1000;
+static constexpr double kDefaultMavlinkRecordDuration = 300.0;  // [s] of sim time kept
+static constexpr double kDefaultMavlinkReplaySpeed = 1.0;  // real time factor without lockstep
+static constexpr double kMavlinkReplayProbeInterval = 1.0;  // [s] wall time between heartbeats to PX4
+// Vision noise used to share a distribution that the IMU callback had
+// rescaled to this standard deviation, keep the tuned magnitudes.
+static constexpr double kEvNoiseStdDev = 0.01;
+static constexpr double kActuatorTimeout = 0.2;  // [s] without controls until the motors stop
 
 namespace gazebo {
 
 typedef const boost::shared_ptr<const mav_msgs::msgs::CommandMotorSpeed> CommandMotorSpeedPtr;
-typedef const boost::shared_ptr<const sensor_msgs::msgs::Imu> ImuPtr;
-typedef const boost::shared_ptr<const lidar_msgs::msgs::lidar> LidarPtr;
-typedef const boost::shared_ptr<const opticalFlow_msgs::msgs::opticalFlow> OpticalFlowPtr;
-typedef const boost::shared_ptr<const sonarSens_msgs::msgs::sonarSens> SonarSensPtr;
-typedef const boost::shared_ptr<const irlock_msgs::msgs::irlock> IRLockPtr;
 
 // Default values
 static const std::string kDefaultNamespace = "";
@@ -68,22 +85,33 @@ static const std::string kDefaultNamespace = "";
 // This just proxies the motor commands from command/motor_speed to the single motors via internal
 // ConsPtr passing, such that the original commands don't have to go n_motors-times over the wire.
 static const std::string kDefaultMotorVelocityReferencePubTopic = "/gazebo/command/motor_speed";
+// The rotor plugins read the commands in-process, the topic is for external listeners.
+static constexpr double kDefaultMotorSpeedCommandPubRate = 50.0;  // [Hz], 0 disables
 
 static const std::string kDefaultImuTopic = "/imu";
+static const std::string kDefaultGpsTopic = "/gps";
 static const std::string kDefaultLidarTopic = "/lidar/link/lidar";
 static const std::string kDefaultOpticalFlowTopic = "/camera/link/opticalFlow";
 static const std::string kDefaultSonarTopic = "/sonar_model/link/sonar";
 static const std::string kDefaultIRLockTopic = "/camera/link/irlock";
 
+// The GPS model is a plugin of its own, warn if a model lacks it.
+static constexpr double kGpsWarnTimeout = 5.0;  // [s] sim time without a GPS sample
+
 class GazeboMavlinkInterface : public ModelPlugin {
  public:
   GazeboMavlinkInterface()
       : ModelPlugin(),
 
         received_first_referenc_(false),
+        received_first_message_(false),
+        gps_received_(false),
+        gps_warned_(false),
+        actuator_timed_out_(true),
         namespace_(kDefaultNamespace),
         motor_velocity_reference_pub_topic_(kDefaultMotorVelocityReferencePubTopic),
         imu_sub_topic_(kDefaultImuTopic),
+        gps_sub_topic_(kDefaultGpsTopic),
         opticalFlow_sub_topic_(kDefaultOpticalFlowTopic),
         lidar_sub_topic_(kDefaultLidarTopic),
         sonar_sub_topic_(kDefaultSonarTopic),
@@ -104,19 +132,40 @@ class GazeboMavlinkInterface : public ModelPlugin {
         input_index_{},
         lat_rad(0.0),
         lon_rad(0.0),
-        mavlink_udp_port_(kDefaultMavlinkUdpPort)
+        alt_home_(0.0),
+        geo_time_(-1.0),
+        mavlink_udp_port_(kDefaultMavlinkUdpPort),
+        enable_lockstep_(false),
+        lockstep_timeout_ms_(kDefaultLockstepTimeoutMs),
+        lockstep_timeouts_(0),
+        hil_sensor_pending_(false),
+        tx_queue_len_(0),
+        actuator_controls_pending_(false),
+        last_actuator_controls_usec_(0),
+        dropped_actuator_controls_(0),
+        stale_actuator_controls_(0),
+        mavlink_link_(nullptr),
+        replay_speed_(kDefaultMavlinkReplaySpeed),
+        replay_stop_(false)
         {}
   ~GazeboMavlinkInterface();
 
   void Publish();
 
+  /// \brief Actuator controls superseded by a newer one within the same step.
+  unsigned DroppedActuatorControls() const { return dropped_actuator_controls_; }
+  /// \brief Actuator controls older than the ones already applied.
+  unsigned StaleActuatorControls() const { return stale_actuator_controls_; }
+
  protected:
   void Load(physics::ModelPtr _model, sdf::ElementPtr _sdf);
   void OnUpdate(const common::UpdateInfo& /*_info*/);
+  void OnUpdateEnd();
 
  private:
 
   bool received_first_referenc_;
+  bool received_first_message_;  ///< anything from PX4 yet
   Eigen::VectorXd input_reference_;
 
   std::string namespace_;
@@ -125,7 +174,8 @@ class GazeboMavlinkInterface : public ModelPlugin {
   std::string link_name_;
 
   transport::NodePtr node_handle_;
-  transport::PublisherPtr motor_velocity_reference_pub_;
+  ThrottledPublisher<mav_msgs::msgs::CommandMotorSpeed> motor_velocity_reference_pub_;
+  std::shared_ptr<ActuatorCommands> actuator_commands_;
   transport::SubscriberPtr mav_control_sub_;
 
   physics::ModelPtr model_;
@@ -151,27 +201,38 @@ class GazeboMavlinkInterface : public ModelPlugin {
 
   /// \brief Pointer to the update event connection.
   event::ConnectionPtr updateConnection_;
+  event::ConnectionPtr updateEndConnection_;
+  ProfileProbePtr update_probe_;
+  ProfileProbePtr update_end_probe_;
+  ProfileProbePtr imu_probe_;
 
   boost::thread callback_queue_thread_;
   void QueueThread();
-  void ImuCallback(ImuPtr& imu_msg);
-  void LidarCallback(LidarPtr& lidar_msg);
-  void SonarCallback(SonarSensPtr& sonar_msg);
-  void OpticalFlowCallback(OpticalFlowPtr& opticalFlow_msg);
-  void IRLockCallback(IRLockPtr& irlock_msg);
+  void ImuCallback(const ImuSample& imu_msg);
+  void GpsCallback(const GpsSample& gps_msg);
+  void LidarCallback(const RangeSample& lidar_msg);
+  void SonarCallback(const RangeSample& sonar_msg);
+  void OpticalFlowCallback(const OpticalFlowSample& opticalFlow_msg);
+  void IRLockCallback(const IRLockSample& irlock_msg);
   void send_mavlink_message(const mavlink_message_t *message, const int destination_port=0);
+  void flushMAVLinkMessages();
+  void sendQueuedMessages();
   void handle_message(mavlink_message_t *msg);
+  void handle_actuator_controls(const mavlink_hil_actuator_controls_t &controls);
   void pollForMAVLinkMessages(double _dt, uint32_t _timeoutMs);
+  void waitForActuatorControls(uint32_t _timeoutMs);
+  void ReplayThread();
+  void VisionCallback(double _due);
+
+  static_assert(MavlinkRecord::kMaxPacketLen == MAVLINK_MAX_PACKET_LEN, "MavlinkRecord can't hold a packet");
 
   static const unsigned n_out_max = 16;
+  static const unsigned n_tx_queue_max = 64;
 
   // vision position estimate noise parameters
   static constexpr double ev_corellation_time = 60.0; // s
   static constexpr double ev_random_walk = 2.0; // (m/s) / sqrt(hz)
   static constexpr double ev_noise_density = 2e-4; // (m) / sqrt(hz)
-  static constexpr double gps_corellation_time = 30.0; // s
-  static constexpr double gps_random_walk = 1.0; // (m/s) / sqrt(hz)
-  static constexpr double gps_noise_density = 2e-4; // (m) / sqrt(hz)
 
   unsigned _rotor_count;
 
@@ -184,43 +245,49 @@ class GazeboMavlinkInterface : public ModelPlugin {
   int input_index_[n_out_max];
   transport::PublisherPtr joint_control_pub_[n_out_max];
 
-  transport::SubscriberPtr imu_sub_;
-  transport::SubscriberPtr lidar_sub_;
-  transport::SubscriberPtr sonar_sub_;
-  transport::SubscriberPtr opticalFlow_sub_;
-  transport::SubscriberPtr irlock_sub_;
-  transport::PublisherPtr gps_pub_;
+  // sensor data arrives through the in-process SensorBus
+  SensorTopic<ImuSample>::SubscriptionPtr imu_sub_;
+  SensorTopic<RangeSample>::SubscriptionPtr lidar_sub_;
+  SensorTopic<RangeSample>::SubscriptionPtr sonar_sub_;
+  SensorTopic<OpticalFlowSample>::SubscriptionPtr opticalFlow_sub_;
+  SensorTopic<IRLockSample>::SubscriptionPtr irlock_sub_;
+  SensorTopic<GpsSample>::SubscriptionPtr gps_sub_;
   std::string imu_sub_topic_;
+  std::string gps_sub_topic_;
+  std::atomic<bool> gps_received_;
+  bool gps_warned_;
   std::string lidar_sub_topic_;
   std::string opticalFlow_sub_topic_;
   std::string sonar_sub_topic_;
   std::string irlock_sub_topic_;
 
   common::Time last_time_;
-  common::Time last_gps_time_;
-  common::Time last_ev_time_;
-  common::Time last_actuator_time_;
 
-  double gps_update_interval_;
-  double gps_delay_;
+  // sim time timers, vision runs at its rate and the motors stop if PX4
+  // sends no controls for kActuatorTimeout
+  SimTimerPtr ev_timer_;
+  SimTimerPtr actuator_timeout_;
+  bool actuator_timed_out_;
+
   double lat_rad;
   double lon_rad;
+  GeoProjection geo_projection_;
+  double alt_home_;
+  double geo_time_;  ///< sim time lat_rad, lon_rad were reprojected at
   double ev_update_interval_;
   double ev_bias_x_;
   double ev_bias_y_;
   double ev_bias_z_;
-  double gps_bias_x_;
-  double gps_bias_y_;
-  double gps_bias_z_;
 
   void handle_control(double _dt);
+  void UpdateGeoPosition();
 
   math::Vector3 gravity_W_;
   math::Vector3 velocity_prev_W_;
   math::Vector3 mag_d_;
+  std::unique_ptr<GeoMagField> mag_field_;
 
-  std::default_random_engine random_generator_;
-  std::normal_distribution<float> standard_normal_distribution_;
+  NoiseStream noise_;
 
   int _fd;
   struct sockaddr_in _myaddr;  ///< The locally bound address
@@ -236,10 +303,42 @@ class GazeboMavlinkInterface : public ModelPlugin {
   double optflow_distance;
   double sonar_distance;
 
-  mavlink_hil_gps_t hil_gps_msg_;
 
   in_addr_t mavlink_addr_;
   int mavlink_udp_port_;
 
+  // lockstep: block each step until PX4 answered the previous HIL_SENSOR
+  bool enable_lockstep_;
+  uint32_t lockstep_timeout_ms_;
+  unsigned lockstep_timeouts_;
+  std::atomic<bool> hil_sensor_pending_;
+
+  // messages produced during one world step, sent in a single syscall
+  MavlinkTxPacket tx_queue_[n_tx_queue_max];
+  unsigned tx_queue_len_;
+  std::mutex tx_mutex_;
+
+  // newest actuator controls received while draining the socket
+  mavlink_hil_actuator_controls_t actuator_controls_;
+  bool actuator_controls_pending_;
+  uint64_t last_actuator_controls_usec_;
+  unsigned dropped_actuator_controls_;
+  unsigned stale_actuator_controls_;
+
+  // optional I/O thread owning the socket, physics only touches its rings
+  std::unique_ptr<MavlinkIoWorker> io_worker_;
+  // or a channel of the world wide shared transport
+  MavlinkMultiplexer::ChannelPtr mux_channel_;
+  // whichever of the two is in use, nullptr for direct socket I/O
+  MavlinkLink *mavlink_link_;
+
+  // every packet sent to PX4, for replay
+  std::unique_ptr<FlightRecordFile> mavlink_record_;
+  // replay of such a recording instead of the sensor plugins
+  std::unique_ptr<FlightRecordReader> replay_reader_;
+  double replay_speed_;
+  std::atomic<bool> replay_stop_;
+  std::thread replay_thread_;
+
   };
 }
@@ -36,7 +36,11 @@
 #include "MotorSpeed.pb.h"
 #include "Float.pb.h"
 
+#include "actuator_commands.h"
 #include "common.h"
+#include "sensor_bus.h"
+#include "step_profiler.h"
+#include "throttled_publisher.h"
 
 
 namespace turning_direction {
@@ -68,6 +72,7 @@ static constexpr double kDefaulMaxRotVelocity = 838.0;
 static constexpr double kDefaultRotorDragCoefficient = 1.0e-4;
 static constexpr double kDefaultRollingMomentCoefficient = 1.0e-6;
 static constexpr double kDefaultRotorVelocitySlowdownSim = 10.0;
+static constexpr double kDefaultMotorSpeedPubRate = kUnlimitedPubRate;  // [Hz]
 
 class GazeboMotorModel : public MotorModel, public ModelPlugin {
  public:
@@ -76,6 +81,7 @@ class GazeboMotorModel : public MotorModel, public ModelPlugin {
         MotorModel(),
         command_sub_topic_(kDefaultCommandSubTopic),
         motor_speed_pub_topic_(kDefaultMotorVelocityPubTopic),
+        motor_speed_pub_rate_(kDefaultMotorSpeedPubRate),
         motor_number_(0),
         turning_direction_(turning_direction::CW),
         max_force_(kDefaultMaxForce),
@@ -100,6 +106,7 @@ class GazeboMotorModel : public MotorModel, public ModelPlugin {
   virtual void UpdateForcesAndMoments();
   virtual void Load(physics::ModelPtr _model, sdf::ElementPtr _sdf);
   virtual void OnUpdate(const common::UpdateInfo & /*_info*/);
+  virtual void Reset();
 
  private:
   std::string command_sub_topic_;
@@ -107,6 +114,7 @@ class GazeboMotorModel : public MotorModel, public ModelPlugin {
   std::string link_name_;
   std::string motor_speed_pub_topic_;
   std::string namespace_;
+  double motor_speed_pub_rate_;
 
   int motor_number_;
   int turning_direction_;
@@ -123,16 +131,24 @@ class GazeboMotorModel : public MotorModel, public ModelPlugin {
   double time_constant_up_;
 
   transport::NodePtr node_handle_;
-  transport::PublisherPtr motor_velocity_pub_;
+  ThrottledPublisher<std_msgs::msgs::Float> motor_velocity_pub_;
   transport::SubscriberPtr command_sub_;
+  std::shared_ptr<ActuatorCommands> actuator_commands_;
 
   physics::ModelPtr model_;
   physics::JointPtr joint_;
   common::PID pid_;
   bool use_pid_;
   physics::LinkPtr link_;
+  /// \brief Link the rotor is attached to, the drag torques act on it.
+  physics::LinkPtr parent_link_;
+  /// \brief Rotor z axis in the parent CoG frame. Spinning the rotor does
+  /// not change it, so it is only resolved at Load and Reset.
+  math::Vector3 rotor_axis_parent_;
+  void UpdateRotorAxis();
   /// \brief Pointer to the update event connection.
   event::ConnectionPtr updateConnection_;
+  ProfileProbePtr update_probe_;
 
   boost::thread callback_queue_thread_;
   void QueueThread();
@@ -32,6 +32,7 @@
 #include "gazebo/transport/transport.hh"
 #include "gazebo/msgs/msgs.hh"
 #include "MotorSpeed.pb.h"
+#include "throttled_publisher.h"
 
 namespace gazebo {
 typedef const boost::shared_ptr<const mav_msgs::msgs::MotorSpeed> MotorSpeedPtr;
@@ -45,6 +46,7 @@ static const std::string kDefaultLinkName = "base_link";
 static const std::string kDefaultFrameId = "base_link";
 
 static constexpr double kDefaultRotorVelocitySlowdownSim = 10.0;
+static constexpr double kDefaultMotorPubRate = kUnlimitedPubRate;  // [Hz]
 
 
 /// \brief This plugin publishes the motor speeds of your multirotor model.
@@ -58,7 +60,8 @@ class GazeboMultirotorBasePlugin : public ModelPlugin {
         motor_pub_topic_(kDefaultMotorPubTopic),
         link_name_(kDefaultLinkName),
         frame_id_(kDefaultFrameId),
-        rotor_velocity_slowdown_sim_(kDefaultRotorVelocitySlowdownSim) {}
+        rotor_velocity_slowdown_sim_(kDefaultRotorVelocitySlowdownSim),
+        motor_pub_rate_(kDefaultMotorPubRate) {}
 
   virtual ~GazeboMultirotorBasePlugin();
 
@@ -88,8 +91,9 @@ class GazeboMultirotorBasePlugin : public ModelPlugin {
   std::string link_name_;
   std::string frame_id_;
   double rotor_velocity_slowdown_sim_;
+  double motor_pub_rate_;
 
   transport::NodePtr node_handle_;
-  transport::PublisherPtr motor_pub_;
+  ThrottledPublisher<mav_msgs::msgs::MotorSpeed> motor_pub_;
 };
 }
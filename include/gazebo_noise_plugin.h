@@ -0,0 +1,51 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_NOISE_PLUGIN_H_
+#define SITL_GAZEBO_NOISE_PLUGIN_H_
+
+#include <gazebo/common/common.hh>
+#include <gazebo/common/Plugin.hh>
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+
+#include "noise_stream.h"
+
+namespace gazebo {
+
+/**
+ * \brief Sets the noise seed of a world.
+ *
+ * All noise streams of the world's sensors are keyed by this seed instead
+ * of PX4_SIM_SEED, so a world file pins its own noise. Without <seed> the
+ * environment variable stays in effect.
+ *
+ *   <plugin name="noise" filename="libgazebo_noise_plugin.so">
+ *     <seed>42</seed>
+ *   </plugin>
+ */
+class GazeboNoisePlugin : public WorldPlugin {
+ public:
+  GazeboNoisePlugin();
+  ~GazeboNoisePlugin();
+
+ protected:
+  void Load(physics::WorldPtr _world, sdf::ElementPtr _sdf);
+};
+
+}
+
+#endif  // SITL_GAZEBO_NOISE_PLUGIN_H_
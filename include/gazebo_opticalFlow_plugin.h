@@ -29,6 +29,7 @@
 #include "gazebo/msgs/msgs.hh"
 
 #include "opticalFlow.pb.h"
+#include "sensor_bus.h"
 
 #include <opencv2/opencv.hpp>
 #include <iostream>
@@ -63,6 +64,7 @@ namespace gazebo
     private:
       event::ConnectionPtr newFrameConnection;
       transport::PublisherPtr opticalFlow_pub_;
+      std::shared_ptr<SensorTopic<OpticalFlowSample> > opticalFlow_bus_topic_;
       transport::NodePtr node_handle_;
       opticalFlow_msgs::msgs::opticalFlow opticalFlow_message;
       std::string namespace_;
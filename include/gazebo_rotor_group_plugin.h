@@ -0,0 +1,110 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_ROTOR_GROUP_PLUGIN_H_
+#define SITL_GAZEBO_ROTOR_GROUP_PLUGIN_H_
+
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <gazebo/common/common.hh>
+#include <gazebo/common/Plugin.hh>
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+#include "gazebo/transport/transport.hh"
+#include "gazebo/msgs/msgs.hh"
+#include "CommandMotorSpeed.pb.h"
+#include "Float.pb.h"
+
+#include "actuator_commands.h"
+#include "common.h"
+#include "gazebo_motor_model.h"
+#include "rotor_group_kernel.h"
+#include "sensor_bus.h"
+#include "step_profiler.h"
+#include "throttled_publisher.h"
+
+namespace gazebo {
+
+/**
+ * \brief All rotors of a vehicle in one plugin.
+ *
+ * Replaces one GazeboMotorModel per rotor. The state of the common parent
+ * link is read once per step, RotorGroupKernel computes all rotors in one
+ * loop and the summed force and torque are applied to the parent in two
+ * calls.
+ *
+ * Commands are read from the ActuatorCommands of the command topic when
+ * the mavlink interface runs in the same process, otherwise from the topic.
+ *
+ * All rotors must be attached to the same rigid parent link. Each <rotor>
+ * takes the parameters of the motor model plugin:
+ *
+ *   <plugin name='rotor_group' filename='librotors_gazebo_rotor_group_plugin.so'>
+ *     <robotNamespace></robotNamespace>
+ *     <commandSubTopic>/gazebo/command/motor_speed</commandSubTopic>
+ *     <rotor>
+ *       <jointName>rotor_0_joint</jointName>
+ *       <linkName>rotor_0</linkName>
+ *       <turningDirection>ccw</turningDirection>
+ *       <motorNumber>0</motorNumber>
+ *       <motorSpeedPubTopic>/motor_speed/0</motorSpeedPubTopic>
+ *       ...
+ *     </rotor>
+ *     ...
+ *   </plugin>
+ */
+class GazeboRotorGroupPlugin : public ModelPlugin {
+ public:
+  GazeboRotorGroupPlugin();
+  ~GazeboRotorGroupPlugin();
+
+ protected:
+  void Load(physics::ModelPtr _model, sdf::ElementPtr _sdf);
+  void Reset();
+
+ private:
+  void LoadRotor(sdf::ElementPtr _sdf);
+  void OnUpdate(const common::UpdateInfo &_info);
+  void VelocityCallback(CommandMotorSpeedPtr &_rot_velocities);
+
+  std::string namespace_;
+  std::string command_sub_topic_;
+
+  transport::NodePtr node_handle_;
+  transport::SubscriberPtr command_sub_;
+  std::shared_ptr<ActuatorCommands> actuator_commands_;
+  std_msgs::msgs::Float turning_velocity_msg_;
+
+  physics::ModelPtr model_;
+  physics::LinkPtr parent_;
+  event::ConnectionPtr update_connection_;
+  ProfileProbePtr update_probe_;
+
+  double prev_sim_time_;
+  bool aliasing_reported_;
+
+  // One entry per rotor, the rest is in kernel_.
+  std::vector<physics::JointPtr> joints_;
+  std::vector<ThrottledPublisher<std_msgs::msgs::Float> > motor_velocity_pubs_;
+  std::vector<int> motor_number_;
+  RotorGroupKernel kernel_;
+};
+
+}
+
+#endif  // SITL_GAZEBO_ROTOR_GROUP_PLUGIN_H_
@@ -28,6 +28,7 @@
 #include "gazebo/util/system.hh"
 
 #include "sonarSens.pb.h"
+#include "sensor_bus.h"
 
 namespace gazebo
 {
@@ -55,6 +56,7 @@ namespace gazebo
       sensors::SonarSensorPtr parentSensor;
       transport::NodePtr node_handle_;
       transport::PublisherPtr sonar_pub_;
+      std::shared_ptr<SensorTopic<RangeSample> > sonar_bus_topic_;
       std::string namespace_;
 
 
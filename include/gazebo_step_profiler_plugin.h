@@ -0,0 +1,79 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_STEP_PROFILER_PLUGIN_H_
+#define SITL_GAZEBO_STEP_PROFILER_PLUGIN_H_
+
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <string>
+
+#include <gazebo/common/common.hh>
+#include <gazebo/common/Plugin.hh>
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+
+#include "step_profiler.h"
+
+namespace gazebo {
+
+static constexpr double kDefaultProfilerReportInterval = 10.0;  // [s] sim time
+
+/**
+ * \brief Reports the step profiler probes of all plugins.
+ *
+ * Every report_interval seconds of sim time the calls, p50, p99 and max
+ * latency of each probe over the interval are written to the console and,
+ * if output_file is set, appended to that file as CSV. The plugin also
+ * times the whole world update (plugins and physics) as world/update.
+ *
+ *   <plugin name="step_profiler" filename="libgazebo_step_profiler_plugin.so">
+ *     <report_interval>10</report_interval>
+ *     <output_file>/tmp/step_profile.csv</output_file>
+ *   </plugin>
+ */
+class GazeboStepProfilerPlugin : public WorldPlugin {
+ public:
+  GazeboStepProfilerPlugin();
+  ~GazeboStepProfilerPlugin();
+
+ protected:
+  void Load(physics::WorldPtr _world, sdf::ElementPtr _sdf);
+
+ private:
+  void OnUpdateBegin(const common::UpdateInfo &_info);
+  void OnUpdateEnd();
+  void Report(const common::Time &_sim_time);
+
+  physics::WorldPtr world_;
+  event::ConnectionPtr update_begin_connection_;
+  event::ConnectionPtr update_end_connection_;
+
+  double report_interval_;
+  std::ofstream output_;
+
+  ProfileProbePtr update_probe_;
+  std::chrono::steady_clock::time_point update_start_;
+
+  common::Time last_report_sim_time_;
+  std::chrono::steady_clock::time_point last_report_wall_time_;
+  std::map<std::string, LatencyStats> last_stats_;
+};
+
+}
+
+#endif  // SITL_GAZEBO_STEP_PROFILER_PLUGIN_H_
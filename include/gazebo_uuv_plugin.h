@@ -26,6 +26,9 @@
 #include "gazebo/msgs/msgs.hh"
 #include "CommandMotorSpeed.pb.h"
 
+#include "actuator_commands.h"
+#include "sensor_bus.h"
+
 namespace gazebo {
 
 // Default values
@@ -60,6 +63,7 @@ class GazeboUUVPlugin : public ModelPlugin {
     
     transport::NodePtr node_handle_;
     transport::SubscriberPtr command_sub_;
+    std::shared_ptr<ActuatorCommands> actuator_commands_;
     
     physics::LinkPtr link_;
     physics::Link_V rotor_links_;
@@ -30,6 +30,9 @@
 #include <gazebo/gazebo.hh>
 #include <gazebo/physics/physics.hh>
 
+#include "throttled_publisher.h"
+#include "Wind.pb.h"
+
 namespace gazebo {
 // Default values
 static const std::string kDefaultNamespace = "";
@@ -44,6 +47,8 @@ static constexpr double kDefaultWindGustForceVariance = 0.0;
 static constexpr double kDefaultWindGustStart = 10.0;
 static constexpr double kDefaultWindGustDuration = 0.0;
 
+static constexpr double kDefaultWindPubRate = kUnlimitedPubRate;  // [Hz]
+
 static const math::Vector3 kDefaultWindDirection = math::Vector3(1, 0, 0);
 static const math::Vector3 kDefaultWindGustDirection = math::Vector3(0, 1, 0);
 
@@ -64,6 +69,7 @@ class GazeboWindPlugin : public ModelPlugin {
         wind_gust_direction_(kDefaultWindGustDirection),
         frame_id_(kDefaultFrameId),
         link_name_(kDefaultLinkName),
+        wind_pub_rate_(kDefaultWindPubRate),
         node_handle_(NULL) {}
 
   virtual ~GazeboWindPlugin();
@@ -91,6 +97,7 @@ class GazeboWindPlugin : public ModelPlugin {
   std::string frame_id_;
   std::string link_name_;
   std::string wind_pub_topic_;
+  double wind_pub_rate_;
 
   double wind_force_mean_;
   double wind_force_variance_;
@@ -105,7 +112,8 @@ class GazeboWindPlugin : public ModelPlugin {
   common::Time wind_gust_start_;
 
   transport::NodePtr node_handle_;
-  transport::PublisherPtr wind_pub_;
+  ThrottledPublisher<wind_msgs::msgs::Wind> wind_pub_;
+  wind_msgs::msgs::Wind wind_msg_;
 };
 }
 
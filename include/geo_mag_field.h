@@ -0,0 +1,83 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_GEO_MAG_FIELD_H_
+#define SITL_GAZEBO_GEO_MAG_FIELD_H_
+
+#include <memory>
+#include <vector>
+
+/// \brief Epoch of the embedded WMM2015 coefficients.
+static const double kWmmEpoch = 2015.0;
+
+/// \brief Default resolution of the precomputed grid.
+static const double kDefaultGeoMagResolutionDeg = 0.5;
+
+/// \brief Earth magnetic field at one location.
+struct GeoMagSample {
+  float declination;  ///< [rad], positive east of true north
+  float inclination;  ///< [rad], positive down
+  float intensity;    ///< total field [Gauss]
+  float horizontal;   ///< horizontal component [Gauss]
+  float vertical;     ///< down component [Gauss]
+};
+
+/**
+ * \brief World Magnetic Model (WMM2015) field lookup.
+ *
+ * The spherical harmonic model is evaluated once on a regular lat/lon grid
+ * when the field is created. Queries interpolate bilinearly between the
+ * four surrounding grid points. The interpolation coefficients of the last
+ * cell are kept, so as long as the vehicle stays inside one cell a query
+ * costs a handful of multiply-adds.
+ *
+ * Grids are shared between all fields of the same epoch and resolution in
+ * the process, so several vehicles pay for the evaluation only once.
+ */
+class GeoMagField {
+ public:
+  /// \param[in] _year Decimal year the secular variation is applied for.
+  /// \param[in] _resolution_deg Grid spacing, must divide 180.
+  explicit GeoMagField(double _year = kWmmEpoch,
+                       double _resolution_deg = kDefaultGeoMagResolutionDeg);
+
+  /// \brief Interpolated field at the given geodetic position.
+  const GeoMagSample &Lookup(double _lat_rad, double _lon_rad);
+
+  /// \brief Evaluates the spherical harmonic model directly.
+  /// \param[in] _alt_km Height above the WGS84 ellipsoid.
+  /// \param[out] _field North, east and down components [nT].
+  static void Evaluate(double _lat_rad, double _lon_rad, double _alt_km,
+                       double _year, double _field[3]);
+
+ private:
+  struct Grid;
+
+  static std::shared_ptr<const Grid> GetGrid(double _year, double _resolution_deg);
+
+  // f(u, v) = c0 + c1 u + c2 v + c3 u v over the cached cell
+  static const int kChannels = 5;
+
+  std::shared_ptr<const Grid> grid_;
+  int cell_lat_;
+  int cell_lon_;
+  double cell_lat0_;
+  double cell_lon0_;
+  float coeffs_[kChannels][4];
+  GeoMagSample sample_;
+};
+
+#endif  // SITL_GAZEBO_GEO_MAG_FIELD_H_
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_GEO_PROJECTION_H_
+#define SITL_GAZEBO_GEO_PROJECTION_H_
+
+#include <cstddef>
+
+/// \brief Radius of the sphere the local frame is reprojected onto [m].
+static const double kGeoEarthRadius = 6353000;
+
+// Other useful homes:
+// Seattle downtown (15 deg declination): 47.592182, -122.316031, 86m
+// Moscow downtown: 55.753395, 37.625427, 155m
+
+/// \brief Geodetic position of the world origin.
+struct GeoHome {
+  double lat_rad;
+  double lon_rad;
+  double alt;  ///< [m] above MSL
+};
+
+/// \brief Zurich Irchel Park, unless the environment variables
+/// PX4_HOME_LAT, PX4_HOME_LON [deg] and PX4_HOME_ALT [m] say otherwise.
+GeoHome GeoHomeFromEnvironment();
+
+/**
+ * \brief Azimuthal equidistant projection around a home position.
+ *
+ * Maps positions in the local east/north frame of the world to latitude and
+ * longitude on a sphere. The trigonometry of the home latitude is computed
+ * once when the home is set, a reprojection then costs one sqrt, sin, cos,
+ * asin and atan2.
+ */
+class GeoProjection {
+ public:
+  explicit GeoProjection(double _lat_home_rad = 0.0, double _lon_home_rad = 0.0);
+
+  void SetHome(double _lat_home_rad, double _lon_home_rad);
+
+  double LatHome() const { return lat_home_; }
+  double LonHome() const { return lon_home_; }
+
+  /// \brief Latitude and longitude [rad] of a local position [m].
+  void Reproject(double _east, double _north, double *_lat_rad, double *_lon_rad) const;
+
+  /// \brief Reprojects _count positions at once, e.g. all vehicles of a world.
+  void Reproject(const double *_east, const double *_north, size_t _count,
+                 double *_lat_rad, double *_lon_rad) const;
+
+ private:
+  double lat_home_;
+  double lon_home_;
+  double sin_lat_home_;
+  double cos_lat_home_;
+};
+
+#endif  // SITL_GAZEBO_GEO_PROJECTION_H_
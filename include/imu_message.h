@@ -0,0 +1,45 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_IMU_MESSAGE_H_
+#define SITL_GAZEBO_IMU_MESSAGE_H_
+
+#include "SensorImu.pb.h"
+#include "sensor_bus.h"
+
+/// \brief Copies _sample into _msg in place. The sub-messages are allocated
+/// on the first call and reused afterwards, so reusing _msg allocates nothing.
+/// checks/imu_message_benchmark.cpp counts the allocations.
+inline void FillImuMessage(const ImuSample &_sample, sensor_msgs::msgs::Imu *_msg)
+{
+  gazebo::msgs::Quaternion *orientation = _msg->mutable_orientation();
+  orientation->set_w(_sample.orientation[0]);
+  orientation->set_x(_sample.orientation[1]);
+  orientation->set_y(_sample.orientation[2]);
+  orientation->set_z(_sample.orientation[3]);
+
+  gazebo::msgs::Vector3d *linear_acceleration = _msg->mutable_linear_acceleration();
+  linear_acceleration->set_x(_sample.linear_acceleration[0]);
+  linear_acceleration->set_y(_sample.linear_acceleration[1]);
+  linear_acceleration->set_z(_sample.linear_acceleration[2]);
+
+  gazebo::msgs::Vector3d *angular_velocity = _msg->mutable_angular_velocity();
+  angular_velocity->set_x(_sample.angular_velocity[0]);
+  angular_velocity->set_y(_sample.angular_velocity[1]);
+  angular_velocity->set_z(_sample.angular_velocity[2]);
+}
+
+#endif  // SITL_GAZEBO_IMU_MESSAGE_H_
@@ -23,6 +23,7 @@
 #include "gazebo/common/Plugin.hh"
 #include "gazebo/physics/physics.hh"
 #include "gazebo/transport/TransportTypes.hh"
+#include "step_profiler.h"
 
 namespace gazebo
 {
@@ -44,6 +45,9 @@ namespace gazebo
     /// \brief Connection to World Update events.
     protected: event::ConnectionPtr updateConnection;
 
+    /// \brief Timing of OnUpdate.
+    protected: ProfileProbePtr updateProbe;
+
     /// \brief Pointer to world.
     protected: physics::WorldPtr world;
 
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_MAVLINK_IO_WORKER_H_
+#define SITL_GAZEBO_MAVLINK_IO_WORKER_H_
+
+#include <atomic>
+#include <thread>
+
+#include "mavlink_link.h"
+#include "spsc_ring.h"
+
+/**
+ * \brief Moves all socket I/O of one MAVLink link off the physics thread.
+ *
+ * The worker thread owns the UDP socket. Encoded outgoing packets and decoded
+ * incoming messages are exchanged with the physics thread through lock-free
+ * single-producer/single-consumer rings, so Send() and Receive() never enter
+ * the kernel.
+ */
+class MavlinkIoWorker : public MavlinkLink {
+ public:
+  MavlinkIoWorker();
+  ~MavlinkIoWorker();
+
+  /// \brief Starts the worker thread on an already bound socket.
+  void Start(int _fd);
+  void Stop();
+
+  bool Send(const MavlinkTxPacket &_packet) override;
+  bool Receive(mavlink_message_t *_msg) override;
+  bool WaitForMessage(uint32_t _timeoutMs) override;
+
+  unsigned DroppedTx() const override { return dropped_tx_; }
+  unsigned DroppedRx() const override { return dropped_rx_; }
+
+ private:
+  void Run();
+  bool SendPending();
+  bool ReceivePending();
+
+  static const unsigned kRingSize = 256;
+  static const unsigned kTxBatchSize = 64;
+
+  SpscRing<MavlinkTxPacket, kRingSize> tx_ring_;
+  SpscRing<mavlink_message_t, kRingSize> rx_ring_;
+  MavlinkRxSignal rx_signal_;
+  MavlinkWakeupPipe tx_wakeup_;
+
+  std::thread thread_;
+  std::atomic<bool> running_;
+  int fd_;
+
+  mavlink_message_t rx_buffer_;
+  mavlink_status_t rx_status_;
+  uint8_t buf_[65535];
+
+  std::atomic<unsigned> dropped_tx_;
+  std::atomic<unsigned> dropped_rx_;
+};
+
+#endif  // SITL_GAZEBO_MAVLINK_IO_WORKER_H_
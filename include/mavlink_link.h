@@ -0,0 +1,189 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_MAVLINK_LINK_H_
+#define SITL_GAZEBO_MAVLINK_LINK_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "mavlink/v2.0/common/mavlink.h"
+
+/// \brief An encoded MAVLink packet together with its destination.
+struct MavlinkTxPacket {
+  uint8_t data[MAVLINK_MAX_PACKET_LEN];
+  uint16_t len;
+  struct sockaddr_in dest_addr;
+};
+
+/// \brief Sends _count packets with as few syscalls as possible.
+/// \return Number of packets handed to the kernel.
+unsigned send_mavlink_packets(int _fd, MavlinkTxPacket *_packets, unsigned _count);
+
+/// \brief Feeds one byte into a MAVLink parser with caller owned state.
+/// Unlike mavlink_parse_char() this does not use the global channel buffers,
+/// so any number of parsers can run in parallel.
+bool parse_mavlink_char(mavlink_message_t *_rx_buffer, mavlink_status_t *_rx_status,
+                        uint8_t _c, mavlink_message_t *_msg);
+
+static const std::chrono::microseconds kMavlinkRxSpinTime(50);
+
+/**
+ * \brief Wakes a thread waiting for messages from the thread that receives them.
+ *
+ * The waiter spins for a few microseconds first, a lockstep answer usually
+ * arrives within that, and only then sleeps on a condition variable. The
+ * receiving thread takes the mutex only while someone sleeps.
+ */
+class MavlinkRxSignal {
+ public:
+  MavlinkRxSignal() : sleeping_(false) {}
+
+  /// \brief Called by the receiving thread after it queued messages.
+  void Notify()
+  {
+    // pairs with the fence in Wait(), either we see the sleeper or it sees the message
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ready_.notify_one();
+    }
+  }
+
+  /// \brief Waits until _available() is true or _timeoutMs elapsed.
+  template <typename Available>
+  bool Wait(uint32_t _timeoutMs, Available _available)
+  {
+    const auto now = std::chrono::steady_clock::now();
+    const auto spin_end = now + kMavlinkRxSpinTime;
+    while (!_available()) {
+      if (std::chrono::steady_clock::now() >= spin_end) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        sleeping_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const bool available = ready_.wait_until(lock, now + std::chrono::milliseconds(_timeoutMs), _available);
+        sleeping_.store(false, std::memory_order_relaxed);
+        return available;
+      }
+    }
+    return true;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::atomic<bool> sleeping_;
+};
+
+/**
+ * \brief Wakes an I/O thread blocked in poll() when there is something to send.
+ *
+ * ReadFd() goes into the poll set. The I/O thread calls BeginWait() before
+ * it blocks and checks its send queues once more, the sending side calls
+ * Notify() after queueing. Only a sleeping I/O thread costs a write().
+ */
+class MavlinkWakeupPipe {
+ public:
+  MavlinkWakeupPipe();
+  ~MavlinkWakeupPipe();
+
+  int ReadFd() const { return fds_[0]; }
+
+  void Notify()
+  {
+    // pairs with the fence in BeginWait()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting_.load(std::memory_order_relaxed) && waiting_.exchange(false)) {
+      Write();
+    }
+  }
+
+  void BeginWait()
+  {
+    waiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+
+  /// \brief After poll() returned, empties the pipe.
+  void EndWait();
+
+ private:
+  MavlinkWakeupPipe(const MavlinkWakeupPipe &) = delete;
+  MavlinkWakeupPipe &operator=(const MavlinkWakeupPipe &) = delete;
+
+  void Write();
+
+  int fds_[2];
+  std::atomic<bool> waiting_;
+};
+
+/**
+ * \brief A MAVLink endpoint whose socket is serviced by another thread.
+ *
+ * Plugins exchange encoded packets and decoded messages with it and never
+ * touch the socket themselves. Send() and Receive() are meant to be called
+ * from a single thread each.
+ */
+class MavlinkLink {
+ public:
+  MavlinkLink() : remote_(0) {}
+  virtual ~MavlinkLink() {}
+
+  /// \brief Queues a packet for sending, returns false if the queue is full.
+  virtual bool Send(const MavlinkTxPacket &_packet) = 0;
+
+  /// \brief Pops the oldest received message, returns false if there is none.
+  virtual bool Receive(mavlink_message_t *_msg) = 0;
+
+  /// \brief Blocks until a message is available or _timeoutMs elapsed.
+  virtual bool WaitForMessage(uint32_t _timeoutMs) = 0;
+
+  virtual unsigned DroppedTx() const = 0;
+  virtual unsigned DroppedRx() const = 0;
+
+  /// \brief Source of the last datagram received, false if none arrived yet.
+  bool RemoteAddress(struct sockaddr_in *_addr) const
+  {
+    const uint64_t remote = remote_.load(std::memory_order_relaxed);
+    if (remote == 0) {
+      return false;
+    }
+    _addr->sin_family = AF_INET;
+    _addr->sin_addr.s_addr = static_cast<uint32_t>(remote >> 16);
+    _addr->sin_port = static_cast<uint16_t>(remote);
+    return true;
+  }
+
+ protected:
+  /// \brief Called by the receiving thread for every datagram.
+  void SetRemoteAddress(const struct sockaddr_in &_addr)
+  {
+    // address and port in network byte order, bit 48 tells it is set
+    remote_.store((uint64_t(1) << 48) | (uint64_t(_addr.sin_addr.s_addr) << 16) | _addr.sin_port,
+                  std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint64_t> remote_;
+};
+
+#endif  // SITL_GAZEBO_MAVLINK_LINK_H_
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_MAVLINK_MULTIPLEXER_H_
+#define SITL_GAZEBO_MAVLINK_MULTIPLEXER_H_
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mavlink_link.h"
+#include "spsc_ring.h"
+
+/**
+ * \brief Process wide MAVLink transport shared by all vehicles of a world.
+ *
+ * Instead of one socket and one poll per plugin, every plugin registers a
+ * channel and a single thread services all sockets with one event loop
+ * (epoll on Linux, poll elsewhere). Vehicles share one ephemeral UDP socket,
+ * incoming datagrams are routed by their source port and, for senders that
+ * are not known by port, by the MAVLink system ID. Endpoints that have to be
+ * reachable on a fixed local port (e.g. the camera) get their own socket in
+ * the same event loop.
+ *
+ * Registering and unregistering a channel only touches a few maps, the
+ * service thread is started with the first and stopped with the last one.
+ */
+class MavlinkMultiplexer {
+ public:
+  class Channel : public MavlinkLink {
+   public:
+    bool Send(const MavlinkTxPacket &_packet) override;
+    bool Receive(mavlink_message_t *_msg) override;
+    bool WaitForMessage(uint32_t _timeoutMs) override;
+
+    unsigned DroppedTx() const override { return dropped_tx_; }
+    unsigned DroppedRx() const override { return dropped_rx_; }
+
+   private:
+    friend class MavlinkMultiplexer;
+    Channel(int _fd, uint16_t _remote_port, uint8_t _system_id, MavlinkWakeupPipe *_tx_wakeup);
+
+    void Deliver(const mavlink_message_t &_msg);
+
+    static const unsigned kRingSize = 256;
+
+    SpscRing<MavlinkTxPacket, kRingSize> tx_ring_;
+    SpscRing<mavlink_message_t, kRingSize> rx_ring_;
+    MavlinkRxSignal rx_signal_;
+
+    const int fd_;                ///< socket used for sending
+    const uint16_t remote_port_;  ///< host byte order, 0 if bound
+    const uint8_t system_id_;     ///< 0 disables routing by system ID
+    MavlinkWakeupPipe *tx_wakeup_;
+
+    mavlink_message_t rx_buffer_;
+    mavlink_status_t rx_status_;
+
+    std::atomic<unsigned> dropped_tx_;
+    std::atomic<unsigned> dropped_rx_;
+  };
+
+  typedef std::shared_ptr<Channel> ChannelPtr;
+
+  static MavlinkMultiplexer &Instance();
+
+  /// \brief Adds a vehicle on the shared socket.
+  /// \param[in] _remote_port Datagrams from this UDP port are routed to it.
+  /// \param[in] _system_id If nonzero, messages with this system ID from
+  ///            unknown ports are routed to it as well.
+  /// \return nullptr if the shared socket could not be opened or the port
+  ///         or system ID is already taken.
+  ChannelPtr Register(uint16_t _remote_port, uint8_t _system_id = 0);
+
+  /// \brief Adds an endpoint with its own socket bound to _local_port.
+  /// Everything received on that socket is routed to the channel.
+  ChannelPtr RegisterBound(uint16_t _local_port);
+
+  void Unregister(const ChannelPtr &_channel);
+
+  /// \brief Messages that matched no channel.
+  unsigned Unrouted() const { return unrouted_; }
+
+ private:
+  MavlinkMultiplexer();
+  ~MavlinkMultiplexer();
+  MavlinkMultiplexer(const MavlinkMultiplexer &) = delete;
+  MavlinkMultiplexer &operator=(const MavlinkMultiplexer &) = delete;
+
+  static int OpenSocket(uint16_t _local_port);
+
+  bool Watch(int _fd);
+  void Unwatch(int _fd);
+  void StartLocked();
+  void Run();
+  bool SendPending();
+  bool ReceivePending(int _fd);
+
+  static const unsigned kTxBatchSize = 64;
+
+  std::mutex lifecycle_mutex_;  ///< serializes starting and stopping the thread
+  std::mutex mutex_;            ///< guards the routing tables
+  std::vector<ChannelPtr> channels_;
+  std::map<uint16_t, Channel *> by_port_;
+  std::map<uint8_t, Channel *> by_system_id_;
+  std::map<int, Channel *> by_fd_;  ///< channels with their own socket
+  std::vector<int> fds_;            ///< all watched sockets
+  MavlinkWakeupPipe tx_wakeup_;     ///< watched as well, not in fds_
+
+  int shared_fd_;
+  int epoll_fd_;
+
+  std::thread thread_;
+  std::atomic<bool> running_;
+
+  // parser for datagrams that have to be routed by system ID
+  mavlink_message_t rx_buffer_;
+  mavlink_status_t rx_status_;
+  uint8_t buf_[65535];
+
+  MavlinkTxPacket tx_batch_[kTxBatchSize];
+
+  std::atomic<unsigned> unrouted_;
+};
+
+#endif  // SITL_GAZEBO_MAVLINK_MULTIPLEXER_H_
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_NOISE_STREAM_H_
+#define SITL_GAZEBO_NOISE_STREAM_H_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include "sensor_bus.h"
+
+/// \brief Default seed if PX4_SIM_SEED is not set.
+static const uint64_t kDefaultNoiseSeed = 0;
+
+/// \brief Seed of one world, set by GazeboNoisePlugin from its <seed>.
+struct WorldNoiseSeed {
+  WorldNoiseSeed() : set(false), seed(kDefaultNoiseSeed) {}
+  bool set;
+  uint64_t seed;
+};
+
+/**
+ * \brief Philox4x32-10 counter based generator (Salmon et al., SC'11).
+ *
+ * Maps a 128 bit counter and a 64 bit key to 128 random bits without any
+ * hidden state, so independent streams are just different counter ranges
+ * and a run is reproduced exactly from its seed.
+ */
+struct Philox4x32 {
+  static void Generate(const uint32_t _counter[4], const uint32_t _key[2], uint32_t _out[4]) {
+    uint32_t c0 = _counter[0], c1 = _counter[1], c2 = _counter[2], c3 = _counter[3];
+    uint32_t k0 = _key[0], k1 = _key[1];
+
+    for (int round = 0; round < 10; ++round) {
+      const uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c0;
+      const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c2;
+      const uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+      const uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+      c1 = static_cast<uint32_t>(p1);
+      c3 = static_cast<uint32_t>(p0);
+      c0 = n0;
+      c2 = n2;
+      k0 += 0x9E3779B9u;
+      k1 += 0xBB67AE85u;
+    }
+
+    _out[0] = c0;
+    _out[1] = c1;
+    _out[2] = c2;
+    _out[3] = c3;
+  }
+};
+
+/**
+ * \brief Reproducible stream of noise samples for one sensor.
+ *
+ * All streams of a world share its seed and are told apart by a name,
+ * usually model/sensor. The seed is the <seed> of the world's noise plugin
+ * or, without one, the environment variable PX4_SIM_SEED. The name, not the
+ * plugin load order, selects the stream, so adding a vehicle or sensor
+ * does not change the noise of the others.
+ */
+class NoiseStream {
+ public:
+  NoiseStream() : NoiseStream(std::string()) {}
+
+  explicit NoiseStream(const std::string &_name)
+      : NoiseStream(Seed(), Hash(_name)) {}
+
+  /// \brief Stream _name of world _world, seeded by WorldSeed(_world).
+  NoiseStream(const std::string &_world, const std::string &_name)
+      : NoiseStream(WorldSeed(_world), Hash(_world + "/" + _name)) {}
+
+  NoiseStream(uint64_t _seed, uint64_t _stream)
+      : index_(0), cached_(0), has_cached_(false) {
+    key_[0] = static_cast<uint32_t>(_seed);
+    key_[1] = static_cast<uint32_t>(_seed >> 32);
+    stream_[0] = static_cast<uint32_t>(_stream);
+    stream_[1] = static_cast<uint32_t>(_stream >> 32);
+  }
+
+  /// \brief The world seed, read once from PX4_SIM_SEED.
+  static uint64_t Seed() {
+    static const uint64_t seed = []() {
+      const char *env_seed = std::getenv("PX4_SIM_SEED");
+      return env_seed ? std::strtoull(env_seed, nullptr, 0) : kDefaultNoiseSeed;
+    }();
+    return seed;
+  }
+
+  /// \brief The seed of world _world: the <seed> of its noise plugin if
+  /// set, Seed() otherwise. World plugins are loaded before the model
+  /// plugins, so the override is in place when the sensors ask for it.
+  static uint64_t WorldSeed(const std::string &_world) {
+    std::shared_ptr<WorldNoiseSeed> world_seed = SharedWorldSeed(_world);
+    return world_seed->set ? world_seed->seed : Seed();
+  }
+
+  /// \brief Overrides the seed of world _world for streams created after.
+  static void SetWorldSeed(const std::string &_world, uint64_t _seed) {
+    std::shared_ptr<WorldNoiseSeed> world_seed = SharedWorldSeed(_world);
+    world_seed->seed = _seed;
+    world_seed->set = true;
+  }
+
+  /// \brief 64 bit FNV-1a, stable across compilers and runs.
+  static uint64_t Hash(const std::string &_name) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char c : _name) {
+      hash ^= c;
+      hash *= 0x100000001b3ull;
+    }
+    return hash;
+  }
+
+  /// \brief Standard normal sample.
+  double Gaussian() {
+    if (has_cached_) {
+      has_cached_ = false;
+      return cached_;
+    }
+    double pair[2];
+    NextGaussianPair(pair);
+    cached_ = pair[1];
+    has_cached_ = true;
+    return pair[0];
+  }
+
+  /// \brief Uniform sample in (0, 1).
+  double Uniform() {
+    uint32_t bits[4];
+    NextBlock(bits);
+    return ToUniform(bits[0], bits[1]);
+  }
+
+  /// \brief Fills _out with _count normal samples of standard deviation
+  /// _stddev. Generates whole blocks at a time, which is considerably
+  /// cheaper per sample than repeated Gaussian() calls.
+  template <typename T>
+  void FillGaussian(T *_out, size_t _count, double _stddev = 1.0) {
+    size_t i = 0;
+    if (has_cached_ && _count > 0) {
+      _out[i++] = static_cast<T>(_stddev * cached_);
+      has_cached_ = false;
+    }
+    double pair[2];
+    for (; i + 1 < _count; i += 2) {
+      NextGaussianPair(pair);
+      _out[i] = static_cast<T>(_stddev * pair[0]);
+      _out[i + 1] = static_cast<T>(_stddev * pair[1]);
+    }
+    if (i < _count) {
+      _out[i] = static_cast<T>(_stddev * Gaussian());
+    }
+  }
+
+ private:
+  // shared through the sensor bus, each plugin has its own copy of this header
+  static std::shared_ptr<WorldNoiseSeed> SharedWorldSeed(const std::string &_world) {
+    return SensorBus::Instance().GetShared<WorldNoiseSeed>(_world + "/noise_seed");
+  }
+
+  void NextBlock(uint32_t _out[4]) {
+    const uint32_t counter[4] = {
+      static_cast<uint32_t>(index_), static_cast<uint32_t>(index_ >> 32),
+      stream_[0], stream_[1]
+    };
+    ++index_;
+    Philox4x32::Generate(counter, key_, _out);
+  }
+
+  // 53 bit uniform in (0, 1), never 0 so the log below is finite
+  static double ToUniform(uint32_t _hi, uint32_t _lo) {
+    const uint64_t bits = (static_cast<uint64_t>(_hi) << 21) ^ (_lo >> 11);
+    return (static_cast<double>(bits & ((1ull << 53) - 1)) + 0.5) * (1.0 / 9007199254740992.0);
+  }
+
+  // Box-Muller on one 128 bit block
+  void NextGaussianPair(double _out[2]) {
+    uint32_t bits[4];
+    NextBlock(bits);
+    const double u1 = ToUniform(bits[0], bits[1]);
+    const double u2 = ToUniform(bits[2], bits[3]);
+    const double r = std::sqrt(-2.0 * std::log(u1));
+    const double theta = 2.0 * M_PI * u2;
+    _out[0] = r * std::cos(theta);
+    _out[1] = r * std::sin(theta);
+  }
+
+  uint32_t key_[2];
+  uint32_t stream_[2];
+  uint64_t index_;
+  double cached_;
+  bool has_cached_;
+};
+
+#endif  // SITL_GAZEBO_NOISE_STREAM_H_
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SITL_GAZEBO_ROTOR_GROUP_KERNEL_H_
+#define SITL_GAZEBO_ROTOR_GROUP_KERNEL_H_
+
+#include <cstddef>
+#include <vector>
+
+/// \brief Parameters and geometry of one rotor of a RotorGroupKernel.
+/// Positions and axes are in the frame of the common parent link.
+struct RotorGroupRotor {
+  double direction;  ///< +1 ccw, -1 cw
+  double max_rot_velocity;
+  double motor_constant;
+  double moment_constant;
+  double rotor_drag_coefficient;
+  double rolling_moment_coefficient;
+  double rotor_velocity_slowdown_sim;
+  double time_constant_up;
+  double time_constant_down;
+  double position[3];     ///< rotor origin relative to the parent CoG
+  double thrust_axis[3];  ///< rotor z axis
+  double joint_axis[3];
+};
+
+/**
+ * \brief Forces, moments and motor response of a group of rotors.
+ *
+ * Computes the same thrust, drag torque, rotor drag and rolling moment as
+ * one GazeboMotorModel per rotor, but for all rotors in a single loop over
+ * parameter arrays. The velocity of each rotor follows from the parent's
+ * linear and angular velocity and the rotor position. Each rotor force is
+ * moved from the rotor to the parent CoG by adding r x F to the torque, so
+ * the sum can be applied to the parent in one call.
+ *
+ * Does not depend on gazebo, GazeboRotorGroupPlugin gathers the state and
+ * scatters the result.
+ */
+class RotorGroupKernel {
+ public:
+  RotorGroupKernel();
+
+  void AddRotor(const RotorGroupRotor &_rotor);
+  size_t Size() const { return direction_.size(); }
+
+  /// \brief Stops the motors, the next step recomputes the filter coefficients.
+  void Reset();
+
+  /// \brief Sets the step size, the filter coefficients only change with it.
+  void SetSamplingTime(double _sampling_time);
+  double SamplingTime() const { return sampling_time_; }
+
+  /// \brief Commanded rotor speed [rad/s], limited to the maximum.
+  void SetReference(size_t _i, double _rot_vel);
+
+  /// \brief Current joint velocity of rotor _i [rad/s].
+  void SetRotorVelocity(size_t _i, double _rot_vel) { rot_vel_[_i] = _rot_vel; }
+  double RotorVelocity(size_t _i) const { return rot_vel_[_i]; }
+
+  /// \brief Joint velocity to set on rotor _i after Update.
+  double VelocityCommand(size_t _i) const { return velocity_command_[_i]; }
+
+  /// \brief The per step kernel.
+  /// \param[in] _linear_vel Velocity of the parent CoG, parent frame.
+  /// \param[in] _angular_vel Angular velocity of the parent, parent frame.
+  /// \param[out] _force Summed force on the parent CoG, parent frame.
+  /// \param[out] _torque Summed torque about the parent CoG, parent frame.
+  /// \return true if a rotor spins too fast for the step size.
+  bool Update(const double _linear_vel[3], const double _angular_vel[3],
+              double _force[3], double _torque[3]);
+
+ private:
+  double sampling_time_;
+
+  // One entry per rotor, structure of arrays.
+  std::vector<double> direction_;
+  std::vector<double> max_rot_velocity_;
+  std::vector<double> motor_constant_;
+  std::vector<double> moment_constant_;
+  std::vector<double> rotor_drag_coefficient_;
+  std::vector<double> rolling_moment_coefficient_;
+  std::vector<double> rotor_velocity_slowdown_sim_;
+  std::vector<double> time_constant_up_;
+  std::vector<double> time_constant_down_;
+
+  // Geometry in the parent frame, the rotors only spin about their axis.
+  std::vector<double> pos_x_, pos_y_, pos_z_;
+  std::vector<double> thrust_x_, thrust_y_, thrust_z_;
+  std::vector<double> axis_x_, axis_y_, axis_z_;
+
+  // State
+  std::vector<double> ref_rot_vel_;
+  std::vector<double> rot_vel_;
+  std::vector<double> filter_state_;
+  std::vector<double> alpha_up_;
+  std::vector<double> alpha_down_;
+  std::vector<double> velocity_command_;
+};
+
+#endif  // SITL_GAZEBO_ROTOR_GROUP_KERNEL_H_
@@ -0,0 +1,196 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_SENSOR_BUS_H_
+#define SITL_GAZEBO_SENSOR_BUS_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+/// \brief Mirrors sensor_msgs::msgs::Imu without the covariances.
+struct ImuSample {
+  double orientation[4];          ///< w, x, y, z
+  double angular_velocity[3];     ///< [rad/s]
+  double linear_acceleration[3];  ///< [m/s^2]
+};
+
+/// \brief Mirrors lidar_msgs::msgs::lidar and sonarSens_msgs::msgs::sonarSens.
+struct RangeSample {
+  float time_msec;
+  float min_distance;      ///< [m]
+  float max_distance;      ///< [m]
+  float current_distance;  ///< [m]
+};
+
+/// \brief Mirrors opticalFlow_msgs::msgs::opticalFlow.
+struct OpticalFlowSample {
+  int32_t time_usec;
+  int32_t sensor_id;
+  int32_t integration_time_us;
+  float integrated_x;
+  float integrated_y;
+  float integrated_xgyro;
+  float integrated_ygyro;
+  float integrated_zgyro;
+  float temperature;
+  int32_t quality;
+  int32_t time_delta_distance_us;
+  float distance;
+};
+
+/// \brief Mirrors irlock_msgs::msgs::irlock.
+struct IRLockSample {
+  float time_usec;
+  int32_t signature;
+  float pos_x;
+  float pos_y;
+  float size_x;
+  float size_y;
+};
+
+/// \brief A GPS fix, laid out after mavlink HIL_GPS in SI units.
+struct GpsSample {
+  double time;                ///< sim time the fix was taken [s]
+  double latitude;            ///< [deg]
+  double longitude;           ///< [deg]
+  double altitude;            ///< above MSL [m]
+  double eph;                 ///< horizontal position accuracy [m]
+  double epv;                 ///< vertical position accuracy [m]
+  double velocity_north;      ///< [m/s]
+  double velocity_east;       ///< [m/s]
+  double velocity_down;       ///< [m/s]
+  double ground_speed;        ///< [m/s]
+  double course_over_ground;  ///< [deg] in [0, 360)
+  int32_t fix_type;
+  int32_t satellites_visible;
+};
+
+/**
+ * \brief One typed topic of the SensorBus.
+ *
+ * Publish() calls every subscriber synchronously with a reference to the
+ * publisher's sample, nothing is copied or serialized.
+ */
+template <typename T>
+class SensorTopic : public std::enable_shared_from_this<SensorTopic<T> > {
+ public:
+  typedef std::function<void(const T &)> Callback;
+
+  /// \brief Unsubscribes when destroyed.
+  class Subscription {
+   public:
+    Subscription(const std::shared_ptr<SensorTopic<T> > &_topic, unsigned _id)
+        : topic_(_topic), id_(_id) {}
+    ~Subscription() { topic_->Unsubscribe(id_); }
+
+   private:
+    std::shared_ptr<SensorTopic<T> > topic_;
+    unsigned id_;
+  };
+  typedef std::shared_ptr<Subscription> SubscriptionPtr;
+
+  SensorTopic() : next_id_(0) {}
+
+  SubscriptionPtr Subscribe(const Callback &_callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const unsigned id = next_id_++;
+    subscribers_.push_back(std::make_pair(id, _callback));
+    return SubscriptionPtr(new Subscription(this->shared_from_this(), id));
+  }
+
+  void Publish(const T &_sample) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &subscriber : subscribers_) {
+      subscriber.second(_sample);
+    }
+  }
+
+  bool HasSubscribers() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !subscribers_.empty();
+  }
+
+ private:
+  void Unsubscribe(unsigned _id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = subscribers_.begin(); it != subscribers_.end(); ++it) {
+      if (it->first == _id) {
+        subscribers_.erase(it);
+        break;
+      }
+    }
+  }
+
+  mutable std::mutex mutex_;
+  std::vector<std::pair<unsigned, Callback> > subscribers_;
+  unsigned next_id_;
+};
+
+/**
+ * \brief In-process bus for sensor data between plugins.
+ *
+ * Sensor plugins publish plain structs here and consumers in the same
+ * gazebo process subscribe to them, which avoids the protobuf round trip
+ * through gazebo transport. Topics are named like the gazebo topic they
+ * shadow, so publishers only need to serialize to gazebo transport when
+ * there is an external subscriber.
+ *
+ * The registry lives in its own shared library so that all plugins see the
+ * same topics.
+ */
+class SensorBus {
+ public:
+  static SensorBus &Instance();
+
+  /// \brief Returns the topic _name carrying T, creating it on first use.
+  template <typename T>
+  std::shared_ptr<SensorTopic<T> > GetTopic(const std::string &_name) {
+    return GetShared<SensorTopic<T> >(_name);
+  }
+
+  /// \brief Returns the object _name of type T shared by all plugins,
+  /// default constructing it on first use.
+  template <typename T>
+  std::shared_ptr<T> GetShared(const std::string &_name) {
+    // the type is part of the key, plugins are loaded with local symbols so
+    // typeid objects can't be compared across them but their names can
+    const std::string key = _name + "#" + typeid(T).name();
+    std::shared_ptr<void> object = Lookup(key, []() {
+      return std::static_pointer_cast<void>(std::make_shared<T>());
+    });
+    return std::static_pointer_cast<T>(object);
+  }
+
+ private:
+  SensorBus() {}
+  SensorBus(const SensorBus &) = delete;
+  SensorBus &operator=(const SensorBus &) = delete;
+
+  std::shared_ptr<void> Lookup(const std::string &_key,
+                               const std::function<std::shared_ptr<void>()> &_create);
+
+  std::mutex mutex_;
+  std::map<std::string, std::shared_ptr<void> > topics_;
+};
+
+#endif  // SITL_GAZEBO_SENSOR_BUS_H_
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_SIM_SCHEDULER_H_
+#define SITL_GAZEBO_SIM_SCHEDULER_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+class SimScheduler;
+
+/// \brief Node of the circular slot lists of the SimScheduler.
+struct SimTimerLink {
+  SimTimerLink *prev;  ///< nullptr if not linked
+  SimTimerLink *next;
+
+  SimTimerLink() : prev(nullptr), next(nullptr) {}
+};
+
+/**
+ * \brief A periodic or one-shot callback of the SimScheduler.
+ *
+ * Cancels itself when destroyed. All methods may be called from within
+ * timer callbacks, including the timer's own.
+ */
+class SimTimer : private SimTimerLink {
+ public:
+  /// \brief Called with the sim time the timer was due at [s].
+  typedef std::function<void(double)> Callback;
+
+  ~SimTimer();
+
+  /// \brief Stops the timer, the callback is not called any more.
+  void Cancel();
+
+  /// \brief (Re)arms the timer to fire _delay seconds after the current
+  /// sim time, a periodic timer then continues at its period.
+  void Restart(double _delay);
+
+  bool Armed() const;
+
+ private:
+  friend class SimScheduler;
+
+  SimTimer(SimScheduler *_scheduler, int64_t _period_ns, const Callback &_callback);
+  SimTimer(const SimTimer &) = delete;
+  SimTimer &operator=(const SimTimer &) = delete;
+
+  SimScheduler *scheduler_;
+  const int64_t period_ns_;  ///< 0 for one-shot timers
+  const Callback callback_;
+  int64_t due_ns_;
+};
+
+typedef std::unique_ptr<SimTimer> SimTimerPtr;
+
+/**
+ * \brief Runs callbacks at given points of sim time.
+ *
+ * Replaces the "now - last_time_ >= interval" checks plugins did on every
+ * physics step. The timers live in a hierarchical timing wheel of four
+ * levels with 256 slots each; a level 0 slot spans 2^20 ns (about 1 ms)
+ * and the wheel covers about 50 days ahead. Arming and cancelling a timer
+ * is O(1) and a step only touches the slots the sim time passed, so a
+ * step without due timers costs next to nothing however many are armed.
+ *
+ * Timers fire in the first world update at or after their due time, in
+ * the order they are due. Periodic timers are rescheduled from their due
+ * time, not from the step they ran in, so their rate has no jitter and if
+ * a step spans several periods the callback runs once per period. When
+ * sim time jumps back (world reset) every timer keeps its remaining delay.
+ *
+ * The scheduler advances itself from the world update begin event while
+ * at least one timer exists. It lives in its own shared library so that
+ * all plugins share the same wheel.
+ *
+ *   gps_timer_ = SimScheduler::Instance().SchedulePeriodic(
+ *       1.0 / update_rate_, std::bind(&GazeboGpsPlugin::TakeFix, this, std::placeholders::_1));
+ */
+class SimScheduler {
+ public:
+  static SimScheduler &Instance();
+
+  /// \brief Calls _callback every _period seconds of sim time, first
+  /// _period seconds from now.
+  SimTimerPtr SchedulePeriodic(double _period, const SimTimer::Callback &_callback);
+
+  /// \brief Calls _callback once, _delay seconds of sim time from now.
+  SimTimerPtr ScheduleAfter(double _delay, const SimTimer::Callback &_callback);
+
+  /// \brief Like ScheduleAfter but not armed, see SimTimer::Restart().
+  SimTimerPtr CreateOneShot(const SimTimer::Callback &_callback);
+
+  /// \brief Sim time of the last world update [s].
+  double Now() const;
+
+  /// \brief Fires all timers due at or before _sim_time_ns.
+  ///
+  /// Called by the world update event, public for drivers of their own.
+  void Advance(int64_t _sim_time_ns);
+
+ private:
+  static const int kLevels = 4;
+  static const int kSlotBits = 8;
+  static const int kSlots = 1 << kSlotBits;
+  static const int kTickBits = 20;
+
+  SimScheduler();
+  SimScheduler(const SimScheduler &) = delete;
+  SimScheduler &operator=(const SimScheduler &) = delete;
+
+  friend class SimTimer;
+
+  SimTimerPtr Create(int64_t _period_ns, const SimTimer::Callback &_callback);
+  void Destroy(SimTimer *_timer);
+
+  void Arm(SimTimer *_timer, int64_t _due_ns);
+  void Disarm(SimTimer *_timer);
+  void Insert(SimTimer *_timer);
+  static void Link(SimTimerLink *_head, SimTimerLink *_node);
+  static void Unlink(SimTimerLink *_node);
+
+  /// \brief Moves the timers of a higher level slot down the wheel.
+  void Cascade(int _level, int64_t _tick);
+
+  /// \brief Fires the due timers of the level 0 slot of the current tick.
+  void RunSlot(int64_t _now_ns);
+
+  /// \brief Shifts all armed timers by _offset_ns.
+  void Rebase(int64_t _offset_ns);
+
+  void Connect();
+  void Disconnect();
+
+  mutable std::recursive_mutex mutex_;
+  SimTimerLink wheel_[kLevels][kSlots];  ///< list heads
+  int64_t now_ns_;
+  int64_t tick_;        ///< now_ns_ >> kTickBits, the slots before are done
+  bool started_;        ///< now_ns_ is the sim time of this world
+  size_t timer_count_;  ///< existing timers, armed or not
+  std::shared_ptr<void> update_connection_;
+};
+
+#endif  // SITL_GAZEBO_SIM_SCHEDULER_H_
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_SPSC_RING_H_
+#define SITL_GAZEBO_SPSC_RING_H_
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * \brief Bounded lock-free single-producer/single-consumer ring buffer.
+ *
+ * Exactly one thread may call Push() and exactly one (other) thread may call
+ * Pop() at any time. Capacity has to be a power of two, one slot is kept free
+ * to tell a full ring from an empty one.
+ */
+template <typename T, size_t Capacity>
+class SpscRing {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "SpscRing capacity must be a power of two");
+
+ public:
+  SpscRing() : head_(0), tail_(0) {}
+
+  /// \brief Copies _item into the ring, returns false if the ring is full.
+  bool Push(const T& _item) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t next = (head + 1) & kMask;
+    if (next == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    slots_[head] = _item;
+    head_.store(next, std::memory_order_release);
+    return true;
+  }
+
+  /// \brief Moves the oldest item into _item, returns false if the ring is empty.
+  bool Pop(T& _item) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    _item = slots_[tail];
+    tail_.store((tail + 1) & kMask, std::memory_order_release);
+    return true;
+  }
+
+  /// \brief Only a hint when called from the producer side.
+  bool Empty() const {
+    return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+  }
+
+ private:
+  static constexpr size_t kMask = Capacity - 1;
+  // Keep producer and consumer indices on separate cache lines. Padding
+  // instead of alignas, so rings can live in objects allocated with plain
+  // operator new before C++17.
+  static constexpr size_t kCacheLine = 64;
+
+  std::atomic<size_t> head_;
+  char pad_head_[kCacheLine - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> tail_;
+  char pad_tail_[kCacheLine - sizeof(std::atomic<size_t>)];
+  T slots_[Capacity];
+};
+
+#endif  // SITL_GAZEBO_SPSC_RING_H_
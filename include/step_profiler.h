@@ -0,0 +1,161 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_STEP_PROFILER_H_
+#define SITL_GAZEBO_STEP_PROFILER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Log-linear latency histogram in the style of HdrHistogram.
+ *
+ * Values are nanoseconds. Every power of two is split into 16 linear
+ * buckets, so a recorded value is known to within 6.25% over the whole
+ * range from 1 ns to about half an hour with a fixed 5 kB footprint.
+ */
+class LatencyHistogram {
+ public:
+  static const int kSubBucketBits = 4;
+  static const int kSubBuckets = 1 << kSubBucketBits;
+  static const int kBuckets = kSubBuckets * 38;
+
+  /// \brief Bucket of a value.
+  static int Index(uint64_t _value_ns);
+
+  /// \brief Largest value that falls into bucket _index.
+  static uint64_t UpperBound(int _index);
+};
+
+/// \brief Counts of a LatencyHistogram at one point in time.
+struct LatencyStats {
+  uint64_t buckets[LatencyHistogram::kBuckets];
+  uint64_t count;
+  uint64_t total_ns;
+
+  LatencyStats();
+
+  /// \brief Counts recorded since _earlier was taken.
+  LatencyStats operator-(const LatencyStats &_earlier) const;
+
+  /// \brief Value below which _quantile of the samples fall, 0 if empty.
+  uint64_t Percentile(double _quantile) const;
+  uint64_t Max() const { return Percentile(1.0); }
+};
+
+/**
+ * \brief Call count and latency histogram of one instrumented callback.
+ *
+ * Record() is meant to be called from a single thread at a time (all
+ * plugins of a world are updated from the physics thread). It uses plain
+ * relaxed loads and stores, no locked instructions, so it costs about as
+ * much as reading the clock. Snapshot() may be called from any thread.
+ */
+class ProfileProbe {
+ public:
+  explicit ProfileProbe(const std::string &_name);
+
+  const std::string &Name() const { return name_; }
+
+  void Record(uint64_t _elapsed_ns) {
+    Increment(buckets_[LatencyHistogram::Index(_elapsed_ns)], 1);
+    Increment(count_, 1);
+    Increment(total_ns_, _elapsed_ns);
+  }
+
+  LatencyStats Snapshot() const;
+
+ private:
+  static void Increment(std::atomic<uint64_t> &_counter, uint64_t _value) {
+    _counter.store(_counter.load(std::memory_order_relaxed) + _value, std::memory_order_relaxed);
+  }
+
+  const std::string name_;
+  std::atomic<uint64_t> buckets_[LatencyHistogram::kBuckets];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> total_ns_;
+};
+
+typedef std::shared_ptr<ProfileProbe> ProfileProbePtr;
+
+/**
+ * \brief Times the enclosing scope into a probe.
+ *
+ *   void GazeboMotorModel::OnUpdate(const common::UpdateInfo& _info) {
+ *     ScopedProbe probe(update_probe_.get());
+ *     ...
+ *
+ * A null probe disables the measurement.
+ */
+class ScopedProbe {
+ public:
+  explicit ScopedProbe(ProfileProbe *_probe)
+      : probe_(_probe) {
+    if (probe_) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~ScopedProbe() {
+    if (probe_) {
+      const auto elapsed = std::chrono::steady_clock::now() - start_;
+      probe_->Record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+  }
+
+ private:
+  ScopedProbe(const ScopedProbe &) = delete;
+  ScopedProbe &operator=(const ScopedProbe &) = delete;
+
+  ProfileProbe *probe_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * \brief Registry of all probes of the process.
+ *
+ * Plugins register one probe per callback, named model/plugin/callback,
+ * and the step profiler world plugin periodically reports them. Probes
+ * are kept for the lifetime of the process so a respawned vehicle
+ * continues its counts. The registry lives in its own shared library so
+ * that all plugins see the same probes.
+ */
+class StepProfiler {
+ public:
+  static StepProfiler &Instance();
+
+  /// \brief Returns the probe _name, creating it on first use.
+  ProfileProbePtr Register(const std::string &_name);
+
+  /// \brief All probes ordered by name.
+  std::vector<ProfileProbePtr> Probes() const;
+
+ private:
+  StepProfiler() {}
+  StepProfiler(const StepProfiler &) = delete;
+  StepProfiler &operator=(const StepProfiler &) = delete;
+
+  mutable std::mutex mutex_;
+  std::map<std::string, ProfileProbePtr> probes_;
+};
+
+#endif  // SITL_GAZEBO_STEP_PROFILER_H_
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_THROTTLED_PUBLISHER_H_
+#define SITL_GAZEBO_THROTTLED_PUBLISHER_H_
+
+#include <limits>
+#include <string>
+
+#include <gazebo/transport/transport.hh>
+
+namespace gazebo {
+
+/// \brief Publish rate meaning "every time the owner has new data".
+static constexpr double kUnlimitedPubRate = std::numeric_limits<double>::infinity();
+
+/**
+ * \brief Publisher for telemetry that is only worth sending if someone listens.
+ *
+ * The owner asks Ready() before it builds a message and only then fills and
+ * publishes it. Ready() is false without subscribers and until the publish
+ * interval has passed, so nothing is allocated or serialized for topics no
+ * one watches, and a slower rate coalesces the updates in between into the
+ * latest state.
+ *
+ *   if (speed_pub_.Ready(sim_time)) {
+ *     std_msgs::msgs::Float msg;
+ *     msg.set_data(rotor_velocity);
+ *     speed_pub_.Publish(msg, sim_time);
+ *   }
+ *
+ * The rate is given in Hz: kUnlimitedPubRate publishes on every update,
+ * 0 never publishes (the topic is still advertised).
+ */
+template <typename M>
+class ThrottledPublisher {
+ public:
+  ThrottledPublisher()
+      : interval_(0.0),
+        enabled_(true),
+        next_pub_time_(-std::numeric_limits<double>::infinity()),
+        last_pub_time_(-std::numeric_limits<double>::infinity()) {}
+
+  void Advertise(transport::NodePtr _node, const std::string &_topic,
+                 double _rate_hz = kUnlimitedPubRate, unsigned int _queue_limit = 1) {
+    pub_ = _node->Advertise<M>(_topic, _queue_limit);
+    SetRate(_rate_hz);
+  }
+
+  void SetRate(double _rate_hz) {
+    enabled_ = _rate_hz > 0.0;
+    interval_ = enabled_ ? 1.0 / _rate_hz : 0.0;
+    Reset();
+  }
+
+  /// \brief Publish the next update regardless of the interval.
+  void Reset() {
+    next_pub_time_ = -std::numeric_limits<double>::infinity();
+    last_pub_time_ = -std::numeric_limits<double>::infinity();
+  }
+
+  /// \brief True if a message published at _sim_time would reach anyone.
+  bool Ready(double _sim_time) const {
+    if (!enabled_ || !pub_ || !pub_->HasConnections()) {
+      return false;
+    }
+    // a world reset moves the time backwards
+    return _sim_time >= next_pub_time_ || _sim_time < last_pub_time_;
+  }
+
+  void Publish(const M &_msg, double _sim_time) {
+    pub_->Publish(_msg);
+    // keep the nominal rate unless we fell behind by more than an interval
+    next_pub_time_ += interval_;
+    if (next_pub_time_ <= _sim_time || _sim_time < last_pub_time_) {
+      next_pub_time_ = _sim_time + interval_;
+    }
+    last_pub_time_ = _sim_time;
+  }
+
+  const transport::PublisherPtr &Publisher() const { return pub_; }
+
+ private:
+  transport::PublisherPtr pub_;
+  double interval_;
+  bool enabled_;
+  double next_pub_time_;
+  double last_pub_time_;
+};
+
+}
+
+#endif  // SITL_GAZEBO_THROTTLED_PUBLISHER_H_
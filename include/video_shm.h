@@ -0,0 +1,136 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SITL_GAZEBO_VIDEO_SHM_H_
+#define SITL_GAZEBO_VIDEO_SHM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * Shared memory video rings
+ *
+ * Raw camera frames for consumers on the same host, without encoding or
+ * sockets. The POSIX shared memory object (/dev/shm/<name> on Linux) is a
+ * 4 kB header followed by `slot_count` slots of `slot_size` bytes. A slot
+ * is a 64 byte VideoShmSlot followed by `height` rows of `stride` bytes of
+ * pixels in `format`, currently always "RGB" (8 bit R, G, B).
+ *
+ * Frame n goes to slot n % slot_count. `written` counts the frames
+ * published, the newest is written - 1. A slot's `sequence` is odd while
+ * the writer fills it and 2 * (n + 1) once frame n is complete; readers
+ * copy a frame and check that its sequence is even and didn't change
+ * meanwhile. All values are in host byte order.
+ *
+ * The writer removes the name when the camera is unloaded, readers keep
+ * their mapping but see no new frames.
+ */
+
+static const char kVideoShmMagic[8] = {'S', 'I', 'T', 'L', 'V', 'I', 'D', '1'};
+static const uint32_t kVideoShmVersion = 1;
+static const uint32_t kVideoShmHeaderSize = 4096;
+static const uint32_t kVideoShmSlotHeaderSize = 64;
+
+struct VideoShmHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;  ///< offset of the first slot
+  uint32_t width;        ///< [pixels]
+  uint32_t height;       ///< [pixels]
+  uint32_t stride;       ///< bytes per row
+  uint32_t slot_count;
+  uint64_t slot_size;    ///< bytes from one slot to the next
+  uint64_t frame_size;   ///< pixel bytes per frame, height * stride
+  uint64_t written;      ///< frames published so far
+  char format[8];        ///< pixel format, "RGB"
+};
+
+struct VideoShmSlot {
+  uint64_t sequence;      ///< 2 * (frame + 1) when complete, odd while written
+  uint64_t frame;         ///< number of the frame, counting from 0
+  double sim_time;        ///< sim time the frame was rendered at [s]
+  char reserved[kVideoShmSlotHeaderSize - 24];
+};
+
+/**
+ * \brief Writer of a video ring, the camera side.
+ */
+class VideoShmWriter {
+ public:
+  /// \brief Creates (or replaces) the ring _name ("/name"), nullptr on failure.
+  static std::unique_ptr<VideoShmWriter> Create(const std::string &_name,
+                                                uint32_t _width,
+                                                uint32_t _height,
+                                                uint32_t _slot_count);
+
+  ~VideoShmWriter();
+
+  const std::string &Name() const { return name_; }
+
+  /// \brief Publishes an RGB frame of width * height * 3 bytes.
+  void Write(const void *_rgb, double _sim_time);
+
+ private:
+  VideoShmWriter(const std::string &_name, void *_map, size_t _map_size);
+
+  std::string name_;
+  void *map_;
+  size_t map_size_;
+  VideoShmHeader *header_;
+};
+
+/**
+ * \brief Reader of a video ring, maps it read only.
+ *
+ *   VideoShmReader reader;
+ *   if (reader.Open("/sitl_camera")) {
+ *     std::vector<uint8_t> rgb(reader.Header().frame_size);
+ *     VideoShmSlot info;
+ *     if (reader.ReadLatest(rgb.data(), &info)) {
+ *       ...
+ */
+class VideoShmReader {
+ public:
+  VideoShmReader();
+  ~VideoShmReader();
+
+  bool Open(const std::string &_name);
+  void Close();
+
+  const VideoShmHeader &Header() const { return *header_; }
+
+  /// \brief Frames published so far.
+  uint64_t Written() const { return __atomic_load_n(&header_->written, __ATOMIC_ACQUIRE); }
+
+  /// \brief Copies frame _frame to _rgb (frame_size bytes), false if it isn't
+  /// in the ring (any more) or was overwritten while copying.
+  bool Read(uint64_t _frame, void *_rgb, VideoShmSlot *_info) const;
+
+  /// \brief Copies the newest frame, false if there is none yet.
+  bool ReadLatest(void *_rgb, VideoShmSlot *_info) const;
+
+ private:
+  VideoShmReader(const VideoShmReader &) = delete;
+  VideoShmReader &operator=(const VideoShmReader &) = delete;
+
+  void *map_;
+  size_t map_size_;
+  const VideoShmHeader *header_;
+};
+
+#endif  // SITL_GAZEBO_VIDEO_SHM_H_
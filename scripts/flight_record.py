@@ -0,0 +1,134 @@
+#!/usr/bin/env python
+#
+# Copyright 2017 PX4 Development Team
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Reader for the record files of the flight recorder plugin.
+
+  import flight_record
+  truth = flight_record.read('iris.truth.rec')
+  plot(truth['sim_time'], truth['position'][:, 2])
+
+With numpy, read() returns a structured array in chronological order,
+otherwise a list of dicts. The record layout is taken from the file, see
+include/flight_record.h.
+
+Run as a script to print a summary of record files.
+"""
+
+from __future__ import print_function
+
+import struct
+import sys
+
+MAGIC = b'SITLREC1'
+VERSION = 1
+# magic, version, header_size, record_type, record_size, capacity, written, stream, format
+HEADER = struct.Struct('=8sIIIIQQ64s512s')
+
+TYPES = {'f8': 'd', 'u4': 'I', 'u1': 'B'}
+
+
+class Header(object):
+    def __init__(self, data):
+        (magic, self.version, self.header_size, self.record_type, self.record_size,
+         self.capacity, self.written, stream, fmt) = HEADER.unpack_from(data)
+        if magic != MAGIC or self.version != VERSION:
+            raise ValueError('not a flight record file of version %d' % VERSION)
+        self.stream = stream.split(b'\0')[0].decode()
+        self.format = fmt.split(b'\0')[0].decode()
+
+    def fields(self):
+        """(name, type, count) of every record field."""
+        fields = []
+        for field in self.format.split(';'):
+            name, spec = field.split(':')
+            type_, _, count = spec.partition('x')
+            fields.append((name, type_, int(count) if count else 1))
+        return fields
+
+    def size(self):
+        return min(self.written, self.capacity)
+
+    def first(self):
+        """Ring index of the oldest record."""
+        return self.written % self.capacity if self.written > self.capacity else 0
+
+
+def read_header(path):
+    with open(path, 'rb') as f:
+        return Header(f.read(HEADER.size))
+
+
+def _records(header, data):
+    """Record bytes in chronological order."""
+    start = header.header_size
+    end = start + header.capacity * header.record_size
+    ring = data[start:end]
+    split = header.first() * header.record_size
+    return (ring[split:] + ring[:split])[:header.size() * header.record_size]
+
+
+def read(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    header = Header(data)
+    records = _records(header, data)
+
+    try:
+        import numpy as np
+    except ImportError:
+        np = None
+
+    if np is not None:
+        dtype = np.dtype([(name, '=' + type_, (count,) if count > 1 else ())
+                          for name, type_, count in header.fields()])
+        if dtype.itemsize != header.record_size:
+            raise ValueError('format does not match the record size')
+        return np.frombuffer(records, dtype=dtype)
+
+    layout = struct.Struct('=' + ''.join('%d%s' % (count, TYPES[type_])
+                                         for _, type_, count in header.fields()))
+    if layout.size != header.record_size:
+        raise ValueError('format does not match the record size')
+    result = []
+    for offset in range(0, len(records), header.record_size):
+        values = layout.unpack_from(records, offset)
+        record = {}
+        i = 0
+        for name, _, count in header.fields():
+            record[name] = values[i] if count == 1 else list(values[i:i + count])
+            i += count
+        result.append(record)
+    return result
+
+
+def main():
+    if len(sys.argv) < 2:
+        print('usage: %s FILE.rec...' % sys.argv[0])
+        return 1
+    for path in sys.argv[1:]:
+        header = read_header(path)
+        records = read(path)
+        span = ''
+        if len(records):
+            span = ', sim time %.3f to %.3f s' % (records[0]['sim_time'], records[-1]['sim_time'])
+        print('%s: %s, %d of %d records%s, %d overwritten'
+              % (path, header.stream, header.size(), header.capacity, span,
+                 header.written - header.size()))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,359 @@
+#!/usr/bin/env python
+#
+# Copyright 2017 PX4 Development Team
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Encode-to-UDP latency of the GStreamer camera plugin's pipeline.
+
+  python scripts/gst_latency.py --codec h264 --frames 300
+
+Builds the plugin's sender chain (appsrc ! videoconvert ! encoder ! parser
+! payloader ! udpsink) with the encoder table and defaults read from
+src/gazebo_gst_camera_plugin.cpp, and a receiver on the loopback that
+depayloads, decodes and reads back a frame number drawn into each frame.
+Latency is the time from pushing a frame into appsrc to the decoded frame
+reaching the receiver's appsink, so it includes the decoder as well, which
+is the same for all configurations.
+
+Every usable encoder of the codec is measured with zerolatency on and off.
+The script checks that
+- zerolatency is on by default and turns off udpsink clock sync,
+- the encoder table lists the hardware encoders before the software ones,
+- "auto" picks the first encoder that is installed and opens its device,
+- zerolatency is not slower than the old settings for that encoder.
+It exits with 1 if a check fails and 2 without GStreamer (python gi).
+"""
+
+from __future__ import print_function
+
+import argparse
+import os
+import re
+import sys
+import threading
+import time
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+REPO_DIR = os.path.dirname(SCRIPT_DIR)
+
+SOFTWARE_ENCODERS = ('x264enc', 'x265enc', 'jpegenc')
+
+# receiver elements per codec, raw frames are not encoded and not measured
+RECEIVERS = {
+    'h264': ('H264', 'rtph264depay ! h264parse ! avdec_h264 max-threads=1'),
+    'h265': ('H265', 'rtph265depay ! h265parse ! avdec_h265 max-threads=1'),
+    'mjpeg': ('JPEG', 'rtpjpegdepay ! jpegdec'),
+}
+PARSERS = {'h264': 'h264parse', 'h265': 'h265parse', 'mjpeg': None}
+PAYLOADERS = {'h264': 'rtph264pay', 'h265': 'rtph265pay', 'mjpeg': 'rtpjpegpay'}
+
+STAMP_BITS = 16
+
+clock = getattr(time, 'monotonic', time.time)
+
+
+class Plugin(object):
+    """Encoder table and defaults of the camera plugin, parsed from its source."""
+
+    def __init__(self, repo_dir):
+        src = _read(os.path.join(repo_dir, 'src', 'gazebo_gst_camera_plugin.cpp'))
+        header = _read(os.path.join(repo_dir, 'include', 'gazebo_gst_camera_plugin.h'))
+
+        table = re.search(r'kGstEncoders\[\] = \{(.*?)\n\};', src, re.S)
+        if not table:
+            raise ValueError('kGstEncoders not found')
+        self.encoders = []
+        for row in re.findall(r'\{([^{}]*)\}', table.group(1)):
+            fields = [f.strip() for f in row.split(',')]
+            values = [None if f == 'nullptr' else f.strip('"') for f in fields]
+            self.encoders.append({
+                'codec': values[0], 'element': values[1], 'bitrate': values[2],
+                'bitrate_scale': int(values[3]), 'gop': values[4], 'threads': values[5],
+                'speed_preset': values[6], 'latency_property': values[7],
+                'latency_value': values[8]})
+
+        match = re.search(r'zeroLatency\((true|false)\)', src)
+        self.zero_latency = bool(match) and match.group(1) == 'true'
+        self.sync_off = bool(re.search(
+            r'if \(this->zeroLatency\) \{[^}]*"sync", FALSE', src))
+        self.bitrate = int(_constant(header, 'kGstDefaultBitrate'))
+        self.speed_preset = _constant(header, 'kGstDefaultSpeedPreset').strip('"')
+        self.jpeg_quality = int(_constant(header, 'kGstDefaultJpegQuality'))
+
+    def candidates(self, codec):
+        return [e for e in self.encoders if e['codec'] == codec]
+
+
+def _read(path):
+    with open(path) as f:
+        return f.read()
+
+
+def _constant(text, name):
+    match = re.search(name + r' = ([^;]+);', text)
+    if not match:
+        raise ValueError('%s not found' % name)
+    return match.group(1).strip()
+
+
+def percentile(values, p):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(p / 100.0 * len(ordered)))]
+
+
+class Benchmark(object):
+    def __init__(self, Gst, GLib, args):
+        self.Gst = Gst
+        self.GLib = GLib
+        self.args = args
+        self.block = args.width // STAMP_BITS
+
+    def create_encoder(self, element, probe):
+        """Same as GstCameraPlugin::createEncoder, probe opens the device."""
+        Gst = self.Gst
+        encoder = Gst.ElementFactory.make(element, 'Encoder')
+        if encoder is None:
+            return None
+        if probe:
+            if encoder.set_state(Gst.State.READY) == Gst.StateChangeReturn.FAILURE:
+                encoder.set_state(Gst.State.NULL)
+                return None
+            encoder.set_state(Gst.State.NULL)
+        return encoder
+
+    def auto_pick(self, candidates):
+        for info in candidates:
+            if self.create_encoder(info['element'], True) is not None:
+                return info['element']
+        return None
+
+    def frame(self, index):
+        """RGB frame with the index in the first block row and its complement
+        in the second, on a moving gradient so the encoder has work to do."""
+        w, h, b = self.args.width, self.args.height, self.block
+        shift = (index * 4) % 256
+        row = bytes(bytearray(((x + shift) % 256) for x in range(w) for _ in range(3)))
+        rows = [row] * h
+        for line, value in ((0, index), (1, ~index)):
+            stamp = bytearray()
+            for bit in range(STAMP_BITS):
+                level = 255 if (value >> (STAMP_BITS - 1 - bit)) & 1 else 0
+                stamp += bytearray([level]) * (3 * b)
+            stamp += row[len(stamp):]
+            rows[line * b:(line + 1) * b] = [bytes(stamp)] * b
+        return b''.join(rows)
+
+    def read_stamp(self, data, stride):
+        b = self.block
+        values = []
+        for line in (0, 1):
+            y = line * b + b // 2
+            value = 0
+            for bit in range(STAMP_BITS):
+                offset = y * stride + bit * b + b // 2
+                pixel = bytearray(data[offset:offset + 1])[0]
+                value = (value << 1) | (1 if pixel >= 128 else 0)
+            values.append(value)
+        mask = (1 << STAMP_BITS) - 1
+        if values[0] != (~values[1]) & mask:
+            return None
+        return values[0]
+
+    def run(self, info, zero_latency):
+        """Median, 95th percentile and maximum latency [ms] and frames received."""
+        Gst, GLib, args = self.Gst, self.GLib, self.args
+        payload_name, depay = RECEIVERS[args.codec]
+
+        receiver = Gst.parse_launch(
+            'udpsrc port=%d caps="application/x-rtp, media=(string)video, '
+            'clock-rate=(int)90000, encoding-name=(string)%s" ! %s ! videoconvert '
+            '! video/x-raw,format=GRAY8 ! appsink name=sink emit-signals=true sync=false'
+            % (args.port, payload_name, depay))
+        sender = Gst.Pipeline.new('sender')
+
+        source = Gst.ElementFactory.make('appsrc', 'AppSrc')
+        source.set_property('caps', Gst.Caps.from_string(
+            'video/x-raw,format=RGB,width=%d,height=%d,framerate=%d/1'
+            % (args.width, args.height, args.rate)))
+        source.set_property('is-live', True)
+        source.set_property('format', Gst.Format.TIME)
+        elements = [source, Gst.ElementFactory.make('videoconvert', 'Convert')]
+
+        encoder = self.create_encoder(info['element'], False)
+        settings = [(info['bitrate'], str(args.bitrate * info['bitrate_scale']))]
+        settings.append((info['speed_preset'], args.speed_preset))
+        if zero_latency:
+            settings.append((info['latency_property'], info['latency_value']))
+        if args.codec == 'mjpeg':
+            settings.append(('quality', str(args.jpeg_quality)))
+        for name, value in settings:
+            if name and encoder.find_property(name):
+                Gst.util_set_object_arg(encoder, name, value)
+        elements.append(encoder)
+        if PARSERS[args.codec]:
+            elements.append(Gst.ElementFactory.make(PARSERS[args.codec], 'Parser'))
+        payload = Gst.ElementFactory.make(PAYLOADERS[args.codec], 'PayLoad')
+        if payload.find_property('config-interval'):
+            payload.set_property('config-interval', 1)
+        elements.append(payload)
+        sink = Gst.ElementFactory.make('udpsink', 'UdpSink')
+        sink.set_property('host', '127.0.0.1')
+        sink.set_property('port', args.port)
+        if zero_latency:
+            sink.set_property('sync', False)
+        elements.append(sink)
+
+        for element in elements:
+            sender.add(element)
+        for first, second in zip(elements, elements[1:]):
+            if not first.link(second):
+                raise RuntimeError('link %s to %s failed' % (first.get_name(), second.get_name()))
+
+        sent = {}
+        latencies = []
+        stride = (args.width + 3) & ~3
+
+        def on_sample(appsink):
+            now = clock()
+            buffer = appsink.emit('pull-sample').get_buffer()
+            ok, mapped = buffer.map(Gst.MapFlags.READ)
+            if ok:
+                index = self.read_stamp(mapped.data, stride)
+                buffer.unmap(mapped)
+                if index in sent:
+                    latencies.append((now - sent.pop(index)) * 1000.0)
+            return Gst.FlowReturn.OK
+
+        receiver.get_by_name('sink').connect('new-sample', on_sample)
+        receiver.set_state(Gst.State.PLAYING)
+        sender.set_state(Gst.State.PLAYING)
+
+        loop = GLib.MainLoop()
+        duration = Gst.util_uint64_scale_int(1, Gst.SECOND, args.rate)
+
+        def push():
+            start = clock()
+            for index in range(args.frames):
+                delay = start + index / float(args.rate) - clock()
+                if delay > 0:
+                    time.sleep(delay)
+                buffer = Gst.Buffer.new_wrapped(self.frame(index))
+                buffer.pts = index * duration
+                buffer.duration = duration
+                sent[index & ((1 << STAMP_BITS) - 1)] = clock()
+                source.emit('push-buffer', buffer)
+            source.emit('end-of-stream')
+            time.sleep(1.0)  # frames still on their way
+            GLib.idle_add(loop.quit)
+
+        thread = threading.Thread(target=push)
+        thread.start()
+        loop.run()
+        thread.join()
+        sender.set_state(Gst.State.NULL)
+        receiver.set_state(Gst.State.NULL)
+
+        if not latencies:
+            return None
+        return (percentile(latencies, 50), percentile(latencies, 95), max(latencies),
+                len(latencies))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--codec', default='h264', choices=sorted(RECEIVERS))
+    parser.add_argument('--encoders', default=None,
+                        help='comma separated encoders to measure (default: all usable)')
+    parser.add_argument('--frames', type=int, default=300, help='frames per configuration')
+    parser.add_argument('--rate', type=int, default=30, help='[Hz]')
+    parser.add_argument('--width', type=int, default=640)
+    parser.add_argument('--height', type=int, default=360)
+    parser.add_argument('--port', type=int, default=5610, help='loopback UDP port')
+    parser.add_argument('--repo', default=REPO_DIR, help='sitl_gazebo source directory')
+    args = parser.parse_args()
+
+    plugin = Plugin(args.repo)
+    args.bitrate = plugin.bitrate
+    args.speed_preset = plugin.speed_preset
+    args.jpeg_quality = plugin.jpeg_quality
+    failures = []
+
+    if not plugin.zero_latency:
+        failures.append('zerolatency is not on by default')
+    if not plugin.sync_off:
+        failures.append('zerolatency does not turn off udpsink sync')
+
+    candidates = plugin.candidates(args.codec)
+    software = [i for i, e in enumerate(candidates) if e['element'] in SOFTWARE_ENCODERS]
+    hardware = [i for i, e in enumerate(candidates) if e['element'] not in SOFTWARE_ENCODERS]
+    if software and hardware and max(hardware) > min(software):
+        failures.append('%s hardware encoders are not listed first' % args.codec)
+
+    try:
+        import gi
+        gi.require_version('Gst', '1.0')
+        from gi.repository import GLib, Gst
+    except (ImportError, ValueError) as e:
+        print('GStreamer python bindings not available: %s' % e)
+        for failure in failures:
+            print('FAIL: %s' % failure)
+        return 2
+    Gst.init(None)
+
+    if args.height < 2 * args.width // STAMP_BITS:
+        print('frames too small for the stamp')
+        return 2
+
+    benchmark = Benchmark(Gst, GLib, args)
+    picked = benchmark.auto_pick(candidates)
+    print('%s encoders, hardware first: %s' % (
+        args.codec, ', '.join(e['element'] for e in candidates)))
+    print('auto picks: %s' % picked)
+    if picked is None:
+        failures.append('no %s encoder usable' % args.codec)
+
+    usable = [e for e in candidates if benchmark.create_encoder(e['element'], True) is not None]
+    if args.encoders:
+        wanted = args.encoders.split(',')
+        usable = [e for e in usable if e['element'] in wanted]
+
+    print('%-14s %-12s %9s %9s %9s %9s' % ('encoder', 'zerolatency', 'median', 'p95', 'max',
+                                          'frames'))
+    medians = {}
+    for info in usable:
+        for zero_latency in (True, False):
+            result = benchmark.run(info, zero_latency)
+            if result is None:
+                print('%-14s %-12s no frames received' % (info['element'], zero_latency))
+                failures.append('%s received no frames' % info['element'])
+                continue
+            medians[(info['element'], zero_latency)] = result[0]
+            print('%-14s %-12s %7.1fms %7.1fms %7.1fms %5d/%d' % (
+                (info['element'], zero_latency) + result + (args.frames,)))
+
+    if (picked, True) in medians and (picked, False) in medians:
+        if medians[(picked, True)] > medians[(picked, False)] + 1.0:
+            failures.append('zerolatency is slower than the old settings with %s' % picked)
+    fastest = sorted((median, element) for (element, zl), median in medians.items() if zl)
+    if fastest and (picked, True) in medians and fastest[0][1] != picked:
+        print('note: %s was faster than the auto pick %s by %.1fms' % (
+            fastest[0][1], picked, medians[(picked, True)] - fastest[0][0]))
+
+    for failure in failures:
+        print('FAIL: %s' % failure)
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,426 @@
+#!/usr/bin/env python
+#
+# Copyright 2017 PX4 Development Team
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Runs a campaign of headless SITL simulations in parallel.
+
+Every run gets its own gzserver (and, with --px4-cmd, its own PX4) pinned
+to one core, its own gazebo master port and MAVLink UDP port, a noise seed
+(PX4_SIM_SEED), a home position (PX4_HOME_*) and optionally a constant
+wind. The world is stepped as fast as possible for --duration seconds of
+sim time with gzserver --iters.
+
+One CSV line per run is written to --output. Keys of a JSON object a run
+leaves in <rundir>/metrics.json (e.g. written by the mission script) are
+added as columns.
+
+  ./scripts/sitl_batch.py worlds/iris.world --runs 200 --duration 300 \\
+      --px4-cmd '../Firmware/build_posix_sitl_default/px4 -i {instance} ...' \\
+      --output results.csv
+"""
+
+from __future__ import print_function
+
+import argparse
+import csv
+import json
+import math
+import os
+import random
+import shutil
+import signal
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import xml.etree.ElementTree as ET
+
+try:
+    import queue
+except ImportError:
+    import Queue as queue
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+REPO_DIR = os.path.dirname(SCRIPT_DIR)
+
+EARTH_RADIUS = 6353000.0  # [m], same as the mavlink interface
+
+DEFAULT_HOME = (47.397742, 8.545594, 488.0)  # PX4 default home
+DEFAULT_MAVLINK_UDP_PORT = 14560
+DEFAULT_GAZEBO_MASTER_PORT = 11345
+
+RESULT_FIELDS = [
+    'run', 'seed', 'instance', 'cpu', 'mavlink_udp_port',
+    'home_lat', 'home_lon', 'home_alt', 'wind_force', 'wind_direction',
+    'sim_s', 'wall_s', 'speedup', 'gzserver_rc', 'px4_rc',
+]
+
+
+def model_path():
+    """Directories gazebo searches for model:// URIs."""
+    paths = [p for p in os.environ.get('GAZEBO_MODEL_PATH', '').split(':') if p]
+    paths.append(os.path.join(REPO_DIR, 'models'))
+    return paths
+
+
+def find_model(name):
+    for path in model_path():
+        model_dir = os.path.join(path, name)
+        if os.path.isfile(os.path.join(model_dir, 'model.config')):
+            return model_dir
+    return None
+
+
+def model_sdf_file(model_dir):
+    config = ET.parse(os.path.join(model_dir, 'model.config')).getroot()
+    return config.find('sdf').text.strip()
+
+
+def included_models(root):
+    for uri in root.iter('uri'):
+        if uri.text and uri.text.strip().startswith('model://'):
+            yield uri.text.strip()[len('model://'):].split('/')[0]
+
+
+def mavlink_plugins(root):
+    return [p for p in root.iter('plugin')
+            if 'mavlink_interface' in p.get('filename', '')]
+
+
+def set_child(element, tag, value):
+    child = element.find(tag)
+    if child is None:
+        child = ET.SubElement(element, tag)
+    child.text = str(value)
+
+
+def wind_plugin(force, direction):
+    plugin = ET.Element('plugin', name='wind_plugin', filename='librotors_gazebo_wind_plugin.so')
+    for tag, value in (('robotNamespace', ''),
+                       ('frameId', 'base_link'),
+                       ('linkName', 'base_link'),
+                       ('xyzOffset', '0 0 0'),
+                       ('windForceMean', '%.3f' % force),
+                       ('windDirection', '%f %f 0' % (math.cos(direction), math.sin(direction))),
+                       ('windPubRate', 0)):
+        set_child(plugin, tag, value)
+    return plugin
+
+
+class Run(object):
+    def __init__(self, index, args):
+        self.index = index
+        rng = random.Random('%d/%d' % (args.seed, index))
+        self.seed = rng.getrandbits(63)
+
+        # uniform over a disc around the home position
+        distance = args.home_radius * math.sqrt(rng.random())
+        bearing = rng.uniform(0.0, 2.0 * math.pi)
+        lat0 = math.radians(args.home_lat)
+        self.home_lat = args.home_lat + math.degrees(distance * math.cos(bearing) / EARTH_RADIUS)
+        self.home_lon = args.home_lon + math.degrees(
+            distance * math.sin(bearing) / (EARTH_RADIUS * math.cos(lat0)))
+        self.home_alt = args.home_alt
+
+        self.wind_force = rng.uniform(0.0, args.wind_max)
+        self.wind_direction = rng.uniform(0.0, 2.0 * math.pi)
+
+
+class Campaign(object):
+    def __init__(self, args):
+        self.args = args
+        self.world = ET.parse(args.world)
+        physics = self.world.getroot().find('world/physics')
+        step = physics.find('max_step_size') if physics is not None else None
+        self.step_size = float(step.text) if step is not None else 0.001
+        self.iterations = int(round(args.duration / self.step_size))
+
+        self.lock = threading.Lock()
+        self.results = []
+        self.sim_s = 0.0
+        self.failed = 0
+        self.start = None
+
+    def prepare(self, run, instance, rundir):
+        """Writes the world and patched vehicle models of one run."""
+        port = self.args.mavlink_udp_port + instance
+        models_dir = os.path.join(rundir, 'models')
+        os.makedirs(models_dir)
+
+        seen = set()
+        pending = list(included_models(self.world.getroot()))
+        while pending:
+            name = pending.pop()
+            if name in seen:
+                continue
+            seen.add(name)
+            model_dir = find_model(name)
+            if model_dir is None:
+                continue
+            sdf_file = model_sdf_file(model_dir)
+            sdf_path = os.path.join(model_dir, sdf_file)
+            if not os.path.isfile(sdf_path):
+                continue
+            tree = ET.parse(sdf_path)
+            pending.extend(included_models(tree.getroot()))
+
+            plugins = mavlink_plugins(tree.getroot())
+            if not plugins:
+                continue
+            for plugin in plugins:
+                set_child(plugin, 'mavlink_udp_port', port)
+                if self.args.lockstep:
+                    set_child(plugin, 'enable_lockstep', 'true')
+            if run.wind_force > 0.0:
+                tree.getroot().find('model').append(wind_plugin(run.wind_force, run.wind_direction))
+
+            # link everything but the patched sdf, meshes can be large
+            patched_dir = os.path.join(models_dir, name)
+            os.makedirs(patched_dir)
+            for entry in os.listdir(model_dir):
+                if entry != sdf_file:
+                    os.symlink(os.path.join(model_dir, entry), os.path.join(patched_dir, entry))
+            tree.write(os.path.join(patched_dir, sdf_file))
+
+        world = ET.parse(self.args.world)
+        physics = world.getroot().find('world/physics')
+        if physics is not None and not self.args.real_time:
+            set_child(physics, 'real_time_update_rate', 0)
+        world_path = os.path.join(rundir, os.path.basename(self.args.world))
+        world.write(world_path)
+        return world_path, models_dir, port
+
+    def environment(self, run, instance, models_dir):
+        env = dict(os.environ)
+        env['GAZEBO_MASTER_URI'] = 'http://localhost:%d' % (self.args.gazebo_master_port + instance)
+        env['GAZEBO_MODEL_PATH'] = ':'.join([models_dir] + model_path())
+        env['PX4_SIM_SEED'] = str(run.seed)
+        env['PX4_HOME_LAT'] = '%.9f' % run.home_lat
+        env['PX4_HOME_LON'] = '%.9f' % run.home_lon
+        env['PX4_HOME_ALT'] = '%.3f' % run.home_alt
+        return env
+
+    def launch(self, cmd, cpu, env, cwd, log):
+        if hasattr(os, 'sched_setaffinity'):
+            preexec = lambda: os.sched_setaffinity(0, [cpu])
+        else:
+            cmd = ['taskset', '-c', str(cpu)] + cmd
+            preexec = None
+        return subprocess.Popen(cmd, env=env, cwd=cwd, stdout=log, stderr=subprocess.STDOUT,
+                                preexec_fn=preexec)
+
+    def execute(self, run, instance, cpu):
+        rundir = os.path.join(self.args.workdir, 'run_%05d' % run.index)
+        if os.path.exists(rundir):
+            shutil.rmtree(rundir)
+        os.makedirs(rundir)
+        world_path, models_dir, port = self.prepare(run, instance, rundir)
+        env = self.environment(run, instance, models_dir)
+
+        gz_cmd = ['gzserver', '--iters', str(self.iterations), world_path]
+        if self.args.verbose:
+            gz_cmd.insert(1, '--verbose')
+        px4_cmd = None
+        if self.args.px4_cmd:
+            px4_cmd = self.args.px4_cmd.format(instance=instance, port=port,
+                                               rundir=rundir, seed=run.seed)
+
+        px4 = None
+        px4_log = None
+        start = time.time()
+        with open(os.path.join(rundir, 'gzserver.log'), 'w') as gz_log:
+            gz = self.launch(gz_cmd, cpu, env, rundir, gz_log)
+            if px4_cmd:
+                px4_log = open(os.path.join(rundir, 'px4.log'), 'w')
+                px4 = self.launch(['/bin/sh', '-c', 'exec ' + px4_cmd], cpu, env, rundir, px4_log)
+            try:
+                gz_rc = gz.wait()
+            finally:
+                if gz.poll() is None:
+                    gz.kill()
+                    gz.wait()
+        wall_s = time.time() - start
+
+        px4_rc = ''
+        if px4 is not None:
+            if px4.poll() is None:
+                px4.send_signal(signal.SIGINT)
+                for _ in range(50):
+                    if px4.poll() is not None:
+                        break
+                    time.sleep(0.1)
+                else:
+                    px4.kill()
+            px4_rc = px4.wait()
+            px4_log.close()
+
+        sim_s = self.iterations * self.step_size if gz_rc == 0 else 0.0
+        result = {
+            'run': run.index,
+            'seed': run.seed,
+            'instance': instance,
+            'cpu': cpu,
+            'mavlink_udp_port': port,
+            'home_lat': '%.7f' % run.home_lat,
+            'home_lon': '%.7f' % run.home_lon,
+            'home_alt': '%.2f' % run.home_alt,
+            'wind_force': '%.3f' % run.wind_force,
+            'wind_direction': '%.1f' % math.degrees(run.wind_direction),
+            'sim_s': '%.3f' % sim_s,
+            'wall_s': '%.3f' % wall_s,
+            'speedup': '%.2f' % (sim_s / wall_s if wall_s > 0 else 0.0),
+            'gzserver_rc': gz_rc,
+            'px4_rc': px4_rc,
+        }
+        metrics_path = os.path.join(rundir, 'metrics.json')
+        if os.path.isfile(metrics_path):
+            try:
+                with open(metrics_path) as f:
+                    result.update(json.load(f))
+            except ValueError as e:
+                print('run %d: bad metrics.json: %s' % (run.index, e), file=sys.stderr)
+
+        if gz_rc == 0 and not self.args.keep:
+            shutil.rmtree(rundir, ignore_errors=True)
+
+        with self.lock:
+            self.results.append(result)
+            self.sim_s += sim_s
+            if gz_rc != 0:
+                self.failed += 1
+            elapsed = time.time() - self.start
+            print('[%d/%d] run %d: %s sim s in %s wall s, campaign %.1f sim s / wall s'
+                  % (len(self.results), self.args.runs, run.index, result['sim_s'],
+                     result['wall_s'], self.sim_s / elapsed))
+
+    def worker(self, slots, runs):
+        instance, cpu = slots
+        while True:
+            try:
+                run = runs.get_nowait()
+            except queue.Empty:
+                return
+            try:
+                self.execute(run, instance, cpu)
+            except Exception as e:  # keep the campaign going
+                with self.lock:
+                    self.failed += 1
+                print('run %d failed: %s' % (run.index, e), file=sys.stderr)
+
+    def run(self):
+        runs = queue.Queue()
+        for index in range(self.args.first_run, self.args.first_run + self.args.runs):
+            runs.put(Run(index, self.args))
+
+        self.start = time.time()
+        threads = [threading.Thread(target=self.worker, args=((i, cpu), runs))
+                   for i, cpu in enumerate(self.args.cpus[:self.args.jobs])]
+        for t in threads:
+            t.daemon = True
+            t.start()
+        for t in threads:
+            while t.is_alive():
+                t.join(1.0)
+        wall_s = time.time() - self.start
+
+        fields = list(RESULT_FIELDS)
+        for result in self.results:
+            fields.extend(k for k in sorted(result) if k not in fields)
+        with open(self.args.output, 'w') as f:
+            writer = csv.DictWriter(f, fieldnames=fields)
+            writer.writeheader()
+            for result in sorted(self.results, key=lambda r: r['run']):
+                writer.writerow(result)
+
+        print('%d runs, %d failed, %.1f sim s in %.1f wall s: %.2f sim s / wall s'
+              % (self.args.runs, self.failed, self.sim_s, wall_s,
+                 self.sim_s / wall_s if wall_s > 0 else 0.0))
+        return 1 if self.failed else 0
+
+
+def parse_cpus(text):
+    cpus = []
+    for part in text.split(','):
+        if '-' in part:
+            first, last = part.split('-')
+            cpus.extend(range(int(first), int(last) + 1))
+        elif part:
+            cpus.append(int(part))
+    return cpus
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('world', help='world file, e.g. worlds/iris.world')
+    parser.add_argument('--runs', type=int, default=1, help='number of simulations')
+    parser.add_argument('--first-run', type=int, default=0,
+                        help='index of the first run, to continue or split a campaign')
+    parser.add_argument('--duration', type=float, default=60.0, help='sim time per run [s]')
+    parser.add_argument('--jobs', type=int, default=0,
+                        help='simulations at a time, one core each (default: all cores)')
+    parser.add_argument('--cpus', type=parse_cpus, default=None,
+                        help='cores to use, e.g. 2-7,10 (default: all)')
+    parser.add_argument('--seed', type=int, default=0,
+                        help='campaign seed, the runs derive their seeds from it')
+    parser.add_argument('--px4-cmd', default=None,
+                        help='PX4 command line, {instance} {port} {rundir} {seed} are replaced')
+    parser.add_argument('--lockstep', action='store_true',
+                        help='let every step wait for PX4 (enable_lockstep)')
+    parser.add_argument('--real-time', action='store_true',
+                        help='keep the real time update rate of the world')
+    parser.add_argument('--home-lat', type=float, default=DEFAULT_HOME[0], help='[deg]')
+    parser.add_argument('--home-lon', type=float, default=DEFAULT_HOME[1], help='[deg]')
+    parser.add_argument('--home-alt', type=float, default=DEFAULT_HOME[2], help='[m]')
+    parser.add_argument('--home-radius', type=float, default=0.0,
+                        help='randomize home within this distance [m]')
+    parser.add_argument('--wind-max', type=float, default=0.0,
+                        help='randomize a constant wind force up to this value [N], '
+                             'needs librotors_gazebo_wind_plugin.so')
+    parser.add_argument('--mavlink-udp-port', type=int, default=DEFAULT_MAVLINK_UDP_PORT,
+                        help='port of instance 0, instance i uses port + i')
+    parser.add_argument('--gazebo-master-port', type=int, default=DEFAULT_GAZEBO_MASTER_PORT,
+                        help='gazebo master port of instance 0, instance i uses port + i')
+    parser.add_argument('--workdir', default=None, help='directory for the run files')
+    parser.add_argument('--keep', action='store_true', help='keep the files of successful runs')
+    parser.add_argument('--verbose', action='store_true', help='run gzserver --verbose')
+    parser.add_argument('--output', default='results.csv', help='CSV file with one line per run')
+    args = parser.parse_args()
+
+    if args.cpus is None:
+        if hasattr(os, 'sched_getaffinity'):
+            args.cpus = sorted(os.sched_getaffinity(0))
+        else:
+            import multiprocessing
+            args.cpus = list(range(multiprocessing.cpu_count()))
+    if args.jobs <= 0 or args.jobs > len(args.cpus):
+        args.jobs = len(args.cpus)
+
+    own_workdir = args.workdir is None
+    if own_workdir:
+        args.workdir = tempfile.mkdtemp(prefix='sitl_batch_')
+    elif not os.path.isdir(args.workdir):
+        os.makedirs(args.workdir)
+
+    rc = Campaign(args).run()
+    if own_workdir and not args.keep and rc == 0:
+        shutil.rmtree(args.workdir, ignore_errors=True)
+    elif rc != 0 or args.keep:
+        print('run files in %s' % args.workdir)
+    return rc
+
+
+if __name__ == '__main__':
+    sys.exit(main())
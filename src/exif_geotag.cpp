@@ -0,0 +1,273 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "exif_geotag.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <utility>
+
+namespace {
+
+enum TiffType : uint16_t {
+  kTiffByte = 1,
+  kTiffAscii = 2,
+  kTiffLong = 4,
+  kTiffRational = 5,
+  kTiffUndefined = 7
+};
+
+typedef std::pair<uint32_t, uint32_t> Rational;
+
+// TIFF data is written little endian ("II"), the JPEG segment lengths are
+// big endian.
+void Put16(std::vector<unsigned char> &_out, uint16_t _value)
+{
+  _out.push_back(_value & 0xff);
+  _out.push_back(_value >> 8);
+}
+
+void Put32(std::vector<unsigned char> &_out, uint32_t _value)
+{
+  Put16(_out, _value & 0xffff);
+  Put16(_out, _value >> 16);
+}
+
+Rational ToRational(double _value, uint32_t _denominator)
+{
+  return Rational(static_cast<uint32_t>(std::llround(std::fabs(_value) * _denominator)), _denominator);
+}
+
+/// \brief An image file directory, the entries have to be added by ascending tag.
+class Ifd {
+ public:
+  void AddBytes(uint16_t _tag, TiffType _type, const std::vector<unsigned char> &_bytes)
+  {
+    entries_.push_back(Entry{_tag, _type, static_cast<uint32_t>(_bytes.size()), _bytes});
+  }
+
+  void AddAscii(uint16_t _tag, const std::string &_text)
+  {
+    std::vector<unsigned char> bytes(_text.begin(), _text.end());
+    bytes.push_back(0);
+    AddBytes(_tag, kTiffAscii, bytes);
+  }
+
+  void AddRationals(uint16_t _tag, const std::vector<Rational> &_values)
+  {
+    std::vector<unsigned char> bytes;
+    for (const Rational &value : _values) {
+      Put32(bytes, value.first);
+      Put32(bytes, value.second);
+    }
+    entries_.push_back(Entry{_tag, kTiffRational, static_cast<uint32_t>(_values.size()), bytes});
+  }
+
+  /// \return the entry, for SetLong
+  size_t AddLong(uint16_t _tag, uint32_t _value)
+  {
+    std::vector<unsigned char> bytes;
+    Put32(bytes, _value);
+    entries_.push_back(Entry{_tag, kTiffLong, 1, bytes});
+    return entries_.size() - 1;
+  }
+
+  void SetLong(size_t _entry, uint32_t _value)
+  {
+    entries_[_entry].data.clear();
+    Put32(entries_[_entry].data, _value);
+  }
+
+  /// \brief Bytes of the directory and the values that don't fit an entry.
+  uint32_t Size() const
+  {
+    uint32_t size = 2 + 12 * entries_.size() + 4;
+    for (const Entry &entry : entries_) {
+      if (entry.data.size() > 4) {
+        size += (entry.data.size() + 1) & ~1u;
+      }
+    }
+    return size;
+  }
+
+  /// \brief Appends the directory to the TIFF data _tiff, with no next directory.
+  void Write(std::vector<unsigned char> &_tiff) const
+  {
+    uint32_t value_offset = _tiff.size() + 2 + 12 * entries_.size() + 4;
+    Put16(_tiff, entries_.size());
+    for (const Entry &entry : entries_) {
+      Put16(_tiff, entry.tag);
+      Put16(_tiff, entry.type);
+      Put32(_tiff, entry.count);
+      if (entry.data.size() > 4) {
+        Put32(_tiff, value_offset);
+        value_offset += (entry.data.size() + 1) & ~1u;
+      } else {
+        // left aligned in the value field
+        std::vector<unsigned char> value(entry.data);
+        value.resize(4, 0);
+        _tiff.insert(_tiff.end(), value.begin(), value.end());
+      }
+    }
+    Put32(_tiff, 0);
+    for (const Entry &entry : entries_) {
+      if (entry.data.size() > 4) {
+        _tiff.insert(_tiff.end(), entry.data.begin(), entry.data.end());
+        if (entry.data.size() & 1) {
+          _tiff.push_back(0);
+        }
+      }
+    }
+  }
+
+ private:
+  struct Entry {
+    uint16_t tag;
+    uint16_t type;
+    uint32_t count;
+    std::vector<unsigned char> data;
+  };
+
+  std::vector<Entry> entries_;
+};
+
+/// \brief deg, min, sec of an angle, to 1/10000 s.
+std::vector<Rational> ToDegMinSec(double _angle)
+{
+  const uint64_t total = std::llround(std::fabs(_angle) * 3600.0 * 10000.0);
+  return {Rational(total / 36000000, 1),
+          Rational(total % 36000000 / 600000, 1),
+          Rational(total % 600000, 10000)};
+}
+
+std::vector<unsigned char> ExifPayload(const ExifGeotag &_tag)
+{
+  const time_t utc_seconds = static_cast<time_t>(std::floor(_tag.utc_time));
+  struct tm utc;
+  gmtime_r(&utc_seconds, &utc);
+  char date_time[20];
+  strftime(date_time, sizeof(date_time), "%Y:%m:%d %H:%M:%S", &utc);
+  char date[11];
+  strftime(date, sizeof(date), "%Y:%m:%d", &utc);
+  const double seconds = utc.tm_sec + (_tag.utc_time - utc_seconds);
+
+  Ifd ifd0;
+  const size_t exif_pointer = ifd0.AddLong(0x8769, 0);
+  const size_t gps_pointer = ifd0.AddLong(0x8825, 0);
+
+  Ifd exif;
+  exif.AddBytes(0x9000, kTiffUndefined, {'0', '2', '3', '0'});  // ExifVersion
+  exif.AddAscii(0x9003, date_time);  // DateTimeOriginal
+
+  Ifd gps;
+  gps.AddBytes(0x0000, kTiffByte, {2, 3, 0, 0});  // GPSVersionID
+  gps.AddAscii(0x0001, _tag.latitude < 0.0 ? "S" : "N");
+  gps.AddRationals(0x0002, ToDegMinSec(_tag.latitude));
+  gps.AddAscii(0x0003, _tag.longitude < 0.0 ? "W" : "E");
+  gps.AddRationals(0x0004, ToDegMinSec(_tag.longitude));
+  gps.AddBytes(0x0005, kTiffByte, {static_cast<unsigned char>(_tag.altitude < 0.0 ? 1 : 0)});
+  gps.AddRationals(0x0006, {ToRational(_tag.altitude, 1000)});
+  gps.AddRationals(0x0007, {Rational(utc.tm_hour, 1), Rational(utc.tm_min, 1), ToRational(seconds, 1000)});
+  gps.AddAscii(0x0008, std::to_string(_tag.satellites));  // GPSSatellites
+  gps.AddAscii(0x000A, "3");  // GPSMeasureMode, 3-d
+  gps.AddRationals(0x000B, {ToRational(_tag.dop, 100)});
+  if (_tag.has_attitude) {
+    gps.AddAscii(0x0010, "T");  // GPSImgDirectionRef, true north
+    gps.AddRationals(0x0011, {ToRational(_tag.yaw, 100)});
+  }
+  gps.AddAscii(0x001D, date);  // GPSDateStamp
+
+  // TIFF header, IFD0, Exif IFD, GPS IFD
+  const uint32_t ifd0_offset = 8;
+  const uint32_t exif_offset = ifd0_offset + ifd0.Size();
+  const uint32_t gps_offset = exif_offset + exif.Size();
+  ifd0.SetLong(exif_pointer, exif_offset);
+  ifd0.SetLong(gps_pointer, gps_offset);
+
+  std::vector<unsigned char> tiff = {'I', 'I'};
+  Put16(tiff, 42);
+  Put32(tiff, ifd0_offset);
+  ifd0.Write(tiff);
+  exif.Write(tiff);
+  gps.Write(tiff);
+
+  std::vector<unsigned char> payload = {'E', 'x', 'i', 'f', 0, 0};
+  payload.insert(payload.end(), tiff.begin(), tiff.end());
+  return payload;
+}
+
+std::vector<unsigned char> XmpPayload(const ExifGeotag &_tag)
+{
+  char packet[1024];
+  snprintf(packet, sizeof(packet),
+           "<?xpacket begin=\"\xEF\xBB\xBF\" id=\"W5M0MpCehiHzreSzNTczkc9d\"?>"
+           "<x:xmpmeta xmlns:x=\"adobe:ns:meta/\">"
+           "<rdf:RDF xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\">"
+           "<rdf:Description rdf:about=\"\" xmlns:Camera=\"http://pix4d.com/camera/1.0/\""
+           " Camera:Yaw=\"%.2f\" Camera:Pitch=\"%.2f\" Camera:Roll=\"%.2f\"/>"
+           "</rdf:RDF></x:xmpmeta><?xpacket end=\"w\"?>",
+           _tag.yaw, _tag.pitch + 90.0, _tag.roll);
+
+  static const char kXmpNamespace[] = "http://ns.adobe.com/xap/1.0/";
+  std::vector<unsigned char> payload(kXmpNamespace, kXmpNamespace + sizeof(kXmpNamespace));
+  payload.insert(payload.end(), packet, packet + strlen(packet));
+  return payload;
+}
+
+bool AppendApp1(std::vector<unsigned char> &_segments, const std::vector<unsigned char> &_payload)
+{
+  const size_t length = _payload.size() + 2;
+  if (length > 0xffff) {
+    return false;
+  }
+  _segments.push_back(0xff);
+  _segments.push_back(0xe1);
+  _segments.push_back(length >> 8);
+  _segments.push_back(length & 0xff);
+  _segments.insert(_segments.end(), _payload.begin(), _payload.end());
+  return true;
+}
+
+}  // namespace
+
+bool InsertExifGeotag(std::vector<unsigned char> &_jpeg, const ExifGeotag &_tag)
+{
+  if (_jpeg.size() < 4 || _jpeg[0] != 0xff || _jpeg[1] != 0xd8) {
+    return false;
+  }
+
+  // JFIF wants its APP0 first
+  size_t position = 2;
+  while (position + 4 <= _jpeg.size() && _jpeg[position] == 0xff && _jpeg[position + 1] == 0xe0) {
+    position += 2 + ((_jpeg[position + 2] << 8) | _jpeg[position + 3]);
+  }
+  if (position > _jpeg.size()) {
+    return false;
+  }
+
+  std::vector<unsigned char> segments;
+  if (!AppendApp1(segments, ExifPayload(_tag))) {
+    return false;
+  }
+  if (_tag.has_attitude && !AppendApp1(segments, XmpPayload(_tag))) {
+    return false;
+  }
+  _jpeg.insert(_jpeg.begin() + position, segments.begin(), segments.end());
+  return true;
+}
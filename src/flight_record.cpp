@@ -0,0 +1,189 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flight_record.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(FlightRecordHeader) <= kFlightRecordHeaderSize, "header too large");
+static_assert(sizeof(MotorRecord) == 8 + 8 + 2 * 8 * MotorRecord::kMaxMotors, "padding in MotorRecord");
+static_assert(sizeof(MavlinkRecord) == 8 + 8 + MavlinkRecord::kMaxPacketLen, "padding in MavlinkRecord");
+
+std::unique_ptr<FlightRecordFile> FlightRecordFile::Create(const std::string &_path,
+                                                           const std::string &_stream,
+                                                           uint32_t _record_type,
+                                                           uint32_t _record_size,
+                                                           const char *_format,
+                                                           uint64_t _capacity)
+{
+  if (_capacity == 0 || _record_size == 0) {
+    return nullptr;
+  }
+
+  const int fd = open(_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    printf("flight record: can't create %s: %s\n", _path.c_str(), strerror(errno));
+    return nullptr;
+  }
+
+  const size_t map_size = kFlightRecordHeaderSize + _capacity * _record_size;
+  // reserve the blocks now, a full disk would otherwise fault the writer later
+#ifdef __linux__
+  const int err = posix_fallocate(fd, 0, map_size);
+#else
+  const int err = ftruncate(fd, map_size) == 0 ? 0 : errno;
+#endif
+  if (err != 0) {
+    printf("flight record: can't allocate %zu bytes for %s: %s\n", map_size, _path.c_str(), strerror(err));
+    close(fd);
+    unlink(_path.c_str());
+    return nullptr;
+  }
+
+  int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE;  // no page faults in the simulation thread
+#endif
+  void *map = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+  if (map == MAP_FAILED) {
+    printf("flight record: can't map %s: %s\n", _path.c_str(), strerror(errno));
+    close(fd);
+    unlink(_path.c_str());
+    return nullptr;
+  }
+
+  std::unique_ptr<FlightRecordFile> file(new FlightRecordFile(fd, map, map_size));
+
+  FlightRecordHeader *header = file->header_;
+  std::memset(header, 0, kFlightRecordHeaderSize);
+  std::memcpy(header->magic, kFlightRecordMagic, sizeof(header->magic));
+  header->version = kFlightRecordVersion;
+  header->header_size = kFlightRecordHeaderSize;
+  header->record_type = _record_type;
+  header->record_size = _record_size;
+  header->capacity = _capacity;
+  header->written = 0;
+  std::strncpy(header->stream, _stream.c_str(), sizeof(header->stream) - 1);
+  std::strncpy(header->format, _format, sizeof(header->format) - 1);
+
+  file->capacity_ = _capacity;
+  file->record_size_ = _record_size;
+  return file;
+}
+
+FlightRecordFile::FlightRecordFile(int _fd, void *_map, size_t _map_size)
+    : fd_(_fd),
+      map_(_map),
+      map_size_(_map_size),
+      header_(static_cast<FlightRecordHeader *>(_map)),
+      records_(static_cast<char *>(_map) + kFlightRecordHeaderSize),
+      capacity_(1),
+      record_size_(0)
+{
+}
+
+FlightRecordFile::~FlightRecordFile()
+{
+  // schedule the write back, munmap doesn't wait for it either
+  msync(map_, map_size_, MS_ASYNC);
+  munmap(map_, map_size_);
+  close(fd_);
+}
+
+FlightRecordReader::FlightRecordReader()
+    : map_(nullptr),
+      map_size_(0),
+      header_(nullptr),
+      records_(nullptr),
+      first_(0),
+      size_(0)
+{
+}
+
+FlightRecordReader::~FlightRecordReader()
+{
+  Close();
+}
+
+bool FlightRecordReader::Open(const std::string &_path)
+{
+  Close();
+
+  const int fd = open(_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    printf("flight record: can't open %s: %s\n", _path.c_str(), strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(kFlightRecordHeaderSize)) {
+    printf("flight record: %s is not a record file\n", _path.c_str());
+    close(fd);
+    return false;
+  }
+
+  void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    printf("flight record: can't map %s: %s\n", _path.c_str(), strerror(errno));
+    return false;
+  }
+
+  const FlightRecordHeader *header = static_cast<const FlightRecordHeader *>(map);
+  if (std::memcmp(header->magic, kFlightRecordMagic, sizeof(header->magic)) != 0 ||
+      header->version != kFlightRecordVersion ||
+      header->capacity == 0 ||
+      header->header_size + header->capacity * header->record_size > static_cast<uint64_t>(st.st_size)) {
+    printf("flight record: %s is not a record file of version %u\n", _path.c_str(), kFlightRecordVersion);
+    munmap(map, st.st_size);
+    return false;
+  }
+
+  map_ = map;
+  map_size_ = st.st_size;
+  header_ = header;
+  records_ = static_cast<const char *>(map) + header->header_size;
+  Refresh();
+  return true;
+}
+
+void FlightRecordReader::Close()
+{
+  if (map_) {
+    munmap(map_, map_size_);
+  }
+  map_ = nullptr;
+  map_size_ = 0;
+  header_ = nullptr;
+  records_ = nullptr;
+  first_ = 0;
+  size_ = 0;
+}
+
+void FlightRecordReader::Refresh()
+{
+  if (!header_) {
+    return;
+  }
+  const uint64_t written = __atomic_load_n(&header_->written, __ATOMIC_ACQUIRE);
+  size_ = written < header_->capacity ? written : header_->capacity;
+  first_ = written - size_;
+}
@@ -0,0 +1,192 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gazebo_flight_recorder_plugin.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <limits>
+
+#include <boost/filesystem.hpp>
+
+namespace gazebo {
+
+GZ_REGISTER_MODEL_PLUGIN(GazeboFlightRecorderPlugin);
+
+GazeboFlightRecorderPlugin::GazeboFlightRecorderPlugin()
+    : ModelPlugin(),
+      output_dir_(kDefaultRecordDir),
+      link_name_(kDefaultRecordLinkName),
+      command_sub_topic_(kDefaultRecordCommandTopic),
+      duration_(kDefaultRecordDuration),
+      rotor_velocity_slowdown_sim_(kDefaultRecordRotorVelocitySlowdownSim),
+      capacity_(0)
+{
+}
+
+GazeboFlightRecorderPlugin::~GazeboFlightRecorderPlugin()
+{
+  event::Events::DisconnectWorldUpdateBegin(update_connection_);
+  // the sensor plugins may outlive us
+  if (imu_stream_) {
+    imu_stream_->Attach(nullptr);
+  }
+  if (gps_stream_) {
+    gps_stream_->Attach(nullptr);
+  }
+}
+
+template <typename R>
+std::unique_ptr<FlightRecordFile> GazeboFlightRecorderPlugin::CreateFile(const std::string &_stream)
+{
+  const std::string path = output_dir_ + "/" + model_->GetName() + "." + _stream + ".rec";
+  std::unique_ptr<FlightRecordFile> file = FlightRecordFile::Create<R>(
+      path, FlightRecordStreamName(model_->GetName(), _stream), capacity_);
+  if (!file) {
+    gzerr << "[flight_recorder] Could not create " << path << ".\n";
+  }
+  return file;
+}
+
+void GazeboFlightRecorderPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf)
+{
+  model_ = _model;
+
+  if (_sdf->HasElement("robotNamespace"))
+    namespace_ = _sdf->GetElement("robotNamespace")->Get<std::string>();
+  else
+    gzerr << "[flight_recorder] Please specify a robotNamespace.\n";
+  node_handle_ = transport::NodePtr(new transport::Node());
+  node_handle_->Init(namespace_);
+
+  getSdfParam<std::string>(_sdf, "output_dir", output_dir_, output_dir_);
+  getSdfParam<double>(_sdf, "duration", duration_, duration_);
+  getSdfParam<std::string>(_sdf, "linkName", link_name_, link_name_);
+  getSdfParam<std::string>(_sdf, "commandSubTopic", command_sub_topic_, command_sub_topic_);
+  getSdfParam<double>(_sdf, "rotorVelocitySlowdownSim", rotor_velocity_slowdown_sim_,
+                      rotor_velocity_slowdown_sim_);
+
+  link_ = model_->GetLink(link_name_);
+  if (link_ == NULL)
+    gzthrow("[flight_recorder] Couldn't find specified link \"" << link_name_ << "\".");
+
+  // rotor_<n>_joint, as in the multirotor base plugin
+  for (const physics::JointPtr &joint : model_->GetJoints()) {
+    const std::string name = joint->GetName();
+    const size_t pos = name.find("rotor_");
+    if (pos != std::string::npos && name.size() > pos + 6 && std::isdigit(name[pos + 6])) {
+      motors_.push_back(std::make_pair(std::stoi(name.substr(pos + 6)), joint));
+    }
+  }
+  std::sort(motors_.begin(), motors_.end(),
+            [](const std::pair<int, physics::JointPtr> &_a, const std::pair<int, physics::JointPtr> &_b) {
+              return _a.first < _b.first;
+            });
+  if (motors_.size() > static_cast<size_t>(MotorRecord::kMaxMotors)) {
+    gzwarn << "[flight_recorder] Recording the first " << MotorRecord::kMaxMotors << " of "
+           << motors_.size() << " rotors.\n";
+    motors_.resize(MotorRecord::kMaxMotors);
+  }
+  actuator_commands_ = SensorBus::Instance().GetShared<ActuatorCommands>(
+      node_handle_->DecodeTopicName("~/" + model_->GetName() + command_sub_topic_));
+
+  // every stream gets a record per step at most
+  const double step_size = model_->GetWorld()->GetPhysicsEngine()->GetMaxStepSize();
+  capacity_ = static_cast<uint64_t>(std::ceil(duration_ / step_size));
+
+  boost::system::error_code error;
+  boost::filesystem::create_directories(output_dir_, error);
+  if (error) {
+    gzerr << "[flight_recorder] Could not create " << output_dir_ << ": " << error.message() << "\n";
+    return;
+  }
+
+  truth_file_ = CreateFile<TruthRecord>("truth");
+  if (!motors_.empty()) {
+    motor_file_ = CreateFile<MotorRecord>("motors");
+  }
+  imu_file_ = CreateFile<ImuRecord>("imu");
+  gps_file_ = CreateFile<GpsRecord>("gps");
+
+  imu_stream_ = SensorBus::Instance().GetShared<FlightRecordStream>(
+      FlightRecordStreamName(model_->GetName(), "imu"));
+  imu_stream_->Attach(imu_file_.get());
+  gps_stream_ = SensorBus::Instance().GetShared<FlightRecordStream>(
+      FlightRecordStreamName(model_->GetName(), "gps"));
+  gps_stream_->Attach(gps_file_.get());
+
+  gzmsg << "[flight_recorder] Recording " << model_->GetName() << " to " << output_dir_
+        << ", last " << duration_ << " s.\n";
+
+  update_connection_ = event::Events::ConnectWorldUpdateBegin(
+      boost::bind(&GazeboFlightRecorderPlugin::OnUpdate, this, _1));
+  update_probe_ = StepProfiler::Instance().Register(model_->GetName() + "/" + GetHandle() + "/OnUpdate");
+}
+
+void GazeboFlightRecorderPlugin::OnUpdate(const common::UpdateInfo &_info)
+{
+  ScopedProbe probe(update_probe_.get());
+
+  const double sim_time = _info.simTime.Double();
+
+  if (truth_file_) {
+    const math::Pose pose = link_->GetWorldPose();
+    const math::Vector3 linear_velocity = link_->GetWorldLinearVel();
+    const math::Vector3 angular_velocity = link_->GetRelativeAngularVel();
+    const math::Vector3 linear_acceleration = link_->GetWorldLinearAccel();
+
+    TruthRecord truth;
+    truth.sim_time = sim_time;
+    truth.position[0] = pose.pos.x;
+    truth.position[1] = pose.pos.y;
+    truth.position[2] = pose.pos.z;
+    truth.orientation[0] = pose.rot.w;
+    truth.orientation[1] = pose.rot.x;
+    truth.orientation[2] = pose.rot.y;
+    truth.orientation[3] = pose.rot.z;
+    truth.linear_velocity[0] = linear_velocity.x;
+    truth.linear_velocity[1] = linear_velocity.y;
+    truth.linear_velocity[2] = linear_velocity.z;
+    truth.angular_velocity[0] = angular_velocity.x;
+    truth.angular_velocity[1] = angular_velocity.y;
+    truth.angular_velocity[2] = angular_velocity.z;
+    truth.linear_acceleration[0] = linear_acceleration.x;
+    truth.linear_acceleration[1] = linear_acceleration.y;
+    truth.linear_acceleration[2] = linear_acceleration.z;
+    truth_file_->Append(&truth);
+  }
+
+  if (motor_file_) {
+    MotorRecord motors;
+    motors.sim_time = sim_time;
+    motors.count = motors_.size();
+    motors.reserved = 0;
+    std::fill(motors.velocity, motors.velocity + MotorRecord::kMaxMotors, 0.0);
+    std::fill(motors.command, motors.command + MotorRecord::kMaxMotors,
+              std::numeric_limits<double>::quiet_NaN());
+    for (size_t i = 0; i < motors_.size(); ++i) {
+      motors.velocity[i] = motors_[i].second->GetVelocity(0) * rotor_velocity_slowdown_sim_;
+      double command;
+      if (actuator_commands_->Read(sim_time, motors_[i].first, &command)) {
+        motors.command[i] = command;
+      }
+    }
+    motor_file_->Append(&motors);
+  }
+}
+
+}
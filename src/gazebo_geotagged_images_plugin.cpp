@@ -20,6 +20,9 @@
 #include <math.h>
 #include <string>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <boost/filesystem.hpp>
 
 #include <cv.h>
@@ -27,12 +30,56 @@
 
 #include <opencv2/opencv.hpp>
 
+#include "exif_geotag.h"
+
 using namespace std;
 using namespace gazebo;
 using namespace cv;
 
 GZ_REGISTER_SENSOR_PLUGIN(GeotaggedImagesPlugin)
 
+/// \brief Heading clockwise from north of a horizontal ENU direction [deg].
+static double Heading(const ignition::math::Vector3d &_direction)
+{
+  return fmod(GZ_RTOD(atan2(_direction.X(), _direction.Y())) + 360.0, 360.0);
+}
+
+/// \brief Yaw, pitch and roll of a camera looking along x with the image top
+/// along z, rotated by _rot in gazebo's ENU world.
+///
+/// Euler angles lose the yaw at nadir, where mapping cameras look. The yaw is
+/// taken from the horizontal projections of the optical axis and of the
+/// image top, the latter weighted by the cube of the axis' vertical
+/// component. At nadir the yaw is where the image top points, away from it
+/// where the camera looks, and it doesn't jump in between. The roll is measured against the image top the yaw and
+/// pitch alone would give.
+static void CameraAttitude(const ignition::math::Quaterniond &_rot,
+                           double &_yaw, double &_pitch, double &_roll)
+{
+  const ignition::math::Vector3d axis = _rot.RotateVector(ignition::math::Vector3d(1.0, 0.0, 0.0));
+  const ignition::math::Vector3d top = _rot.RotateVector(ignition::math::Vector3d(0.0, 0.0, 1.0));
+  const ignition::math::Vector3d axis_horizontal(axis.X(), axis.Y(), 0.0);
+  const ignition::math::Vector3d top_horizontal(top.X(), top.Y(), 0.0);
+
+  const double elevation = asin(std::max(-1.0, std::min(1.0, axis.Z())));
+  // the image top points along the axis looking down, against it looking up
+  ignition::math::Vector3d heading =
+      axis_horizontal + top_horizontal * (-axis.Z() * axis.Z() * axis.Z());
+  if (heading.Length() < 1e-9) {
+    // upside down at the one pitch where both cancel
+    heading = axis_horizontal;
+  }
+  heading.Normalize();
+
+  const ignition::math::Vector3d level_top =
+      heading * -sin(elevation) + ignition::math::Vector3d(0.0, 0.0, cos(elevation));
+
+  _yaw = Heading(heading);
+  _pitch = GZ_RTOD(elevation);
+  // positive with the right side down, a right handed turn about the axis
+  _roll = GZ_RTOD(atan2(level_top.Cross(top).Dot(axis), level_top.Dot(top)));
+}
+
 
 GeotaggedImagesPlugin::GeotaggedImagesPlugin()
 : SensorPlugin(), width_(0), height_(0), depth_(0), imageCounter_(0)
@@ -41,6 +88,25 @@ GeotaggedImagesPlugin::GeotaggedImagesPlugin()
 
 GeotaggedImagesPlugin::~GeotaggedImagesPlugin()
 {
+  pollTimer_.reset();
+
+  // the captured images are still written
+  {
+    std::lock_guard<std::mutex> lock(jobMutex_);
+    stopWriters_ = true;
+  }
+  jobReady_.notify_all();
+  for (std::thread &writer : writers_) {
+    writer.join();
+  }
+  if (droppedImages_ > 0) {
+    gzmsg << "[gazebo_geotagging_images_camera_plugin] images dropped, writers busy: " << droppedImages_ << "\n";
+  }
+
+  if (mavlink_channel_) {
+    MavlinkMultiplexer::Instance().Unregister(mavlink_channel_);
+  }
+
   this->parentSensor_.reset();
   this->camera_.reset();
 }
@@ -113,13 +179,6 @@ void GeotaggedImagesPlugin::Load(sensors::SensorPtr sensor, sdf::ElementPtr sdf)
   }
 
 
-  //check if exiftool exists
-  if (system("exiftool -ver &>/dev/null") != 0) {
-    gzerr << "exiftool not found. geotagging_images plugin will be disabled" << endl;
-    gzerr << "On Ubuntu, use 'sudo apt-get install libimage-exiftool-perl' to install" << endl;
-    return;
-  }
-
   node_handle_ = transport::NodePtr(new transport::Node());
   node_handle_->Init(namespace_);
 
@@ -134,10 +193,17 @@ void GeotaggedImagesPlugin::Load(sensors::SensorPtr sensor, sdf::ElementPtr sdf)
   boost::filesystem::remove_all(storageDir_); //clear existing images
   boost::filesystem::create_directory(storageDir_);
 
-  // Listen to the update event. This event is broadcast every
-  // simulation iteration.
-  updateConnection_ = event::Events::ConnectWorldUpdateBegin(
-      boost::bind(&GeotaggedImagesPlugin::OnUpdate, this, _1));
+  int writerThreads = kGeotagDefaultWriterThreads;
+  int maxPendingImages = kGeotagDefaultMaxPendingImages;
+  getSdfParam<int>(sdf, "writer_threads", writerThreads, writerThreads);
+  getSdfParam<int>(sdf, "max_pending_images", maxPendingImages, maxPendingImages);
+  freeBuffers_.resize(std::max(maxPendingImages, 1));
+  for (std::vector<unsigned char> &buffer : freeBuffers_) {
+    buffer.resize(width_ * height_ * 3);
+  }
+  for (int i = 0; i < std::max(writerThreads, 1); ++i) {
+    writers_.push_back(std::thread(&GeotaggedImagesPlugin::WriterThread, this));
+  }
 
   //Create socket
   // udp socket data
@@ -155,50 +221,36 @@ void GeotaggedImagesPlugin::Load(sensors::SensorPtr sensor, sdf::ElementPtr sdf)
   if (sdf->HasElement("mavlink_telem_udp_port")) {
     mavlink_udp_port_ = sdf->GetElement("mavlink_telem_udp_port")->Get<int>();
   }
-
-  // try to setup udp socket for communcation with simulator
-  if ((_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-    printf("create socket failed\n");
-    return;
+  if (sdf->HasElement("mavlink_cam_udp_port")) {
+    mavlink_cam_udp_port_ = sdf->GetElement("mavlink_cam_udp_port")->Get<int>();
   }
 
-  memset((char *)&_myaddr, 0, sizeof(_myaddr));
-  _myaddr.sin_family = AF_INET;
-  _myaddr.sin_addr.s_addr = htonl(INADDR_ANY);
-  // Choose the default cam port
-  _myaddr.sin_port = htons(14530);
-
-  if (::bind(_fd, (struct sockaddr *)&_myaddr, sizeof(_myaddr)) < 0) {
-    printf("bind failed\n");
+  // The camera has to be reachable on a fixed port, it gets its own socket
+  // in the shared MAVLink transport.
+  mavlink_channel_ = MavlinkMultiplexer::Instance().RegisterBound(mavlink_cam_udp_port_);
+  if (!mavlink_channel_) {
+    gzerr << "[gazebo_geotagging_images_camera_plugin] could not bind port "
+          << mavlink_cam_udp_port_ << "\n";
     return;
   }
 
   _srcaddr.sin_family = AF_INET;
   _srcaddr.sin_addr.s_addr = mavlink_addr_;
   _srcaddr.sin_port = htons(mavlink_udp_port_);
-  _addrlen = sizeof(_srcaddr);
-
-  fds[0].fd = _fd;
-  fds[0].events = POLLIN;
 
   mavlink_status_t* chan_state = mavlink_get_channel_status(MAVLINK_COMM_1);
   chan_state->flags &= ~(MAVLINK_STATUS_FLAG_OUT_MAVLINK1);
-}
 
-// This gets called by the world update start event.
-void GeotaggedImagesPlugin::OnUpdate(const common::UpdateInfo& /*_info*/) {
-#if GAZEBO_MAJOR_VERSION >= 8
-  common::Time current_time = scene_->SimTime();
-#else
-  common::Time current_time = scene_->GetSimTime();
-#endif
-  double dt = (current_time - last_time_).Double();
+  pollTimer_ = SimScheduler::Instance().SchedulePeriodic(
+      kGeotagCommandPollInterval, boost::bind(&GeotaggedImagesPlugin::OnCommandPoll, this, _1));
+}
 
-  pollForMAVLinkMessages(dt, 1000);
+// Called every kGeotagCommandPollInterval of sim time.
+void GeotaggedImagesPlugin::OnCommandPoll(double /*_due*/) {
+  pollForMAVLinkMessages(kGeotagCommandPollInterval, 1000);
+  SendCaptureResults();
 
   // TODO: This is the camera main loop
-
-  last_time_ = current_time;
 }
 
 void GeotaggedImagesPlugin::OnNewGpsPosition(ConstVector3dPtr& v)
@@ -231,71 +283,150 @@ void GeotaggedImagesPlugin::OnNewFrame(const unsigned char * image)
   }
 
   lastImageTime_ = currentTime;
+  capture_ = false;
 
-  Mat frame = Mat(height_, width_, CV_8UC3);
-  Mat frameBGR = Mat(height_, width_, CV_8UC3);
-  frame.data = (uchar*)image; //frame has not the right color format yet -> convert
-  cvtColor(frame, frameBGR, CV_RGB2BGR);
+  ImageJob job;
+  job.sequence = imageCounter_++;
+  job.simTime = currentTime.Double();
+  job.latitude = lastGpsPosition_.x();
+  job.longitude = lastGpsPosition_.y();
+  job.altitude = lastGpsPosition_.z();
+  job.utcTime = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+#if GAZEBO_MAJOR_VERSION >= 7
+  CameraAttitude(this->camera_->WorldPose().Rot(), job.yaw, job.pitch, job.roll);
+#else
+  CameraAttitude(this->camera_->GetWorldPose().rot.Ign(), job.yaw, job.pitch, job.roll);
+#endif
 
   char file_name[256];
-  snprintf(file_name, sizeof(file_name), "%s/DSC%05i.jpg", storageDir_.c_str(), imageCounter_);
+  snprintf(file_name, sizeof(file_name), "%s/DSC%05i.jpg", storageDir_.c_str(), job.sequence);
+  job.fileName = file_name;
+  job.success = false;
+
+  std::unique_lock<std::mutex> lock(jobMutex_);
+  if (freeBuffers_.empty()) {
+    // reported as failed capture
+    ++droppedImages_;
+    finishedJobs_.push_back(std::move(job));
+    return;
+  }
+  job.rgb.swap(freeBuffers_.back());
+  freeBuffers_.pop_back();
+  lock.unlock();
+
+  // the only work on the rendering thread
+  memcpy(job.rgb.data(), image, job.rgb.size());
+
+  lock.lock();
+  pendingJobs_.push_back(std::move(job));
+  lock.unlock();
+  jobReady_.notify_one();
+}
+
+void GeotaggedImagesPlugin::WriterThread()
+{
+  std::unique_lock<std::mutex> lock(jobMutex_);
+  for (;;) {
+    jobReady_.wait(lock, [this]() { return stopWriters_ || !pendingJobs_.empty(); });
+    if (pendingJobs_.empty()) {
+      return;
+    }
+    ImageJob job = std::move(pendingJobs_.front());
+    pendingJobs_.pop_front();
+    lock.unlock();
 
+    job.success = WriteImage(job);
+
+    lock.lock();
+    freeBuffers_.push_back(std::vector<unsigned char>());
+    freeBuffers_.back().swap(job.rgb);
+    finishedJobs_.push_back(std::move(job));
+  }
+}
+
+bool GeotaggedImagesPlugin::WriteImage(ImageJob &job)
+{
+  Mat frame = Mat(height_, width_, CV_8UC3, job.rgb.data());
+  Mat frameBGR;
+  cvtColor(frame, frameBGR, CV_RGB2BGR);
+
+  std::vector<unsigned char> jpeg;
   if (destWidth_ != width_ || destHeight_ != height_) {
     Mat frameResized;
     cv::Size size(destWidth_, destHeight_);
     cv::resize(frameBGR, frameResized, size);
-    imwrite(file_name, frameResized);
+    imencode(".jpg", frameResized, jpeg);
   } else {
-    imwrite(file_name, frameBGR);
+    imencode(".jpg", frameBGR, jpeg);
+  }
+
+  ExifGeotag tag;
+  tag.latitude = job.latitude;
+  tag.longitude = job.longitude;
+  tag.altitude = job.altitude;
+  tag.utc_time = job.utcTime;
+  tag.dop = kGeotagDop;
+  tag.satellites = kGeotagSatellites;
+  tag.has_attitude = true;
+  tag.yaw = job.yaw;
+  tag.pitch = job.pitch;
+  tag.roll = job.roll;
+  if (!InsertExifGeotag(jpeg, tag)) {
+    gzerr << "Could not geotag " << job.fileName << endl;
+    return false;
   }
 
-  char gps_tag_command[1024];
-  double lat = lastGpsPosition_.x();
-  char north_south = 'N', east_west = 'E';
-  double lon = lastGpsPosition_.y();
-  if (lat < 0.) {
-    lat = -lat;
-    north_south = 'S';
+  FILE *file = fopen(job.fileName.c_str(), "wb");
+  if (!file) {
+    gzerr << "Could not write " << job.fileName << endl;
+    return false;
   }
-  if (lon < 0.) {
-    lon = -lon;
-    east_west = 'W';
+  const bool written = fwrite(jpeg.data(), 1, jpeg.size(), file) == jpeg.size();
+  if (fclose(file) != 0 || !written) {
+    gzerr << "Could not write " << job.fileName << endl;
+    return false;
   }
-  snprintf(gps_tag_command, sizeof(gps_tag_command),
-    "exiftool -gpslatituderef=%c -gpslongituderef=%c -gpsaltituderef=above -gpslatitude=%.9lf -gpslongitude=%.9lf"
-//    " -gpsdatetime=now -gpsmapdatum=WGS-84"
-    " -datetimeoriginal=now -gpsdop=0.8"
-    " -gpsmeasuremode=3-d -gpssatellites=13 -gpsaltitude=%.3lf -overwrite_original %s &>/dev/null",
-    north_south, east_west, lat, lon, lastGpsPosition_.z(), file_name);
+  return true;
+}
 
-  system(gps_tag_command);
+void GeotaggedImagesPlugin::SendCaptureResults()
+{
+  std::deque<ImageJob> finished;
+  {
+    std::lock_guard<std::mutex> lock(jobMutex_);
+    finished.swap(finishedJobs_);
+  }
 
-  gzerr << "Took picture:" << file_name << endl;
+  for (const ImageJob &job : finished) {
+    if (job.success) {
+      gzmsg << "Took picture:" << job.fileName << endl;
+    } else {
+      gzerr << "Failed to take picture " << job.sequence << endl;
+    }
 
-  // Send indication to GCS
-  mavlink_message_t msg;
-  mavlink_msg_camera_image_captured_pack_chan(1,
-                                   MAV_COMP_ID_CAMERA,
-                                   MAVLINK_COMM_1,
-                                   &msg,
-                                   currentTime.Double() * 1e3, // time boot ms
-                                   currentTime.Double() * 1e6, // time UTC
-                                   1, // camera ID
-                                   lat * 1e7,
-                                   lon * 1e7,
-                                   lastGpsPosition_.z(),
-                                   0, // relative alt
-                                   0, // q[4]
-                                   imageCounter_,
-                                   1, // result
-                                   0 // file_url
-                                   );
-
-  // Send to GCS port directly
-  send_mavlink_message(&msg, 14550);
-
-  ++imageCounter_;
-  capture_ = false;
+    // Send indication to GCS
+    mavlink_message_t msg;
+    mavlink_msg_camera_image_captured_pack_chan(1,
+                                     MAV_COMP_ID_CAMERA,
+                                     MAVLINK_COMM_1,
+                                     &msg,
+                                     job.simTime * 1e3, // time boot ms
+                                     job.simTime * 1e6, // time UTC
+                                     1, // camera ID
+                                     job.latitude * 1e7,
+                                     job.longitude * 1e7,
+                                     job.altitude,
+                                     0, // relative alt
+                                     0, // q[4]
+                                     job.sequence,
+                                     job.success ? 1 : 0, // result
+                                     0 // file_url
+                                     );
+
+    // Send to GCS port directly
+    send_mavlink_message(&msg, 14550);
+  }
 }
 
 void GeotaggedImagesPlugin::TakePicture()
@@ -305,25 +436,16 @@ void GeotaggedImagesPlugin::TakePicture()
 
 void GeotaggedImagesPlugin::pollForMAVLinkMessages(double _dt, uint32_t _timeoutMs)
 {
-  // poll with immediate return
-  ::poll(&fds[0], (sizeof(fds[0])/sizeof(fds[0])), 0);
-
-  if (fds[0].revents & POLLIN) {
-    int len;
+  if (!mavlink_channel_) {
+    return;
+  }
 
-    len = recvfrom(_fd, _buf, sizeof(_buf), 0, (struct sockaddr *)&_srcaddr, &_addrlen);
-    if (len > 0) {
-      mavlink_message_t msg;
-      mavlink_status_t status;
-      for (unsigned i = 0; i < len; ++i)
-      {
-        if (mavlink_parse_char(MAVLINK_COMM_1, _buf[i], &msg, &status))
-        {
-          // have a message, handle it
-          handle_message(&msg);
-        }
-      }
-    }
+  // already decoded by the transport thread, returns immediately
+  mavlink_message_t msg;
+  while (mavlink_channel_->Receive(&msg)) {
+    // answer whoever sent the command, not only mavlink_telem_udp_port
+    mavlink_channel_->RemoteAddress(&_srcaddr);
+    handle_message(&msg);
   }
 }
 
@@ -359,17 +481,19 @@ void GeotaggedImagesPlugin::handle_message(mavlink_message_t *msg)
 
 void GeotaggedImagesPlugin::send_mavlink_message(const mavlink_message_t *message, const int destination_port)
 {
+  if (!mavlink_channel_) {
+    return;
+  }
 
-  uint8_t buffer[MAVLINK_MAX_PACKET_LEN];
-  int packetlen = mavlink_msg_to_send_buffer(buffer, message);
+  MavlinkTxPacket packet;
+  packet.len = mavlink_msg_to_send_buffer(packet.data, message);
+  memcpy(&packet.dest_addr, &_srcaddr, sizeof(_srcaddr));
 
   if (destination_port != 0) {
-    _srcaddr.sin_port = htons(destination_port);
+    packet.dest_addr.sin_port = htons(destination_port);
   }
 
-  ssize_t len = sendto(_fd, buffer, packetlen, 0, (struct sockaddr *)&_srcaddr, sizeof(_srcaddr));
-
-  if (len <= 0) {
+  if (!mavlink_channel_->Send(packet)) {
     printf("Failed sending mavlink message\n");
   }
 }
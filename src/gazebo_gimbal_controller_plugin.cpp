@@ -35,6 +35,7 @@ GimbalControllerPlugin::GimbalControllerPlugin()
   this->pitchCommand = 0.5* M_PI;
   this->rollCommand = 0;
   this->yawCommand = 0;
+  this->statusInterval = 0;
 }
 
 /////////////////////////////////////////////////
@@ -155,9 +156,15 @@ void GimbalControllerPlugin::Init()
   this->yawSub = this->node->Subscribe(yawTopic,
      &GimbalControllerPlugin::OnYawStringMsg, this);
 
-  // plugin update
+  // plugin update, the joint forces have to be set every step
   this->connections.push_back(event::Events::ConnectWorldUpdateBegin(
           boost::bind(&GimbalControllerPlugin::OnUpdate, this)));
+  // status every 100 physics steps, as before the sim time timer
+  this->statusInterval =
+    100 * this->model->GetWorld()->GetPhysicsEngine()->GetMaxStepSize();
+  this->statusTimer = SimScheduler::Instance().SchedulePeriodic(
+      this->statusInterval,
+      boost::bind(&GimbalControllerPlugin::OnStatusTimer, this, _1));
 
   // publish pitch status via gz transport
   pitchTopic = std::string("~/") +  this->model->GetName()
@@ -403,40 +410,42 @@ void GimbalControllerPlugin::OnUpdate()
 
     this->lastUpdateTime = time;
   }
+}
+
+/////////////////////////////////////////////////
+void GimbalControllerPlugin::OnStatusTimer(double /*_due*/)
+{
+  if (!this->pitchJoint || !this->rollJoint || !this->yawJoint)
+    return;
 
-  static int i =1000;
-  if (++i>100)
-  {
-    i = 0;
 #if GAZEBO_MAJOR_VERSION >= 7 && GAZEBO_MINOR_VERSION >= 4
-    gazebo::msgs::Any m;
-    m.set_type(gazebo::msgs::Any_ValueType_DOUBLE);
+  gazebo::msgs::Any m;
+  m.set_type(gazebo::msgs::Any_ValueType_DOUBLE);
 
-    m.set_double_value(this->pitchJoint->GetAngle(0).Radian());
-    this->pitchPub->Publish(m);
+  m.set_double_value(this->pitchJoint->GetAngle(0).Radian());
+  this->pitchPub->Publish(m);
 
-    m.set_double_value(this->rollJoint->GetAngle(0).Radian());
-    this->rollPub->Publish(m);
+  m.set_double_value(this->rollJoint->GetAngle(0).Radian());
+  this->rollPub->Publish(m);
 
-    m.set_double_value(this->yawJoint->GetAngle(0).Radian());
-    this->yawPub->Publish(m);
+  m.set_double_value(this->yawJoint->GetAngle(0).Radian());
+  this->yawPub->Publish(m);
 #else
-    std::stringstream ss;
-    gazebo::msgs::GzString m;
+  std::stringstream ss;
+  gazebo::msgs::GzString m;
 
-    ss << this->pitchJoint->GetAngle(0).Radian();
-    m.set_data(ss.str());
-    this->pitchPub->Publish(m);
+  ss << this->pitchJoint->GetAngle(0).Radian();
+  m.set_data(ss.str());
+  this->pitchPub->Publish(m);
 
-    ss << this->rollJoint->GetAngle(0).Radian();
-    m.set_data(ss.str());
-    this->rollPub->Publish(m);
+  ss << this->rollJoint->GetAngle(0).Radian();
+  m.set_data(ss.str());
+  this->rollPub->Publish(m);
 
-    ss << this->yawJoint->GetAngle(0).Radian();
-    m.set_data(ss.str());
-    this->yawPub->Publish(m);
+  ss << this->yawJoint->GetAngle(0).Radian();
+  m.set_data(ss.str());
+  this->yawPub->Publish(m);
 #endif
-  }
 }
 
 /////////////////////////////////////////////////
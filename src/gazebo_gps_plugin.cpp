@@ -0,0 +1,223 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gazebo_gps_plugin.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gazebo {
+
+GZ_REGISTER_MODEL_PLUGIN(GazeboGpsPlugin);
+
+GazeboGpsPlugin::GazeboGpsPlugin()
+    : ModelPlugin(),
+      gps_topic_(kDefaultGpsTopic),
+      update_interval_(1.0 / kDefaultGpsUpdateRate),
+      delay_(kDefaultGpsDelay),
+      noise_density_(kDefaultGpsNoiseDensity),
+      random_walk_(kDefaultGpsRandomWalk),
+      correlation_time_(kDefaultGpsCorrelationTime),
+      alt_home_(0.0),
+      bias_{},
+      last_fix_time_(0.0),
+      pending_head_(0),
+      pending_count_(0)
+{
+}
+
+GazeboGpsPlugin::~GazeboGpsPlugin()
+{
+  fix_timer_.reset();
+  publish_timer_.reset();
+}
+
+void GazeboGpsPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf)
+{
+  model_ = _model;
+
+  if (_sdf->HasElement("robotNamespace"))
+    namespace_ = _sdf->GetElement("robotNamespace")->Get<std::string>();
+  else
+    gzerr << "[gazebo_gps_plugin] Please specify a robotNamespace.\n";
+  node_handle_ = transport::NodePtr(new transport::Node());
+  node_handle_->Init(namespace_);
+
+  double update_rate = kDefaultGpsUpdateRate;
+  double gps_position_pub_rate = kDefaultGpsPositionPubRate;
+  getSdfParam<std::string>(_sdf, "gpsTopic", gps_topic_, gps_topic_);
+  getSdfParam<double>(_sdf, "update_rate", update_rate, update_rate);
+  getSdfParam<double>(_sdf, "gps_delay", delay_, delay_);
+  getSdfParam<double>(_sdf, "gpsNoiseDensity", noise_density_, noise_density_);
+  getSdfParam<double>(_sdf, "gpsRandomWalk", random_walk_, random_walk_);
+  getSdfParam<double>(_sdf, "gpsCorrelationTime", correlation_time_, correlation_time_);
+  getSdfParam<double>(_sdf, "gpsPubRate", gps_position_pub_rate, gps_position_pub_rate);
+
+  if (update_rate <= 0.0) {
+    gzerr << "[gazebo_gps_plugin] update_rate must be positive, using " << kDefaultGpsUpdateRate << " Hz.\n";
+    update_rate = kDefaultGpsUpdateRate;
+  }
+  update_interval_ = 1.0 / update_rate;
+  delay_ = std::max(delay_, 0.0);
+
+  const GeoHome home = GeoHomeFromEnvironment();
+  geo_projection_.SetHome(home.lat_rad, home.lon_rad);
+  alt_home_ = home.alt;
+
+  // One reproducible stream per receiver, seeded by the world's noise plugin or PX4_SIM_SEED.
+  noise_ = NoiseStream(model_->GetWorld()->GetName(), model_->GetName() + gps_topic_);
+
+  // every fix waits delay_ at most, so this many are in flight at once
+  pending_.resize(static_cast<size_t>(std::ceil(delay_ / update_interval_)) + 1);
+
+  gps_bus_topic_ = SensorBus::Instance().GetTopic<GpsSample>(
+      node_handle_->DecodeTopicName("~/" + model_->GetName() + gps_topic_));
+  // the geotagging plugin listens here
+  gps_position_pub_.Advertise(node_handle_, "~/gps_position", gps_position_pub_rate, 1000);
+  gps_record_ = SensorBus::Instance().GetShared<FlightRecordStream>(
+      FlightRecordStreamName(model_->GetName(), "gps"));
+
+  last_fix_time_ = model_->GetWorld()->GetSimTime().Double();
+
+  const std::string probe_prefix = model_->GetName() + "/" + GetHandle() + "/";
+  fix_probe_ = StepProfiler::Instance().Register(probe_prefix + "OnFix");
+  publish_probe_ = StepProfiler::Instance().Register(probe_prefix + "OnPublish");
+  fix_timer_ = SimScheduler::Instance().SchedulePeriodic(
+      update_interval_, boost::bind(&GazeboGpsPlugin::OnFix, this, _1));
+  publish_timer_ = SimScheduler::Instance().CreateOneShot(
+      boost::bind(&GazeboGpsPlugin::OnPublish, this, _1));
+}
+
+void GazeboGpsPlugin::OnFix(double /*_due*/)
+{
+  ScopedProbe probe(fix_probe_.get());
+
+  const double sim_time = model_->GetWorld()->GetSimTime().Double();
+
+  // world reset, start over
+  if (sim_time < last_fix_time_) {
+    pending_count_ = 0;
+    last_fix_time_ = sim_time;
+    publish_timer_->Cancel();
+  }
+
+  if (pending_count_ == pending_.size()) {
+    // can't happen with the ring sized for delay_, drop the oldest anyway
+    pending_head_ = (pending_head_ + 1) % pending_.size();
+    --pending_count_;
+  }
+  TakeFix(sim_time, &pending_[(pending_head_ + pending_count_) % pending_.size()]);
+  ++pending_count_;
+
+  if (!publish_timer_->Armed()) {
+    publish_timer_->Restart(delay_);
+  }
+}
+
+void GazeboGpsPlugin::OnPublish(double /*_due*/)
+{
+  ScopedProbe probe(publish_probe_.get());
+
+  const double sim_time = model_->GetWorld()->GetSimTime().Double();
+  if (pending_count_ == 0) {
+    return;
+  }
+
+  const GpsSample &fix = pending_[pending_head_];
+  if (fix.time <= sim_time) {
+    gps_bus_topic_->Publish(fix);
+
+    if (gps_position_pub_.Ready(sim_time)) {
+      // true position for the geotags, as before the receiver had a delay
+      const math::Vector3 pos_W_I = model_->GetWorldPose().pos;
+      double lat_rad;
+      double lon_rad;
+      geo_projection_.Reproject(pos_W_I.x, pos_W_I.y, &lat_rad, &lon_rad);
+
+      msgs::Vector3d gps_msg;
+      gps_msg.set_x(lat_rad * 180. / M_PI);
+      gps_msg.set_y(lon_rad * 180. / M_PI);
+      gps_msg.set_z(fix.altitude);
+      gps_position_pub_.Publish(gps_msg, sim_time);
+    }
+  }
+  // else taken before a world reset, dropped
+
+  pending_head_ = (pending_head_ + 1) % pending_.size();
+  --pending_count_;
+  if (pending_count_ > 0) {
+    publish_timer_->Restart(std::max(pending_[pending_head_].time + delay_ - sim_time, 0.0));
+  }
+}
+
+void GazeboGpsPlugin::TakeFix(double _sim_time, GpsSample *_fix)
+{
+  const math::Vector3 pos_W_I = model_->GetWorldPose().pos;  // ENU
+  const math::Vector3 velocity_W = model_->GetWorldLinearVel();
+
+  double lat_rad;
+  double lon_rad;
+  geo_projection_.Reproject(pos_W_I.x, pos_W_I.y, &lat_rad, &lon_rad);
+
+  // white noise and bias random walk, north, east [m] and up [mm]
+  const double dt = _sim_time - last_fix_time_;
+  last_fix_time_ = _sim_time;
+  double n[6];
+  noise_.FillGaussian(n, 6, kGpsNoiseStdDev);
+  double noise[3];
+  for (int i = 0; i < 3; ++i) {
+    noise[i] = noise_density_ * sqrt(dt) * n[i];
+    bias_[i] += random_walk_ * n[3 + i] - bias_[i] / correlation_time_;
+  }
+
+  // standard deviation of random walk
+  const double std_xy = random_walk_ * correlation_time_ / sqrt(2 * correlation_time_ - 1);
+  const double std_z = std_xy;
+
+  _fix->time = _sim_time;
+  _fix->fix_type = 3;
+  // at the standard home coords, 1m is about 1e-5 deg
+  _fix->latitude = lat_rad * 180 / M_PI + (noise[0] + bias_[0]) * 1e-5;
+  _fix->longitude = lon_rad * 180 / M_PI + (noise[1] + bias_[1]) * 1e-5;
+  _fix->altitude = pos_W_I.z + alt_home_ + (noise[2] + bias_[2]) * 1e-3;
+  _fix->eph = std_xy + noise_density_ * noise_density_;
+  _fix->epv = std_z + noise_density_ * noise_density_;
+  _fix->velocity_north = velocity_W.y;
+  _fix->velocity_east = velocity_W.x;
+  _fix->velocity_down = -velocity_W.z;
+  _fix->ground_speed = sqrt(velocity_W.x * velocity_W.x + velocity_W.y * velocity_W.y);
+  math::Angle cog(atan2(velocity_W.x, velocity_W.y));
+  _fix->course_over_ground = GetDegrees360(cog);
+  _fix->satellites_visible = 10;
+
+  if (gps_record_->Active()) {
+    GpsRecord record;
+    record.sim_time = _sim_time;
+    record.latitude = lat_rad * 180 / M_PI;
+    record.longitude = lon_rad * 180 / M_PI;
+    record.altitude = pos_W_I.z + alt_home_;
+    record.velocity_ned[0] = _fix->velocity_north;
+    record.velocity_ned[1] = _fix->velocity_east;
+    record.velocity_ned[2] = _fix->velocity_down;
+    for (int i = 0; i < 3; ++i) {
+      record.bias[i] = bias_[i];
+      record.noise[i] = noise[i];
+    }
+    gps_record_->Append(record);
+  }
+}
+
+}
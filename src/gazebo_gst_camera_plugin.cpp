@@ -24,10 +24,13 @@
 #include "gazebo_gst_camera_plugin.h"
 
 #include <math.h>
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <iostream>
 #include <thread>
 #include <time.h>
+#include <vector>
 
 using namespace std;
 using namespace gazebo;
@@ -35,6 +38,60 @@ using namespace gazebo;
 GZ_REGISTER_SENSOR_PLUGIN(GstCameraPlugin)
 
 
+/// \brief Encoder elements and how to tune them, nullptr where an encoder has
+/// no such property. Per codec the hardware encoders come first, "auto" picks
+/// the first one that is installed and can open its device.
+struct GstEncoderInfo {
+  const char *codec;
+  const char *element;
+  const char *bitrate;
+  int bitrateScale;           ///< property units per kbit/s
+  const char *gop;            ///< distance between key frames [frames]
+  const char *threads;
+  const char *speedPreset;
+  const char *latencyProperty;
+  const char *latencyValue;   ///< set on latencyProperty for zerolatency
+};
+
+static const GstEncoderInfo kGstEncoders[] = {
+  {"h264", "nvh264enc", "bitrate", 1, "gop-size", nullptr, nullptr, "preset", "low-latency-hq"},
+  {"h264", "vaapih264enc", "bitrate", 1, "keyframe-period", nullptr, nullptr, nullptr, nullptr},
+  {"h264", "omxh264enc", "target-bitrate", 1000, nullptr, nullptr, nullptr, nullptr, nullptr},
+  {"h264", "x264enc", "bitrate", 1, "key-int-max", "threads", "speed-preset", "tune", "zerolatency"},
+  {"h265", "nvh265enc", "bitrate", 1, "gop-size", nullptr, nullptr, "preset", "low-latency-hq"},
+  {"h265", "vaapih265enc", "bitrate", 1, "keyframe-period", nullptr, nullptr, nullptr, nullptr},
+  {"h265", "x265enc", "bitrate", 1, "key-int-max", nullptr, "speed-preset", "tune", "zerolatency"},
+  {"mjpeg", "jpegenc", nullptr, 1, nullptr, nullptr, nullptr, nullptr, nullptr},
+};
+
+/// \brief Elements between the encoder and the udpsink per codec.
+struct GstCodecInfo {
+  const char *codec;
+  bool encoded;        ///< false streams the raw frames
+  const char *parser;
+  const char *payloader;
+};
+
+static const GstCodecInfo kGstCodecs[] = {
+  {"h264", true, "h264parse", "rtph264pay"},
+  {"h265", true, "h265parse", "rtph265pay"},
+  {"mjpeg", true, nullptr, "rtpjpegpay"},
+  {"raw", false, nullptr, "rtpvrawpay"},
+};
+
+/// \brief Sets a property from its string form if the element has it.
+static void setElementProperty(GstElement *element, const char *name, const std::string &value) {
+  if (!name) {
+    return;
+  }
+  if (!g_object_class_find_property(G_OBJECT_GET_CLASS(element), name)) {
+    gzwarn << "[gazebo_gst_camera_plugin] " << GST_ELEMENT_NAME(element) << " has no property "
+           << name << ", not set.\n";
+    return;
+  }
+  gst_util_set_object_arg(G_OBJECT(element), name, value.c_str());
+}
+
 static void cb_need_data(GstElement *appsrc, guint unused_size, gpointer user_data) {
   GstCameraPlugin *plugin = (GstCameraPlugin*)user_data;
   plugin->gstCallback(appsrc);
@@ -42,23 +99,23 @@ static void cb_need_data(GstElement *appsrc, guint unused_size, gpointer user_da
 
 void GstCameraPlugin::gstCallback(GstElement *appsrc) {
 
-  frameBufferMutex.lock();
-
-  while (!frameBuffer) {
-	/* can happen if not initialized yet */
-    frameBufferMutex.unlock();
-    usleep(10000);
-    frameBufferMutex.lock();
+  GstBuffer *buffer = pendingFrame.exchange(nullptr);
+  while (!buffer) {
+    /* nothing rendered since the last call */
+    std::unique_lock<std::mutex> lock(frameMutex);
+    frameReady.wait_for(lock, std::chrono::milliseconds(100), [this]() {
+      return pendingFrame.load() != nullptr || stopping;
+    });
+    if (stopping) {
+      return;
+    }
+    buffer = pendingFrame.exchange(nullptr);
   }
 
-  GST_BUFFER_PTS(frameBuffer) = gstTimestamp;
-  GST_BUFFER_DURATION(frameBuffer) = gst_util_uint64_scale_int (1, GST_SECOND, (int)rate);
-  gstTimestamp += GST_BUFFER_DURATION(frameBuffer);
-
   GstFlowReturn ret;
-  g_signal_emit_by_name(appsrc, "push-buffer", frameBuffer, &ret);
-
-  frameBufferMutex.unlock();
+  g_signal_emit_by_name(appsrc, "push-buffer", buffer, &ret);
+  /* the pipeline holds its own reference, the buffer returns to the pool once it's done */
+  gst_buffer_unref(buffer);
 
   if (ret != GST_FLOW_OK) {
     /* something wrong, stop pushing */
@@ -73,15 +130,12 @@ static void* start_thread(void* param) {
   return nullptr;
 }
 
-void GstCameraPlugin::startGstThread() {
-
-  gst_init(0, 0);
+static gboolean quit_loop(gpointer loop) {
+  g_main_loop_quit((GMainLoop*)loop);
+  return G_SOURCE_REMOVE;
+}
 
-  mainLoop = g_main_loop_new(NULL, FALSE);
-  if (!mainLoop) {
-    gzerr << "Create loop failed. \n";
-    return;
-  }
+void GstCameraPlugin::startGstThread() {
 
   GstElement* pipeline = gst_pipeline_new("sender");
   if (!pipeline) {
@@ -90,55 +144,52 @@ void GstCameraPlugin::startGstThread() {
   }
 
   GstElement* dataSrc = gst_element_factory_make("appsrc", "AppSrc");
-  GstElement* testSrc = gst_element_factory_make("videotestsrc", "FileSrc");
   GstElement* conv  = gst_element_factory_make("videoconvert", "Convert");
-  GstElement* encoder = gst_element_factory_make("x264enc", "AvcEncoder");
-  GstElement* parser  = gst_element_factory_make("h264parse", "Parser");
-  GstElement* payload = gst_element_factory_make("rtph264pay", "PayLoad");
-  GstElement* sink  = gst_element_factory_make("udpsink", "UdpSink");
-  if (!dataSrc || !testSrc || !conv || !encoder || !parser || !payload || !sink) {
+  if (!dataSrc || !conv) {
     gzerr << "ERR: Create elements failed. \n";
     return;
   }
 
-// gzerr <<"width"<< this->width<<"\n";
-// gzerr <<"height"<< this->height<<"\n";
-// gzerr <<"rate"<< this->rate<<"\n";
-
   // Config src
-  g_object_set(G_OBJECT(dataSrc), "caps",
-      gst_caps_new_simple ("video/x-raw",
-      "format", G_TYPE_STRING, "RGB",
-      "width", G_TYPE_INT, this->width,
-      "height", G_TYPE_INT, this->height,
-      "framerate", GST_TYPE_FRACTION, (unsigned int)this->rate, 1,
-      NULL),
-      "is-live", TRUE,
-      NULL);
-
-  // Config encoder
-  g_object_set(G_OBJECT(encoder), "bitrate", 800, NULL);
-  g_object_set(G_OBJECT(encoder), "speed-preset", 2, NULL); //lower = faster, 6=medium
-  //g_object_set(G_OBJECT(encoder), "tune", "zerolatency", NULL);
-  //g_object_set(G_OBJECT(encoder), "low-latency", 1, NULL);
-  //g_object_set(G_OBJECT(encoder), "control-rate", 2, NULL);
-
-  // Config payload
-  g_object_set(G_OBJECT(payload), "config-interval", 1, NULL);
+  GstCaps *caps = frameCaps();
+  g_object_set(G_OBJECT(dataSrc), "caps", caps, "is-live", TRUE, NULL);
+  gst_caps_unref(caps);
+
+  std::vector<GstElement*> elements = {dataSrc, conv};
+  if (!addEncoder(&elements)) {
+    for (GstElement *element : elements) {
+      gst_object_unref(element);
+    }
+    return;
+  }
 
+  GstElement* sink  = gst_element_factory_make("udpsink", "UdpSink");
+  if (!sink) {
+    gzerr << "ERR: Create elements failed. \n";
+    return;
+  }
   // Config udpsink
-  g_object_set(G_OBJECT(sink), "host", "127.0.0.1", NULL);
+  g_object_set(G_OBJECT(sink), "host", this->udpHost.c_str(), NULL);
   g_object_set(G_OBJECT(sink), "port", this->udpPort, NULL);
-  //g_object_set(G_OBJECT(sink), "sync", false, NULL);
-  //g_object_set(G_OBJECT(sink), "async", false, NULL);
+  if (this->zeroLatency) {
+    // send as soon as encoded instead of waiting for the frame's time
+    g_object_set(G_OBJECT(sink), "sync", FALSE, NULL);
+  }
+  elements.push_back(sink);
 
   // Connect all elements to pipeline
-  gst_bin_add_many(GST_BIN(pipeline), dataSrc, conv, encoder, parser, payload, sink, NULL);
+  for (GstElement *element : elements) {
+    gst_bin_add(GST_BIN(pipeline), element);
+  }
 
-  // Link all elements
-  if (gst_element_link_many(dataSrc, conv, encoder, parser, payload, sink, NULL) != TRUE) {
-    gzerr << "ERR: Link all the elements failed. \n";
-    return;
+  // Link all elements in order
+  for (size_t i = 1; i < elements.size(); ++i) {
+    if (!gst_element_link(elements[i - 1], elements[i])) {
+      gzerr << "ERR: Link " << GST_ELEMENT_NAME(elements[i - 1]) << " to "
+            << GST_ELEMENT_NAME(elements[i]) << " failed. \n";
+      gst_object_unref(GST_OBJECT(pipeline));
+      return;
+    }
   }
 
   // Set up appsrc
@@ -149,33 +200,179 @@ void GstCameraPlugin::startGstThread() {
   gst_element_set_state(pipeline, GST_STATE_PLAYING);
   g_main_loop_run(mainLoop);
 
-  // Clean up
+  // Clean up, this waits for the streaming threads
   gst_element_set_state(pipeline, GST_STATE_NULL);
   gst_object_unref(GST_OBJECT(pipeline));
-  g_main_loop_unref(mainLoop);
-  mainLoop = nullptr;
 
 }
 
+/////////////////////////////////////////////////
+GstElement *GstCameraPlugin::createEncoder(const std::string &codec, const GstEncoderInfo **info) const {
+  for (const GstEncoderInfo &candidate : kGstEncoders) {
+    if (codec != candidate.codec ||
+        (this->encoderName != "auto" && this->encoderName != candidate.element)) {
+      continue;
+    }
+    GstElement *encoder = gst_element_factory_make(candidate.element, "Encoder");
+    if (!encoder) {
+      continue;
+    }
+    // hardware encoders open their device on the way to READY
+    if (this->encoderName == "auto" &&
+        gst_element_set_state(encoder, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE) {
+      gst_element_set_state(encoder, GST_STATE_NULL);
+      gst_object_unref(encoder);
+      continue;
+    }
+    gst_element_set_state(encoder, GST_STATE_NULL);
+    *info = &candidate;
+    return encoder;
+  }
+
+  // an encoder we have no tuning for, only the generic properties are set
+  if (this->encoderName != "auto") {
+    GstElement *encoder = gst_element_factory_make(this->encoderName.c_str(), "Encoder");
+    if (encoder) {
+      *info = nullptr;
+      return encoder;
+    }
+  }
+  return nullptr;
+}
+
+/////////////////////////////////////////////////
+bool GstCameraPlugin::addEncoder(std::vector<GstElement*> *elements) const {
+  const GstCodecInfo *codec = nullptr;
+  for (const GstCodecInfo &candidate : kGstCodecs) {
+    if (this->codec == candidate.codec) {
+      codec = &candidate;
+    }
+  }
+  if (!codec) {
+    gzerr << "[gazebo_gst_camera_plugin] Unknown codec " << this->codec
+          << ", use h264, h265, mjpeg or raw.\n";
+    return false;
+  }
+
+  if (codec->encoded) {
+    const GstEncoderInfo *info = nullptr;
+    GstElement *encoder = createEncoder(this->codec, &info);
+    if (!encoder) {
+      gzerr << "[gazebo_gst_camera_plugin] No " << this->codec << " encoder "
+            << (this->encoderName == "auto" ? std::string("available") : this->encoderName) << ".\n";
+      return false;
+    }
+    gzmsg << "[gazebo_gst_camera_plugin] Encoding " << this->codec << " with "
+          << GST_ELEMENT_NAME(gst_element_get_factory(encoder)) << ".\n";
+
+    if (info) {
+      if (info->bitrate) {
+        setElementProperty(encoder, info->bitrate, std::to_string(this->bitrate * info->bitrateScale));
+      }
+      if (info->gop && this->gop > 0) {
+        setElementProperty(encoder, info->gop, std::to_string(this->gop));
+      }
+      if (info->threads && this->threads > 0) {
+        setElementProperty(encoder, info->threads, std::to_string(this->threads));
+      }
+      if (info->speedPreset && !this->speedPreset.empty()) {
+        setElementProperty(encoder, info->speedPreset, this->speedPreset);
+      }
+      if (info->latencyProperty && this->zeroLatency) {
+        setElementProperty(encoder, info->latencyProperty, info->latencyValue);
+      }
+    }
+    if (this->codec == "mjpeg") {
+      setElementProperty(encoder, "quality", std::to_string(this->jpegQuality));
+    }
+    elements->push_back(encoder);
+  }
+
+  if (codec->parser) {
+    GstElement *parser = gst_element_factory_make(codec->parser, "Parser");
+    if (!parser) {
+      gzerr << "[gazebo_gst_camera_plugin] Could not create " << codec->parser << ".\n";
+      return false;
+    }
+    elements->push_back(parser);
+  }
+
+  GstElement *payload = gst_element_factory_make(codec->payloader, "PayLoad");
+  if (!payload) {
+    gzerr << "[gazebo_gst_camera_plugin] Could not create " << codec->payloader << ".\n";
+    return false;
+  }
+  // send SPS/PPS with every key frame so receivers can join any time
+  if (g_object_class_find_property(G_OBJECT_GET_CLASS(payload), "config-interval")) {
+    g_object_set(G_OBJECT(payload), "config-interval", 1, NULL);
+  }
+  elements->push_back(payload);
+  return true;
+}
+
+/////////////////////////////////////////////////
+GstCaps *GstCameraPlugin::frameCaps() const {
+  return gst_caps_new_simple("video/x-raw",
+      "format", G_TYPE_STRING, "RGB",
+      "width", G_TYPE_INT, this->width,
+      "height", G_TYPE_INT, this->height,
+      "framerate", GST_TYPE_FRACTION, (unsigned int)this->rate, 1,
+      NULL);
+}
+
 /////////////////////////////////////////////////
 GstCameraPlugin::GstCameraPlugin()
-: SensorPlugin(), width(0), height(0), depth(0), frameBuffer(nullptr), mainLoop(nullptr),
-  gstTimestamp(0)
+: SensorPlugin(), width(0), height(0), depth(0), output(kGstDefaultOutput), udpHost(kGstDefaultUdpHost), codec(kGstDefaultCodec),
+  encoderName(kGstDefaultEncoder), bitrate(kGstDefaultBitrate), gop(kGstDefaultGop),
+  zeroLatency(true), threads(0), speedPreset(kGstDefaultSpeedPreset), jpegQuality(kGstDefaultJpegQuality),
+  framePool(nullptr), pendingFrame(nullptr), stopping(false), mainLoop(nullptr), gstThreadStarted(false), haveFirstFrame(false), gstTimestamp(GST_CLOCK_TIME_NONE),
+  framesRendered(0), framesDropped(0), framesOverwritten(0)
 {
 }
 
 /////////////////////////////////////////////////
 GstCameraPlugin::~GstCameraPlugin()
 {
+  /* no more frames from the rendering thread */
+  this->newFrameConnection.reset();
   this->parentSensor.reset();
   this->camera.reset();
+  {
+    std::lock_guard<std::mutex> guard(frameMutex);
+    stopping = true;
+  }
+  frameReady.notify_all();
   if (mainLoop) {
     g_main_loop_quit(mainLoop);
+    /* in case the loop isn't running yet, the quit above would be lost */
+    GSource *source = g_idle_source_new();
+    g_source_set_callback(source, quit_loop, g_main_loop_ref(mainLoop), (GDestroyNotify)g_main_loop_unref);
+    g_source_attach(source, g_main_loop_get_context(mainLoop));
+    g_source_unref(source);
+  }
+  if (gstThreadStarted) {
+    pthread_join(gstThread, NULL);
+    gstThreadStarted = false;
+  }
+  if (mainLoop) {
+    g_main_loop_unref(mainLoop);
+    mainLoop = nullptr;
+  }
+
+  GstBuffer *buffer = pendingFrame.exchange(nullptr);
+  if (buffer) {
+    gst_buffer_unref(buffer);
+  }
+  if (framePool) {
+    /* buffers still in the pipeline keep the pool alive */
+    gst_buffer_pool_set_active(framePool, FALSE);
+    gst_object_unref(framePool);
+    framePool = nullptr;
   }
-  std::lock_guard<std::mutex> guard(frameBufferMutex);
-  if (frameBuffer) {
-	  gst_buffer_unref(frameBuffer);
-	  frameBuffer = nullptr;
+
+  if (framesDropped > 0 || framesOverwritten > 0) {
+    gzmsg << "[gazebo_gst_camera_plugin] frames rendered: " << framesRendered
+          << ", dropped: " << framesDropped << ", overwritten: " << framesOverwritten << "\n";
   }
 }
 
@@ -242,10 +439,62 @@ void GstCameraPlugin::Load(sensors::SensorPtr sensor, sdf::ElementPtr sdf)
   if (sdf->HasElement("udpPort")) {
 	this->udpPort = sdf->GetElement("udpPort")->Get<int>();
   }
+  getSdfParam<std::string>(sdf, "output", this->output, this->output);
+  getSdfParam<std::string>(sdf, "udpHost", this->udpHost, this->udpHost);
+  getSdfParam<std::string>(sdf, "codec", this->codec, this->codec);
+  getSdfParam<std::string>(sdf, "encoder", this->encoderName, this->encoderName);
+  getSdfParam<int>(sdf, "bitrate", this->bitrate, this->bitrate);
+  getSdfParam<int>(sdf, "gop", this->gop, this->gop);
+  getSdfParam<bool>(sdf, "zerolatency", this->zeroLatency, this->zeroLatency);
+  getSdfParam<int>(sdf, "threads", this->threads, this->threads);
+  getSdfParam<std::string>(sdf, "speedPreset", this->speedPreset, this->speedPreset);
+  getSdfParam<int>(sdf, "jpegQuality", this->jpegQuality, this->jpegQuality);
 
   node_handle_ = transport::NodePtr(new transport::Node());
   node_handle_->Init(namespace_);
 
+  if (this->output == "shm") {
+    // raw frames for local consumers, no GStreamer involved
+    std::string shmName = "/sitl_camera_" + this->parentSensor->ScopedName();
+    getSdfParam<std::string>(sdf, "shmName", shmName, shmName);
+    std::replace(shmName.begin() + 1, shmName.end(), '/', '_');
+    std::replace(shmName.begin() + 1, shmName.end(), ':', '_');
+    int shmSlots = kGstDefaultShmSlots;
+    getSdfParam<int>(sdf, "shmSlots", shmSlots, shmSlots);
+
+    this->shmRing = VideoShmWriter::Create(shmName, this->width, this->height, std::max(shmSlots, 1));
+    if (!this->shmRing) {
+      gzerr << "[gazebo_gst_camera_plugin] Could not create the shared memory ring " << shmName << ".\n";
+      return;
+    }
+    gzmsg << "[gazebo_gst_camera_plugin] Writing frames to shared memory " << shmName << ".\n";
+
+    this->newFrameConnection = this->camera->ConnectNewImageFrame(
+        boost::bind(&GstCameraPlugin::OnNewFrame, this, _1, this->width, this->height, this->depth, this->format));
+    this->parentSensor->SetActive(true);
+    return;
+  }
+  if (this->output != "udp") {
+    gzerr << "[gazebo_gst_camera_plugin] Unknown output " << this->output << ", use udp or shm.\n";
+    return;
+  }
+
+  gst_init(0, 0);
+
+  // all frame buffers are allocated once here
+  this->framePool = gst_buffer_pool_new();
+  GstStructure *config = gst_buffer_pool_get_config(this->framePool);
+  GstCaps *caps = frameCaps();
+  gst_buffer_pool_config_set_params(config, caps, this->width * this->height * 3,
+                                    kGstFramePoolSize, kGstFramePoolSize);
+  gst_caps_unref(caps);
+  if (!gst_buffer_pool_set_config(this->framePool, config) ||
+      !gst_buffer_pool_set_active(this->framePool, TRUE)) {
+    gzerr << "[gazebo_gst_camera_plugin] Could not allocate the frame buffers.\n";
+    gst_object_unref(this->framePool);
+    this->framePool = nullptr;
+    return;
+  }
 
   this->newFrameConnection = this->camera->ConnectNewImageFrame(
       boost::bind(&GstCameraPlugin::OnNewFrame, this, _1, this->width, this->height, this->depth, this->format));
@@ -253,8 +502,16 @@ void GstCameraPlugin::Load(sensors::SensorPtr sensor, sdf::ElementPtr sdf)
   this->parentSensor->SetActive(true);
 
   /* start the gstreamer event loop */
-  pthread_t threadId;
-  pthread_create(&threadId, NULL, start_thread, this);
+  this->mainLoop = g_main_loop_new(NULL, FALSE);
+  if (!this->mainLoop) {
+    gzerr << "Create loop failed. \n";
+    return;
+  }
+  if (pthread_create(&this->gstThread, NULL, start_thread, this) != 0) {
+    gzerr << "[gazebo_gst_camera_plugin] Could not start the GStreamer thread.\n";
+    return;
+  }
+  this->gstThreadStarted = true;
 }
 
 /////////////////////////////////////////////////
@@ -271,21 +528,64 @@ void GstCameraPlugin::OnNewFrame(const unsigned char * image,
   image = this->camera->GetImageData(0);
 #endif
 
-  std::lock_guard<std::mutex> guard(frameBufferMutex);
+  ++framesRendered;
+
+#if GAZEBO_MAJOR_VERSION >= 8
+  const common::Time frameTime = this->camera->GetScene()->SimTime();
+#else
+  const common::Time frameTime = this->camera->GetScene()->GetSimTime();
+#endif
+
+  if (shmRing) {
+    shmRing->Write(image, frameTime.Double());
+    return;
+  }
+  if (!framePool) {
+    return;
+  }
+  if (!haveFirstFrame) {
+    firstFrameTime = frameTime;
+    haveFirstFrame = true;
+  }
 
-  if (frameBuffer) {
-    gst_buffer_unref(frameBuffer);
+  GstBufferPoolAcquireParams params = {};
+  params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+  GstBuffer *buffer = nullptr;
+  if (gst_buffer_pool_acquire_buffer(framePool, &buffer, &params) != GST_FLOW_OK) {
+    // the encoder has all free buffers, reuse the one waiting in the slot
+    buffer = pendingFrame.exchange(nullptr);
+    if (!buffer) {
+      ++framesDropped;
+      return;
+    }
+    ++framesOverwritten;
   }
 
-  // Alloc buffer
-  guint size = width * height * 3;
-  frameBuffer = gst_buffer_new_allocate(NULL, size, NULL);
+  const gsize size = width * height * 3;
+  gst_buffer_fill(buffer, 0, image, size);
+
+  // sim time stamps, kept increasing across world resets
+  const GstClockTime duration = gst_util_uint64_scale_int(1, GST_SECOND, (int)rate);
+  const common::Time elapsed = frameTime - firstFrameTime;
+  GstClockTime timestamp = elapsed.sec >= 0 ?
+      (GstClockTime)elapsed.sec * GST_SECOND + elapsed.nsec : 0;
+  if (GST_CLOCK_TIME_IS_VALID(gstTimestamp) && timestamp <= gstTimestamp) {
+    timestamp = gstTimestamp + duration;
+  }
+  gstTimestamp = timestamp;
+  GST_BUFFER_PTS(buffer) = timestamp;
+  GST_BUFFER_DURATION(buffer) = duration;
+  GST_BUFFER_OFFSET(buffer) = framesRendered - 1;
+
+  GstBuffer *previous = pendingFrame.exchange(buffer);
+  if (previous) {
+    gst_buffer_unref(previous);
+    ++framesOverwritten;
+  }
 
-  GstMapInfo mapInfo;
-  if (gst_buffer_map(frameBuffer, &mapInfo, GST_MAP_WRITE)) {
-    memcpy(mapInfo.data, image, size);
-    gst_buffer_unmap(frameBuffer, &mapInfo);
-  } else {
-	  gzerr << "gst_buffer_map failed"<<endl;
+  {
+    // empty critical section, the encoder thread can't miss the notification
+    std::lock_guard<std::mutex> guard(frameMutex);
   }
+  frameReady.notify_one();
 }
@@ -101,8 +101,12 @@ void GazeboImuPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
   this->updateConnection_ =
       event::Events::ConnectWorldUpdateBegin(
           boost::bind(&GazeboImuPlugin::OnUpdate, this, _1));
+  update_probe_ = StepProfiler::Instance().Register(model_->GetName() + "/" + GetHandle() + "/OnUpdate");
 
   imu_pub_ = node_handle_->Advertise<sensor_msgs::msgs::Imu>("~/" + model_->GetName() + imu_topic_, 1);
+  imu_bus_topic_ = SensorBus::Instance().GetTopic<ImuSample>(imu_pub_->GetTopic());
+  imu_record_ = SensorBus::Instance().GetShared<FlightRecordStream>(
+      FlightRecordStreamName(model_->GetName(), "imu"));
 
   // Fill imu message.
   // imu_message_.header.frame_id = frame_id_; TODO Add header
@@ -164,15 +168,14 @@ void GazeboImuPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
   gravity_W_ = world_->GetPhysicsEngine()->GetGravity();
   imu_parameters_.gravity_magnitude = gravity_W_.GetLength();
 
-  standard_normal_distribution_ = std::normal_distribution<double>(0.0, 1.0);
+  // One reproducible stream per IMU, seeded by the world's noise plugin or PX4_SIM_SEED.
+  noise_ = NoiseStream(world_->GetName(), model_->GetName() + "/" + link_name_ + imu_topic_);
 
   double sigma_bon_g = imu_parameters_.gyroscope_turn_on_bias_sigma;
   double sigma_bon_a = imu_parameters_.accelerometer_turn_on_bias_sigma;
   for (int i = 0; i < 3; ++i) {
-      gyroscope_turn_on_bias_[i] =
-          sigma_bon_g * standard_normal_distribution_(random_generator_);
-      accelerometer_turn_on_bias_[i] =
-          sigma_bon_a * standard_normal_distribution_(random_generator_);
+      gyroscope_turn_on_bias_[i] = sigma_bon_g * noise_.Gaussian();
+      accelerometer_turn_on_bias_[i] = sigma_bon_a * noise_.Gaussian();
   }
 
   // TODO(nikolicj) incorporate steady-state covariance of bias process
@@ -189,6 +192,10 @@ void GazeboImuPlugin::addNoise(Eigen::Vector3d* linear_acceleration,
   // CHECK(angular_velocity);
   assert(dt > 0.0);
 
+  // bias and white noise for the 3 gyroscope and 3 accelerometer axes
+  double n[12];
+  noise_.FillGaussian(n, 12);
+
   // Gyrosocpe
   double tau_g = imu_parameters_.gyroscope_bias_correlation_time;
   // Discrete-time standard deviation equivalent to an "integrating" sampler
@@ -204,10 +211,10 @@ void GazeboImuPlugin::addNoise(Eigen::Vector3d* linear_acceleration,
   // Simulate gyroscope noise processes and add them to the true angular rate.
   for (int i = 0; i < 3; ++i) {
     gyroscope_bias_[i] = phi_g_d * gyroscope_bias_[i] +
-        sigma_b_g_d * standard_normal_distribution_(random_generator_);
+        sigma_b_g_d * n[i];
     (*angular_velocity)[i] = (*angular_velocity)[i] +
         gyroscope_bias_[i] +
-        sigma_g_d * standard_normal_distribution_(random_generator_) +
+        sigma_g_d * n[3 + i] +
         gyroscope_turn_on_bias_[i];
   }
 
@@ -227,10 +234,10 @@ void GazeboImuPlugin::addNoise(Eigen::Vector3d* linear_acceleration,
   // acceleration.
   for (int i = 0; i < 3; ++i) {
     accelerometer_bias_[i] = phi_a_d * accelerometer_bias_[i] +
-        sigma_b_a_d * standard_normal_distribution_(random_generator_);
+        sigma_b_a_d * n[6 + i];
     (*linear_acceleration)[i] = (*linear_acceleration)[i] +
         accelerometer_bias_[i] +
-        sigma_a_d * standard_normal_distribution_(random_generator_) +
+        sigma_a_d * n[9 + i] +
         accelerometer_turn_on_bias_[i];
   }
 
@@ -238,6 +245,9 @@ void GazeboImuPlugin::addNoise(Eigen::Vector3d* linear_acceleration,
 
 // This gets called by the world update start event.
 void GazeboImuPlugin::OnUpdate(const common::UpdateInfo& _info) {
+  // includes the bus subscribers, e.g. the ImuCallback of the mavlink interface
+  ScopedProbe probe(update_probe_.get());
+
   common::Time current_time  = world_->GetSimTime();
   double dt = (current_time - last_time_).Double();
   last_time_ = current_time;
@@ -246,13 +256,6 @@ void GazeboImuPlugin::OnUpdate(const common::UpdateInfo& _info) {
   math::Pose T_W_I = link_->GetWorldPose(); //TODO(burrimi): Check tf.
   math::Quaternion C_W_I = T_W_I.rot;
 
-  // Copy math::Quaternion to gazebo::msgs::Quaternion
-  gazebo::msgs::Quaternion* orientation = new gazebo::msgs::Quaternion();
-  orientation->set_x(C_W_I.x);
-  orientation->set_y(C_W_I.y);
-  orientation->set_z(C_W_I.z);
-  orientation->set_w(C_W_I.w);
-
 
 
 
@@ -283,19 +286,47 @@ void GazeboImuPlugin::OnUpdate(const common::UpdateInfo& _info) {
                                      angular_vel_I.y,
                                      angular_vel_I.z);
 
+  ImuRecord record;
+  const bool recording = imu_record_->Active();
+  if (recording) {
+    for (int i = 0; i < 3; ++i) {
+      record.linear_acceleration_true[i] = linear_acceleration_I[i];
+      record.angular_velocity_true[i] = angular_velocity_I[i];
+    }
+  }
+
   addNoise(&linear_acceleration_I, &angular_velocity_I, dt);
 
-  // Copy Eigen::Vector3d to gazebo::msgs::Vector3d
-  gazebo::msgs::Vector3d* linear_acceleration = new gazebo::msgs::Vector3d();
-  linear_acceleration->set_x(linear_acceleration_I[0]);
-  linear_acceleration->set_y(linear_acceleration_I[1]);
-  linear_acceleration->set_z(linear_acceleration_I[2]);
+  if (recording) {
+    record.sim_time = t;
+    for (int i = 0; i < 3; ++i) {
+      record.linear_acceleration[i] = linear_acceleration_I[i];
+      record.angular_velocity[i] = angular_velocity_I[i];
+      record.accelerometer_bias[i] = accelerometer_bias_[i] + accelerometer_turn_on_bias_[i];
+      record.gyroscope_bias[i] = gyroscope_bias_[i] + gyroscope_turn_on_bias_[i];
+    }
+    imu_record_->Append(record);
+  }
+
+  // In-process consumers get the plain sample, no serialization involved.
+  ImuSample sample;
+  sample.orientation[0] = C_W_I.w;
+  sample.orientation[1] = C_W_I.x;
+  sample.orientation[2] = C_W_I.y;
+  sample.orientation[3] = C_W_I.z;
+  for (int i = 0; i < 3; ++i) {
+    sample.angular_velocity[i] = angular_velocity_I[i];
+    sample.linear_acceleration[i] = linear_acceleration_I[i];
+  }
+  imu_bus_topic_->Publish(sample);
+
+  // Only build and serialize the protobuf for subscribers outside the process.
+  if (!imu_pub_->HasConnections()) {
+    return;
+  }
 
-  // Copy Eigen::Vector3d to gazebo::msgs::Vector3d
-  gazebo::msgs::Vector3d* angular_velocity = new gazebo::msgs::Vector3d();
-  angular_velocity->set_x(angular_velocity_I[0]);
-  angular_velocity->set_y(angular_velocity_I[1]);
-  angular_velocity->set_z(angular_velocity_I[2]);
+  // Fill the message in place, no heap allocation per step.
+  FillImuMessage(sample, &imu_message_);
 
   // Fill IMU message.
   // ADD HEaders
@@ -307,10 +338,6 @@ void GazeboImuPlugin::OnUpdate(const common::UpdateInfo& _info) {
   // imu_message_.orientation.x = 0;
   // imu_message_.orientation.y = 0;
   // imu_message_.orientation.z = 0;
-  
-  imu_message_.set_allocated_orientation(orientation);
-  imu_message_.set_allocated_linear_acceleration(linear_acceleration);
-  imu_message_.set_allocated_angular_velocity(angular_velocity);
 
   // gzerr << "publishing: " << imu_message_.linear_acceleration().z() << "\n";
   imu_pub_->Publish(imu_message_);
@@ -71,6 +71,7 @@ void IRLockPlugin::Load(sensors::SensorPtr _sensor, sdf::ElementPtr _sdf)
   boost::replace_all(topicName, "::", "/");
 
   irlock_pub_ = node_handle_->Advertise<irlock_msgs::msgs::irlock>(topicName, 10);
+  irlock_bus_topic_ = SensorBus::Instance().GetTopic<IRLockSample>(irlock_pub_->GetTopic());
 
   this->updateConnection = this->camera->ConnectUpdated(
       std::bind(&IRLockPlugin::OnUpdated, this));
@@ -101,16 +102,28 @@ void IRLockPlugin::OnUpdated()
         // rotate the measurement accordingly
         gazebo::math::Vector3 meas(-pos.y/pos.x, -pos.z/pos.x, 1.0);
 
-        // prepare irlock message
-        irlock_message.set_time_usec(0); // will be filled in simulator_mavlink.cpp
-        irlock_message.set_signature(idx); // unused by beacon estimator
-        irlock_message.set_pos_x(meas.x);
-        irlock_message.set_pos_y(meas.y);
-        irlock_message.set_size_x(0); // unused by beacon estimator
-        irlock_message.set_size_y(0); // unused by beacon estimator
-
-        // send message
-        irlock_pub_->Publish(irlock_message);
+        // prepare irlock sample
+        IRLockSample sample;
+        sample.time_usec = 0; // will be filled in simulator_mavlink.cpp
+        sample.signature = idx; // unused by beacon estimator
+        sample.pos_x = meas.x;
+        sample.pos_y = meas.y;
+        sample.size_x = 0; // unused by beacon estimator
+        sample.size_y = 0; // unused by beacon estimator
+
+        // send to in-process subscribers
+        irlock_bus_topic_->Publish(sample);
+
+        // serialize only for subscribers outside the process
+        if (irlock_pub_->HasConnections()) {
+          irlock_message.set_time_usec(sample.time_usec);
+          irlock_message.set_signature(sample.signature);
+          irlock_message.set_pos_x(sample.pos_x);
+          irlock_message.set_pos_y(sample.pos_y);
+          irlock_message.set_size_x(sample.size_x);
+          irlock_message.set_size_y(sample.size_y);
+          irlock_pub_->Publish(irlock_message);
+        }
 
       }
     }
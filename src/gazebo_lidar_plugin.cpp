@@ -107,21 +107,32 @@ void RayPlugin::Load(sensors::SensorPtr _parent, sdf::ElementPtr _sdf)
   boost::replace_all(topicName, "::", "/");
 
   lidar_pub_ = node_handle_->Advertise<lidar_msgs::msgs::lidar>(topicName, 10);
+  lidar_bus_topic_ = SensorBus::Instance().GetTopic<RangeSample>(lidar_pub_->GetTopic());
 }
 
 /////////////////////////////////////////////////
 void RayPlugin::OnNewLaserScans()
 {
-  lidar_message.set_time_msec(0);
+  RangeSample sample;
+  sample.time_msec = 0;
 #if GAZEBO_MAJOR_VERSION >= 7
-  lidar_message.set_min_distance(parentSensor->RangeMin());
-  lidar_message.set_max_distance(parentSensor->RangeMax());
-  lidar_message.set_current_distance(parentSensor->Range(0));
+  sample.min_distance = parentSensor->RangeMin();
+  sample.max_distance = parentSensor->RangeMax();
+  sample.current_distance = parentSensor->Range(0);
 #else
-  lidar_message.set_min_distance(parentSensor->GetRangeMin());
-  lidar_message.set_max_distance(parentSensor->GetRangeMax());
-  lidar_message.set_current_distance(parentSensor->GetRange(0));
+  sample.min_distance = parentSensor->GetRangeMin();
+  sample.max_distance = parentSensor->GetRangeMax();
+  sample.current_distance = parentSensor->GetRange(0);
 #endif
 
-  lidar_pub_->Publish(lidar_message);
+  lidar_bus_topic_->Publish(sample);
+
+  // serialize only for subscribers outside the process
+  if (lidar_pub_->HasConnections()) {
+    lidar_message.set_time_msec(sample.time_msec);
+    lidar_message.set_min_distance(sample.min_distance);
+    lidar_message.set_max_distance(sample.max_distance);
+    lidar_message.set_current_distance(sample.current_distance);
+    lidar_pub_->Publish(lidar_message);
+  }
 }
@@ -21,35 +21,53 @@
 
 #include "common.h"
 #include "gazebo_mavlink_interface.h"
-#include "geo_mag_declination.h"
+#include <chrono>
+#include <cmath>
 #include <cstdlib>
 #include <string>
 
 namespace gazebo {
 
-// Set global reference point
-// Zurich Irchel Park: 47.397742, 8.545594, 488m
-// Seattle downtown (15 deg declination): 47.592182, -122.316031, 86m
-// Moscow downtown: 55.753395, 37.625427, 155m
-
-// The home position can be specified using the environment variables:
-// PX4_HOME_LAT, PX4_HOME_LON, and PX4_HOME_ALT
-
-// Zurich Irchel Park
-static double lat_home = 47.397742 * M_PI / 180;  // rad
-static double lon_home = 8.545594 * M_PI / 180;  // rad
-static double alt_home = 488.0; // meters
-// Seattle downtown (15 deg declination): 47.592182, -122.316031
-// static const double lat_home = 47.592182 * M_PI / 180;  // rad
-// static const double lon_home = -122.316031 * M_PI / 180;  // rad
-// static const double alt_home = 86.0; // meters
-static const double earth_radius = 6353000;  // m
 
 
 GZ_REGISTER_MODEL_PLUGIN(GazeboMavlinkInterface);
 
 GazeboMavlinkInterface::~GazeboMavlinkInterface() {
   event::Events::DisconnectWorldUpdateBegin(updateConnection_);
+  event::Events::DisconnectWorldUpdateEnd(updateEndConnection_);
+  ev_timer_.reset();
+  actuator_timeout_.reset();
+
+  // the replay thread sends through the transport torn down below
+  replay_stop_ = true;
+  if (replay_thread_.joinable()) {
+    replay_thread_.join();
+  }
+
+  // stop sensor callbacks before anything else is torn down
+  imu_sub_.reset();
+  gps_sub_.reset();
+  lidar_sub_.reset();
+  sonar_sub_.reset();
+  opticalFlow_sub_.reset();
+  irlock_sub_.reset();
+
+  if (io_worker_) {
+    io_worker_->Stop();
+  }
+  if (mux_channel_) {
+    MavlinkMultiplexer::Instance().Unregister(mux_channel_);
+  }
+
+  if (mavlink_link_ && (mavlink_link_->DroppedTx() > 0 || mavlink_link_->DroppedRx() > 0)) {
+    gzmsg << "[gazebo_mavlink_interface] I/O thread ring overflows, tx: " << mavlink_link_->DroppedTx()
+          << ", rx: " << mavlink_link_->DroppedRx() << "\n";
+  }
+
+  if (dropped_actuator_controls_ > 0 || stale_actuator_controls_ > 0) {
+    gzmsg << "[gazebo_mavlink_interface] actuator controls dropped: " << dropped_actuator_controls_
+          << ", stale: " << stale_actuator_controls_ << "\n";
+  }
 }
 
 void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
@@ -58,22 +76,16 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
 
   world_ = model_->GetWorld();
 
-  // Use environment variables if set for home position.
-  const char *env_lat = std::getenv("PX4_HOME_LAT");
-  const char *env_lon = std::getenv("PX4_HOME_LON");
-  const char *env_alt = std::getenv("PX4_HOME_ALT");
+  // reproducible noise, seeded by the world's noise plugin or PX4_SIM_SEED
+  noise_ = NoiseStream(world_->GetName(), model_->GetName() + "/mavlink_interface");
 
-  if (env_lat) {
-    gzmsg << "Home latitude is set to " << env_lat << ".\n";
-    lat_home = std::stod(env_lat) * M_PI / 180.0;
-  }
-  if (env_lon) {
-    gzmsg << "Home longitude is set to " << env_lon << ".\n";
-    lon_home = std::stod(env_lon) * M_PI / 180.0;
-  }
-  if (env_alt) {
-    gzmsg << "Home altitude is set to " << env_alt << ".\n";
-    alt_home = std::stod(env_alt);
+  // Use environment variables if set for home position.
+  const GeoHome home = GeoHomeFromEnvironment();
+  geo_projection_.SetHome(home.lat_rad, home.lon_rad);
+  alt_home_ = home.alt;
+  if (std::getenv("PX4_HOME_LAT") || std::getenv("PX4_HOME_LON") || std::getenv("PX4_HOME_ALT")) {
+    gzmsg << "Home is set to " << home.lat_rad * 180 / M_PI << ", " << home.lon_rad * 180 / M_PI
+          << ", " << home.alt << " m.\n";
   }
 
   namespace_.clear();
@@ -88,7 +100,10 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
 
   getSdfParam<std::string>(_sdf, "motorSpeedCommandPubTopic", motor_velocity_reference_pub_topic_,
                            motor_velocity_reference_pub_topic_);
+  double motor_speed_pub_rate = kDefaultMotorSpeedCommandPubRate;
+  getSdfParam<double>(_sdf, "motorSpeedCommandPubRate", motor_speed_pub_rate, motor_speed_pub_rate);
   getSdfParam<std::string>(_sdf, "imuSubTopic", imu_sub_topic_, imu_sub_topic_);
+  getSdfParam<std::string>(_sdf, "gpsSubTopic", gps_sub_topic_, gps_sub_topic_);
   getSdfParam<std::string>(_sdf, "lidarSubTopic", lidar_sub_topic_, lidar_sub_topic_);
   getSdfParam<std::string>(_sdf, "opticalFlowSubTopic",
       opticalFlow_sub_topic_, opticalFlow_sub_topic_);
@@ -420,40 +435,79 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
     }
   }
 
+  // Replay the packets of an earlier run instead of simulating the sensors,
+  // physics then only has to keep gazebo alive (run it paused, gzserver -u).
+  std::string replay_file;
+  getSdfParam<std::string>(_sdf, "mavlink_replay_file", replay_file, "");
+  getSdfParam<double>(_sdf, "mavlink_replay_speed", replay_speed_, replay_speed_);
+  if (!replay_file.empty()) {
+    replay_reader_.reset(new FlightRecordReader());
+    if (!replay_reader_->Open(replay_file) ||
+        !replay_reader_->Get<MavlinkRecord>(0)) {
+      gzthrow("[gazebo_mavlink_interface] " << replay_file << " is no MAVLink recording.");
+    }
+    if (replay_reader_->Overwritten() > 0) {
+      gzwarn << "[gazebo_mavlink_interface] " << replay_file << " lost its first "
+             << replay_reader_->Overwritten() << " messages, replay starts mid flight.\n";
+    }
+  }
+
   // Listen to the update event. This event is broadcast every
   // simulation iteration.
-  updateConnection_ = event::Events::ConnectWorldUpdateBegin(
-      boost::bind(&GazeboMavlinkInterface::OnUpdate, this, _1));
-
-  // Subscriber to IMU sensor_msgs::Imu Message and SITL message
-  imu_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + imu_sub_topic_, &GazeboMavlinkInterface::ImuCallback, this);
-  lidar_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + lidar_sub_topic_, &GazeboMavlinkInterface::LidarCallback, this);
-  opticalFlow_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + opticalFlow_sub_topic_, &GazeboMavlinkInterface::OpticalFlowCallback, this);
-  sonar_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + sonar_sub_topic_, &GazeboMavlinkInterface::SonarCallback, this);
-  irlock_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + irlock_sub_topic_, &GazeboMavlinkInterface::IRLockCallback, this);
+  if (!replay_reader_) {
+    updateConnection_ = event::Events::ConnectWorldUpdateBegin(
+        boost::bind(&GazeboMavlinkInterface::OnUpdate, this, _1));
+    // All MAVLink messages of a step are sent together once the step is done.
+    updateEndConnection_ = event::Events::ConnectWorldUpdateEnd(
+        boost::bind(&GazeboMavlinkInterface::OnUpdateEnd, this));
+
+    const std::string probe_prefix = model_->GetName() + "/" + GetHandle() + "/";
+    update_probe_ = StepProfiler::Instance().Register(probe_prefix + "OnUpdate");
+    update_end_probe_ = StepProfiler::Instance().Register(probe_prefix + "OnUpdateEnd");
+    imu_probe_ = StepProfiler::Instance().Register(probe_prefix + "ImuCallback");
+
+    // Subscribe to the sensor plugins through the in-process bus, the topics
+    // are named after the gazebo topics the sensors advertise.
+    SensorBus &bus = SensorBus::Instance();
+    imu_sub_ = bus.GetTopic<ImuSample>(node_handle_->DecodeTopicName("~/" + model_->GetName() + imu_sub_topic_))
+        ->Subscribe(boost::bind(&GazeboMavlinkInterface::ImuCallback, this, _1));
+    gps_sub_ = bus.GetTopic<GpsSample>(node_handle_->DecodeTopicName("~/" + model_->GetName() + gps_sub_topic_))
+        ->Subscribe(boost::bind(&GazeboMavlinkInterface::GpsCallback, this, _1));
+    lidar_sub_ = bus.GetTopic<RangeSample>(node_handle_->DecodeTopicName("~/" + model_->GetName() + lidar_sub_topic_))
+        ->Subscribe(boost::bind(&GazeboMavlinkInterface::LidarCallback, this, _1));
+    opticalFlow_sub_ = bus.GetTopic<OpticalFlowSample>(node_handle_->DecodeTopicName("~/" + model_->GetName() + opticalFlow_sub_topic_))
+        ->Subscribe(boost::bind(&GazeboMavlinkInterface::OpticalFlowCallback, this, _1));
+    sonar_sub_ = bus.GetTopic<RangeSample>(node_handle_->DecodeTopicName("~/" + model_->GetName() + sonar_sub_topic_))
+        ->Subscribe(boost::bind(&GazeboMavlinkInterface::SonarCallback, this, _1));
+    irlock_sub_ = bus.GetTopic<IRLockSample>(node_handle_->DecodeTopicName("~/" + model_->GetName() + irlock_sub_topic_))
+        ->Subscribe(boost::bind(&GazeboMavlinkInterface::IRLockCallback, this, _1));
+  }
 
   // Publish gazebo's motor_speed message
-  motor_velocity_reference_pub_ = node_handle_->Advertise<mav_msgs::msgs::CommandMotorSpeed>("~/" + model_->GetName() + motor_velocity_reference_pub_topic_, 1);
+  motor_velocity_reference_pub_.Advertise(node_handle_, "~/" + model_->GetName() + motor_velocity_reference_pub_topic_,
+                                          motor_speed_pub_rate);
+  // The rotor plugins read their command from here instead.
+  actuator_commands_ = SensorBus::Instance().GetShared<ActuatorCommands>(motor_velocity_reference_pub_.Publisher()->GetTopic());
 
   _rotor_count = 5;
   last_time_ = world_->GetSimTime();
-  last_gps_time_ = world_->GetSimTime();
-  gps_update_interval_ = 0.2;  // in seconds for 5Hz
-  gps_delay_ = 0.12; // in seconds
   ev_update_interval_ = 0.05; // in seconds for 20Hz
 
+  if (!replay_reader_) {
+    ev_timer_ = SimScheduler::Instance().SchedulePeriodic(
+        ev_update_interval_, boost::bind(&GazeboMavlinkInterface::VisionCallback, this, _1));
+    actuator_timeout_ = SimScheduler::Instance().CreateOneShot([this](double) {
+      actuator_timed_out_ = true;
+    });
+  }
+
   gravity_W_ = world_->GetPhysicsEngine()->GetGravity();
 
-  // Magnetic field data for Zurich from WMM2015 (10^5xnanoTesla (N, E D) n-frame )
-  // mag_n_ = {0.21523, 0.00771, -0.42741};
-  // We set the world Y component to zero because we apply
-  // the declination based on the global position,
-  // and so we need to start without any offsets.
-  // The real value for Zurich would be 0.00771
-  // frame d is the magnetic north frame
-  mag_d_.x = 0.21523;
-  mag_d_.y = 0;
-  mag_d_.z = -0.42741;
+  // Earth magnetic field from WMM2015, evaluated on a grid once and
+  // interpolated at the vehicle position in ImuCallback.
+  double mag_field_year = kWmmEpoch;
+  getSdfParam<double>(_sdf, "mag_field_year", mag_field_year, mag_field_year);
+  mag_field_.reset(new GeoMagField(mag_field_year));
 
   //Create socket
   // udp socket data
@@ -472,21 +526,15 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
     mavlink_udp_port_ = _sdf->GetElement("mavlink_udp_port")->Get<int>();
   }
 
-  // try to setup udp socket for communcation with simulator
-  if ((_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-    printf("create socket failed\n");
-    return;
-  }
-
-  memset((char *)&_myaddr, 0, sizeof(_myaddr));
-  _myaddr.sin_family = AF_INET;
-  _myaddr.sin_addr.s_addr = htonl(INADDR_ANY);
-  // Let the OS pick the port
-  _myaddr.sin_port = htons(0);
-
-  if (bind(_fd, (struct sockaddr *)&_myaddr, sizeof(_myaddr)) < 0) {
-    printf("bind failed\n");
-    return;
+  // In lockstep mode every physics step waits for the actuator controls PX4
+  // computed from the HIL_SENSOR of the previous step, so the simulation runs
+  // as fast as both sides can compute, independent of wall clock pacing.
+  getSdfParam<bool>(_sdf, "enable_lockstep", enable_lockstep_, false);
+  int lockstep_timeout_ms;
+  getSdfParam<int>(_sdf, "lockstep_timeout_ms", lockstep_timeout_ms, kDefaultLockstepTimeoutMs);
+  lockstep_timeout_ms_ = lockstep_timeout_ms > 0 ? lockstep_timeout_ms : kDefaultLockstepTimeoutMs;
+  if (enable_lockstep_) {
+    gzmsg << "Lockstep enabled, timeout " << lockstep_timeout_ms_ << " ms.\n";
   }
 
   _srcaddr.sin_family = AF_INET;
@@ -494,175 +542,236 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
   _srcaddr.sin_port = htons(mavlink_udp_port_);
   _addrlen = sizeof(_srcaddr);
 
-  fds[0].fd = _fd;
-  fds[0].events = POLLIN;
+  // With many vehicles in one world, let them all share a single socket
+  // served by one event loop instead of polling a socket per vehicle.
+  bool enable_shared_transport = false;
+  getSdfParam<bool>(_sdf, "enable_shared_transport", enable_shared_transport, false);
 
-  gps_pub_ = node_handle_->Advertise<msgs::Vector3d>("~/gps_position");
+  if (enable_shared_transport) {
+    int mavlink_system_id = 0;
+    getSdfParam<int>(_sdf, "mavlink_system_id", mavlink_system_id, 0);
+
+    mux_channel_ = MavlinkMultiplexer::Instance().Register(mavlink_udp_port_, mavlink_system_id);
+    if (!mux_channel_) {
+      gzerr << "[gazebo_mavlink_interface] could not register port " << mavlink_udp_port_
+            << " with the shared MAVLink transport\n";
+      return;
+    }
+    mavlink_link_ = mux_channel_.get();
+    gzmsg << "Using shared MAVLink transport.\n";
+  } else {
+    // try to setup udp socket for communcation with simulator
+    if ((_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+      printf("create socket failed\n");
+      return;
+    }
+
+    memset((char *)&_myaddr, 0, sizeof(_myaddr));
+    _myaddr.sin_family = AF_INET;
+    _myaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    // Let the OS pick the port
+    _myaddr.sin_port = htons(0);
+
+    if (bind(_fd, (struct sockaddr *)&_myaddr, sizeof(_myaddr)) < 0) {
+      printf("bind failed\n");
+      return;
+    }
+
+    fds[0].fd = _fd;
+    fds[0].events = POLLIN;
+
+    // Hand the socket to a dedicated thread, the world update then only
+    // exchanges messages through lock-free rings and never blocks on I/O.
+    bool enable_io_thread = false;
+    getSdfParam<bool>(_sdf, "enable_io_thread", enable_io_thread, false);
+    if (enable_io_thread) {
+      io_worker_.reset(new MavlinkIoWorker());
+      io_worker_->Start(_fd);
+      mavlink_link_ = io_worker_.get();
+      gzmsg << "MAVLink I/O thread enabled.\n";
+    }
+  }
 
   mavlink_status_t* chan_state = mavlink_get_channel_status(MAVLINK_COMM_0);
   chan_state->flags |= MAVLINK_STATUS_FLAG_OUT_MAVLINK1;
+
+  // Record everything sent to PX4, mavlink_replay_file plays it back later.
+  std::string record_file;
+  getSdfParam<std::string>(_sdf, "mavlink_record_file", record_file, "");
+  if (!record_file.empty() && !replay_reader_) {
+    double record_duration = kDefaultMavlinkRecordDuration;
+    getSdfParam<double>(_sdf, "mavlink_record_duration", record_duration, record_duration);
+    // a HIL_SENSOR per step plus the slower messages
+    const double step_size = world_->GetPhysicsEngine()->GetMaxStepSize();
+    const uint64_t capacity = static_cast<uint64_t>(std::ceil(record_duration * (1.0 / step_size + 100.0)));
+    mavlink_record_ = FlightRecordFile::Create<MavlinkRecord>(
+        record_file, FlightRecordStreamName(model_->GetName(), "mavlink"), capacity);
+    if (!mavlink_record_) {
+      gzerr << "[gazebo_mavlink_interface] Could not create " << record_file << ".\n";
+    }
+  }
+
+  if (replay_reader_) {
+    gzmsg << "[gazebo_mavlink_interface] Replaying " << replay_reader_->Size() << " messages from "
+          << replay_file << ".\n";
+    replay_thread_ = std::thread(&GazeboMavlinkInterface::ReplayThread, this);
+  }
 }
 
 // This gets called by the world update start event.
 void GazeboMavlinkInterface::OnUpdate(const common::UpdateInfo& /*_info*/) {
+  ScopedProbe probe(update_probe_.get());
 
   common::Time current_time = world_->GetSimTime();
   double dt = (current_time - last_time_).Double();
 
-  pollForMAVLinkMessages(dt, 1000);
+  if (enable_lockstep_ && received_first_referenc_) {
+    waitForActuatorControls(lockstep_timeout_ms_);
+  } else {
+    pollForMAVLinkMessages(dt, 0);
+  }
 
   handle_control(dt);
 
-  if (received_first_referenc_) {
+  if (!gps_warned_ && !gps_received_ && gps_sub_ && current_time.Double() > kGpsWarnTimeout) {
+    gzwarn << "[gazebo_mavlink_interface] No GPS sample on " << gps_sub_topic_ << " after "
+           << kGpsWarnTimeout << " s, is libgazebo_gps_plugin.so loaded by model "
+           << model_->GetName() << "?\n";
+    gps_warned_ = true;
+  }
 
-    mav_msgs::msgs::CommandMotorSpeed turning_velocities_msg;
+  if (received_first_referenc_) {
 
+    double motor_speeds[n_out_max];
     for (int i = 0; i < input_reference_.size(); i++){
-      if (last_actuator_time_ == 0 || (current_time - last_actuator_time_).Double() > 0.2) {
-        turning_velocities_msg.add_motor_speed(0);
-      } else {
-        turning_velocities_msg.add_motor_speed(input_reference_[i]);
-      }
+      motor_speeds[i] = actuator_timed_out_ ? 0.0 : input_reference_[i];
     }
-    // TODO Add timestamp and Header
-    // turning_velocities_msg->header.stamp.sec = current_time.sec;
-    // turning_velocities_msg->header.stamp.nsec = current_time.nsec;
+    actuator_commands_->Write(current_time.Double(), motor_speeds, input_reference_.size());
+
+    // Rate limited copy on gazebo transport for listeners outside this process.
+    if (motor_velocity_reference_pub_.Ready(current_time.Double())) {
+      mav_msgs::msgs::CommandMotorSpeed turning_velocities_msg;
+
+      for (int i = 0; i < input_reference_.size(); i++){
+        turning_velocities_msg.add_motor_speed(motor_speeds[i]);
+      }
+      // TODO Add timestamp and Header
+      // turning_velocities_msg->header.stamp.sec = current_time.sec;
+      // turning_velocities_msg->header.stamp.nsec = current_time.nsec;
 
-    // gzerr << turning_velocities_msg.motor_speed(0) << "\n";
-    motor_velocity_reference_pub_->Publish(turning_velocities_msg);
+      motor_velocity_reference_pub_.Publish(turning_velocities_msg, current_time.Double());
+    }
   }
 
   last_time_ = current_time;
+}
 
-  //send gps
+// Vision position estimate, called every ev_update_interval_ of sim time.
+void GazeboMavlinkInterface::VisionCallback(double /*_due*/) {
+  const double dt_ev = ev_update_interval_;
   math::Pose T_W_I = model_->GetWorldPose(); //TODO(burrimi): Check tf.
-  math::Vector3 pos_W_I = T_W_I.pos;  // Use the models' world position for GPS and pressure alt.
-
-  math::Vector3 velocity_current_W = model_->GetWorldLinearVel();  // Use the models' world position for GPS velocity.
-
-  math::Vector3 velocity_current_W_xy = velocity_current_W;
-  velocity_current_W_xy.z = 0;
-
-  // TODO: Remove GPS message from IMU plugin. Added gazebo GPS plugin. This is temp here.
-  // reproject local position to gps coordinates
-  double x_rad = pos_W_I.y / earth_radius; // north
-  double y_rad = pos_W_I.x / earth_radius; // east
-  double c = sqrt(x_rad * x_rad + y_rad * y_rad);
-  double sin_c = sin(c);
-  double cos_c = cos(c);
-  if (c != 0.0) {
-    lat_rad = asin(cos_c * sin(lat_home) + (x_rad * sin_c * cos(lat_home)) / c);
-    lon_rad = (lon_home + atan2(y_rad * sin_c, c * cos(lat_home) * cos_c - x_rad * sin(lat_home) * sin_c));
-  } else {
-    lat_rad = lat_home;
-    lon_rad = lon_home;
-  }
+  math::Vector3 pos_W_I = T_W_I.pos;  // Use the models' world position for vision.
+
+  //update noise paramters
+  double noise[6];
+  noise_.FillGaussian(noise, 6, kEvNoiseStdDev);
+  double noise_ev_x = ev_noise_density*sqrt(dt_ev)*noise[0];
+  double noise_ev_y = ev_noise_density*sqrt(dt_ev)*noise[1];
+  double noise_ev_z = ev_noise_density*sqrt(dt_ev)*noise[2];
+  double random_walk_ev_x = ev_random_walk*sqrt(dt_ev)*noise[3];
+  double random_walk_ev_y = ev_random_walk*sqrt(dt_ev)*noise[4];
+  double random_walk_ev_z = ev_random_walk*sqrt(dt_ev)*noise[5];
+  // bias integration, with the physics step like before the vision timer
+  const double dt = world_->GetPhysicsEngine()->GetMaxStepSize();
+  ev_bias_x_ += random_walk_ev_x*dt - ev_bias_x_/ev_corellation_time;
+  ev_bias_y_ += random_walk_ev_y*dt - ev_bias_y_/ev_corellation_time;
+  ev_bias_z_ += random_walk_ev_z*dt - ev_bias_z_/ev_corellation_time;
+
+  mavlink_vision_position_estimate_t vp_msg;
+
+  vp_msg.usec = world_->GetSimTime().Double() * 1e6;
+  vp_msg.y = pos_W_I.x + noise_ev_x + ev_bias_x_;
+  vp_msg.x = pos_W_I.y + noise_ev_y + ev_bias_y_;
+  vp_msg.z = -pos_W_I.z + noise_ev_z + ev_bias_z_;
+  vp_msg.roll = T_W_I.rot.GetRoll();
+  vp_msg.pitch = -T_W_I.rot.GetPitch();
+  vp_msg.yaw = -T_W_I.rot.GetYaw() + M_PI/2.0;
+
+  mavlink_message_t msg_;
+  mavlink_msg_vision_position_estimate_encode_chan(1, 200, MAVLINK_COMM_0, &msg_, &vp_msg);
+  send_mavlink_message(&msg_);
+}
 
-  double dt_gps = current_time.Double() - last_gps_time_.Double();
-  if (current_time.Double() - last_gps_time_.Double() > gps_update_interval_ - gps_delay_) {  // 120 ms delay
-    //update noise paramters
-    double noise_gps_x = gps_noise_density*sqrt(dt_gps)*standard_normal_distribution_(random_generator_);
-    double noise_gps_y = gps_noise_density*sqrt(dt_gps)*standard_normal_distribution_(random_generator_);
-    double noise_gps_z = gps_noise_density*sqrt(dt_gps)*standard_normal_distribution_(random_generator_);
-    double random_walk_gps_x = gps_random_walk*standard_normal_distribution_(random_generator_);
-    double random_walk_gps_y = gps_random_walk*standard_normal_distribution_(random_generator_);
-    double random_walk_gps_z = gps_random_walk*standard_normal_distribution_(random_generator_);
-    // bias integration
-    gps_bias_x_ += random_walk_gps_x - gps_bias_x_/gps_corellation_time;
-    gps_bias_y_ += random_walk_gps_y - gps_bias_y_/gps_corellation_time;
-    gps_bias_z_ += random_walk_gps_z - gps_bias_z_/gps_corellation_time;
-
-    // standard deviation of random walk
-    double std_xy = gps_random_walk*gps_corellation_time/sqrtf(2*gps_corellation_time-1);
-    double std_z = std_xy;
-
-    // Raw UDP mavlink
-    hil_gps_msg_.time_usec = current_time.Double() * 1e6;
-    hil_gps_msg_.fix_type = 3;
-    hil_gps_msg_.lat = (lat_rad * 180 / M_PI + (noise_gps_x + gps_bias_x_)*1e-5) * 1e7; // at the standard home coords, 1m is about 1e-5 deg
-    hil_gps_msg_.lon = (lon_rad * 180 / M_PI + (noise_gps_y + gps_bias_y_)*1e-5) * 1e7; // at the standard home coords, 1m is about 1e-5 deg
-    hil_gps_msg_.alt = (pos_W_I.z + alt_home) * 1000 + noise_gps_z + gps_bias_z_;
-    hil_gps_msg_.eph = 100*(std_xy + gps_noise_density*gps_noise_density);
-    hil_gps_msg_.epv = 100*(std_z  + gps_noise_density*gps_noise_density);
-    hil_gps_msg_.vel = velocity_current_W_xy.GetLength() * 100;
-    hil_gps_msg_.vn = velocity_current_W.y * 100;
-    hil_gps_msg_.ve = velocity_current_W.x * 100;
-    hil_gps_msg_.vd = -velocity_current_W.z * 100;
-
-    // MAVLINK_HIL_GPS_T CoG is [0, 360]. math::Angle::Normalize() is [-pi, pi].
-    math::Angle cog(atan2(velocity_current_W.x, velocity_current_W.y));
-    cog.Normalize();
-    hil_gps_msg_.cog = static_cast<uint16_t>(GetDegrees360(cog) * 100.0);
-    hil_gps_msg_.satellites_visible = 10;
+// Reprojects the vehicle position to lat_rad, lon_rad, at most once a step
+// and only for steps that send magnetometer data.
+void GazeboMavlinkInterface::UpdateGeoPosition() {
+  const double sim_time = world_->GetSimTime().Double();
+  if (sim_time == geo_time_) {
+    return;
   }
+  const math::Vector3 pos_W_I = model_->GetWorldPose().pos;
+  geo_projection_.Reproject(pos_W_I.x, pos_W_I.y, &lat_rad, &lon_rad);
+  geo_time_ = sim_time;
+}
 
-  if (current_time.Double() - last_gps_time_.Double() > gps_update_interval_) {  // 5Hz
-    mavlink_message_t msg;
-    mavlink_msg_hil_gps_encode_chan(1, 200, MAVLINK_COMM_0, &msg, &hil_gps_msg_);
-    send_mavlink_message(&msg);
+// This gets called by the world update end event.
+void GazeboMavlinkInterface::OnUpdateEnd() {
+  ScopedProbe probe(update_end_probe_.get());
+  flushMAVLinkMessages();
+}
 
-    msgs::Vector3d gps_msg;
-    gps_msg.set_x(lat_rad * 180. / M_PI);
-    gps_msg.set_y(lon_rad * 180. / M_PI);
-    gps_msg.set_z(hil_gps_msg_.alt / 1000.f);
-    gps_pub_->Publish(gps_msg);
+void GazeboMavlinkInterface::send_mavlink_message(const mavlink_message_t *message, const int destination_port)
+{
+  std::lock_guard<std::mutex> lock(tx_mutex_);
 
-    last_gps_time_ = current_time;
+  // only happens if a lot of messages arrive between two world updates
+  if (tx_queue_len_ == n_tx_queue_max) {
+    sendQueuedMessages();
   }
 
-  // vision position estimate
-  double dt_ev = current_time.Double() - last_ev_time_.Double();
-  if (dt_ev > ev_update_interval_) {
-    //update noise paramters
-    double noise_ev_x = ev_noise_density*sqrt(dt_ev)*standard_normal_distribution_(random_generator_);
-    double noise_ev_y = ev_noise_density*sqrt(dt_ev)*standard_normal_distribution_(random_generator_);
-    double noise_ev_z = ev_noise_density*sqrt(dt_ev)*standard_normal_distribution_(random_generator_);
-    double random_walk_ev_x = ev_random_walk*sqrt(dt_ev)*standard_normal_distribution_(random_generator_);
-    double random_walk_ev_y = ev_random_walk*sqrt(dt_ev)*standard_normal_distribution_(random_generator_);
-    double random_walk_ev_z = ev_random_walk*sqrt(dt_ev)*standard_normal_distribution_(random_generator_);
-    // bias integration
-    ev_bias_x_ += random_walk_ev_x*dt - ev_bias_x_/ev_corellation_time;
-    ev_bias_y_ += random_walk_ev_y*dt - ev_bias_y_/ev_corellation_time;
-    ev_bias_z_ += random_walk_ev_z*dt - ev_bias_z_/ev_corellation_time;
-
-    mavlink_vision_position_estimate_t vp_msg;
-
-    vp_msg.usec = current_time.Double() * 1e6;
-    vp_msg.y = pos_W_I.x + noise_ev_x + ev_bias_x_;
-    vp_msg.x = pos_W_I.y + noise_ev_y + ev_bias_y_;
-    vp_msg.z = -pos_W_I.z + noise_ev_z + ev_bias_z_;
-    vp_msg.roll = T_W_I.rot.GetRoll();
-    vp_msg.pitch = -T_W_I.rot.GetPitch();
-    vp_msg.yaw = -T_W_I.rot.GetYaw() + M_PI/2.0;
-
-    mavlink_message_t msg_;
-    mavlink_msg_vision_position_estimate_encode_chan(1, 200, MAVLINK_COMM_0, &msg_, &vp_msg);
-    send_mavlink_message(&msg_);
-
-    last_ev_time_ = current_time;
+  MavlinkTxPacket &packet = tx_queue_[tx_queue_len_++];
+  packet.len = mavlink_msg_to_send_buffer(packet.data, message);
+  memcpy(&packet.dest_addr, &_srcaddr, sizeof(_srcaddr));
+
+  if (destination_port != 0) {
+    packet.dest_addr.sin_port = htons(destination_port);
+  } else if (mavlink_record_) {
+    MavlinkRecord record;
+    record.sim_time = world_->GetSimTime().Double();
+    record.msgid = message->msgid;
+    record.len = packet.len;
+    memcpy(record.packet, packet.data, packet.len);
+    memset(record.packet + packet.len, 0, sizeof(record.packet) - packet.len);
+    mavlink_record_->Append(&record);
   }
 }
 
-void GazeboMavlinkInterface::send_mavlink_message(const mavlink_message_t *message, const int destination_port)
+void GazeboMavlinkInterface::flushMAVLinkMessages()
 {
-  uint8_t buffer[MAVLINK_MAX_PACKET_LEN];
-  int packetlen = mavlink_msg_to_send_buffer(buffer, message);
-
-  struct sockaddr_in dest_addr;
-  memcpy(&dest_addr, &_srcaddr, sizeof(_srcaddr));
+  std::lock_guard<std::mutex> lock(tx_mutex_);
+  sendQueuedMessages();
+}
 
-  if (destination_port != 0) {
-    dest_addr.sin_port = htons(destination_port);
+// Must be called with tx_mutex_ held.
+void GazeboMavlinkInterface::sendQueuedMessages()
+{
+  if (tx_queue_len_ == 0) {
+    return;
   }
 
-  ssize_t len = sendto(_fd, buffer, packetlen, 0, (struct sockaddr *)&_srcaddr, sizeof(_srcaddr));
-
-  if (len <= 0) {
-    printf("Failed sending mavlink message\n");
+  if (mavlink_link_) {
+    for (unsigned i = 0; i < tx_queue_len_; ++i) {
+      mavlink_link_->Send(tx_queue_[i]);
+    }
+  } else {
+    send_mavlink_packets(_fd, tx_queue_, tx_queue_len_);
   }
+
+  tx_queue_len_ = 0;
 }
 
-void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
+void GazeboMavlinkInterface::ImuCallback(const ImuSample& imu_message) {
+  ScopedProbe probe(imu_probe_.get());
 
   // frames
   // g - gazebo (ENU), east, north, up
@@ -670,10 +779,10 @@ void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
   // b - px4 (FRD) forward, right down
   // n - px4 (NED) north, east, down
   math::Quaternion q_gr = math::Quaternion(
-    imu_message->orientation().w(),
-    imu_message->orientation().x(),
-    imu_message->orientation().y(),
-    imu_message->orientation().z());
+    imu_message.orientation[0],
+    imu_message.orientation[1],
+    imu_message.orientation[2],
+    imu_message.orientation[3]);
 
 
   // q_br
@@ -709,29 +818,34 @@ void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
 
   //gzerr << "got imu: " << C_W_I << "\n";
   //gzerr << "got pose: " << T_W_I.rot << "\n";
-  float declination = get_mag_declination(lat_rad, lon_rad);
+  // frame d is the magnetic north frame, the field has no east component
+  // in it and is rotated by the declination into the n-frame
+  UpdateGeoPosition();
+  const GeoMagSample &mag_field = mag_field_->Lookup(lat_rad, lon_rad);
+  mag_d_.x = mag_field.horizontal;
+  mag_d_.y = 0;
+  mag_d_.z = -mag_field.vertical;
 
-  math::Quaternion q_dn(0.0, 0.0, declination);
+  math::Quaternion q_dn(0.0, 0.0, mag_field.declination);
   math::Vector3 mag_n = q_dn.RotateVectorReverse(mag_d_);
 
   math::Vector3 vel_b = q_br.RotateVector(model_->GetRelativeLinearVel());
   math::Vector3 vel_n = q_ng.RotateVector(model_->GetWorldLinearVel());
   math::Vector3 omega_nb_b = q_br.RotateVector(model_->GetRelativeAngularVel());
 
-  standard_normal_distribution_ = std::normal_distribution<float>(0, 0.01f);
-  math::Vector3 mag_noise_b(
-    standard_normal_distribution_(random_generator_),
-    standard_normal_distribution_(random_generator_),
-    standard_normal_distribution_(random_generator_));
+  // magnetometer noise (x, y, z) and barometer noise
+  double noise[4];
+  noise_.FillGaussian(noise, 4);
+  math::Vector3 mag_noise_b(noise[0] * 0.01, noise[1] * 0.01, noise[2] * 0.01);
 
   math::Vector3 accel_b = q_br.RotateVector(math::Vector3(
-    imu_message->linear_acceleration().x(),
-    imu_message->linear_acceleration().y(),
-    imu_message->linear_acceleration().z()));
+    imu_message.linear_acceleration[0],
+    imu_message.linear_acceleration[1],
+    imu_message.linear_acceleration[2]));
   math::Vector3 gyro_b = q_br.RotateVector(math::Vector3(
-    imu_message->angular_velocity().x(),
-    imu_message->angular_velocity().y(),
-    imu_message->angular_velocity().z()));
+    imu_message.angular_velocity[0],
+    imu_message.angular_velocity[1],
+    imu_message.angular_velocity[2]));
   math::Vector3 mag_b = q_nb.RotateVectorReverse(mag_n) + mag_noise_b;
 
   mavlink_hil_sensor_t sensor_msg;
@@ -749,16 +863,8 @@ void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
   float rho = 1.2754f; // density of air, TODO why is this not 1.225 as given by std. atmos.
   sensor_msg.diff_pressure = 0.5f*rho*vel_b.x*vel_b.x / 100;
 
-  float p1, p2;
-
   // need to add noise to pressure alt
-  do {
-      p1 = rand() * (1.0 / RAND_MAX);
-      p2 = rand() * (1.0 / RAND_MAX);
-  } while (p1 <= FLT_EPSILON);
-
-  float n = sqrtf(-2.0 * logf(p1)) * cosf(2.0f * M_PI * p2);
-  float alt_n = -pos_n.z + n * sqrtf(0.006f);
+  float alt_n = -pos_n.z + noise[3] * sqrtf(0.006f);
 
   sensor_msg.pressure_alt = (std::isfinite(alt_n)) ? alt_n : -pos_n.z;
   sensor_msg.temperature = 0.0;
@@ -775,6 +881,7 @@ void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
   mavlink_message_t msg;
   mavlink_msg_hil_sensor_encode_chan(1, 200, MAVLINK_COMM_0, &msg, &sensor_msg);
   send_mavlink_message(&msg);
+  hil_sensor_pending_ = true;
 
   // ground truth
   math::Vector3 accel_true_b = q_br.RotateVector(model_->GetRelativeLinearAccel());
@@ -793,7 +900,7 @@ void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
 
   hil_state_quat.lat = lat_rad * 180 / M_PI * 1e7;
   hil_state_quat.lon = lon_rad * 180 / M_PI * 1e7;
-  hil_state_quat.alt = (-pos_n.z + alt_home) * 1000;
+  hil_state_quat.alt = (-pos_n.z + alt_home_) * 1000;
 
   hil_state_quat.vx = vel_n.x * 100;
   hil_state_quat.vy = vel_n.y * 100;
@@ -811,19 +918,42 @@ void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
   send_mavlink_message(&msg);
 }
 
-void GazeboMavlinkInterface::LidarCallback(LidarPtr& lidar_message) {
+void GazeboMavlinkInterface::GpsCallback(const GpsSample& gps_message) {
+  gps_received_ = true;
+
+  mavlink_hil_gps_t hil_gps_msg;
+  hil_gps_msg.time_usec = gps_message.time * 1e6;
+  hil_gps_msg.fix_type = gps_message.fix_type;
+  hil_gps_msg.lat = gps_message.latitude * 1e7;
+  hil_gps_msg.lon = gps_message.longitude * 1e7;
+  hil_gps_msg.alt = gps_message.altitude * 1000;
+  hil_gps_msg.eph = gps_message.eph * 100;
+  hil_gps_msg.epv = gps_message.epv * 100;
+  hil_gps_msg.vel = gps_message.ground_speed * 100;
+  hil_gps_msg.vn = gps_message.velocity_north * 100;
+  hil_gps_msg.ve = gps_message.velocity_east * 100;
+  hil_gps_msg.vd = gps_message.velocity_down * 100;
+  hil_gps_msg.cog = static_cast<uint16_t>(gps_message.course_over_ground * 100.0);
+  hil_gps_msg.satellites_visible = gps_message.satellites_visible;
+
+  mavlink_message_t msg;
+  mavlink_msg_hil_gps_encode_chan(1, 200, MAVLINK_COMM_0, &msg, &hil_gps_msg);
+  send_mavlink_message(&msg);
+}
+
+void GazeboMavlinkInterface::LidarCallback(const RangeSample& lidar_message) {
   mavlink_distance_sensor_t sensor_msg;
-  sensor_msg.time_boot_ms = lidar_message->time_msec();
-  sensor_msg.min_distance = lidar_message->min_distance() * 100.0;
-  sensor_msg.max_distance = lidar_message->max_distance() * 100.0;
-  sensor_msg.current_distance = lidar_message->current_distance() * 100.0;
+  sensor_msg.time_boot_ms = lidar_message.time_msec;
+  sensor_msg.min_distance = lidar_message.min_distance * 100.0;
+  sensor_msg.max_distance = lidar_message.max_distance * 100.0;
+  sensor_msg.current_distance = lidar_message.current_distance * 100.0;
   sensor_msg.type = 0;
   sensor_msg.id = 0;
   sensor_msg.orientation = 25; //downward facing
   sensor_msg.covariance = 0;
 
   //distance needed for optical flow message
-  optflow_distance = lidar_message->current_distance(); //[m]
+  optflow_distance = lidar_message.current_distance; //[m]
 
   mavlink_message_t msg;
   mavlink_msg_distance_sensor_encode_chan(1, 200, MAVLINK_COMM_0, &msg, &sensor_msg);
@@ -831,19 +961,19 @@ void GazeboMavlinkInterface::LidarCallback(LidarPtr& lidar_message) {
 
 }
 
-void GazeboMavlinkInterface::OpticalFlowCallback(OpticalFlowPtr& opticalFlow_message) {
+void GazeboMavlinkInterface::OpticalFlowCallback(const OpticalFlowSample& opticalFlow_message) {
   mavlink_hil_optical_flow_t sensor_msg;
   sensor_msg.time_usec = world_->GetSimTime().Double() * 1e6;
-  sensor_msg.sensor_id = opticalFlow_message->sensor_id();
-  sensor_msg.integration_time_us = opticalFlow_message->integration_time_us();
-  sensor_msg.integrated_x = opticalFlow_message->integrated_x();
-  sensor_msg.integrated_y = opticalFlow_message->integrated_y();
-  sensor_msg.integrated_xgyro = opticalFlow_message->quality() ? -optflow_gyro.y : 0.0f; //xy switched
-  sensor_msg.integrated_ygyro = opticalFlow_message->quality() ? optflow_gyro.x : 0.0f; //xy switched
-  sensor_msg.integrated_zgyro = opticalFlow_message->quality() ? -optflow_gyro.z : 0.0f; //change direction
-  sensor_msg.temperature = opticalFlow_message->temperature();
-  sensor_msg.quality = opticalFlow_message->quality();
-  sensor_msg.time_delta_distance_us = opticalFlow_message->time_delta_distance_us();
+  sensor_msg.sensor_id = opticalFlow_message.sensor_id;
+  sensor_msg.integration_time_us = opticalFlow_message.integration_time_us;
+  sensor_msg.integrated_x = opticalFlow_message.integrated_x;
+  sensor_msg.integrated_y = opticalFlow_message.integrated_y;
+  sensor_msg.integrated_xgyro = opticalFlow_message.quality ? -optflow_gyro.y : 0.0f; //xy switched
+  sensor_msg.integrated_ygyro = opticalFlow_message.quality ? optflow_gyro.x : 0.0f; //xy switched
+  sensor_msg.integrated_zgyro = opticalFlow_message.quality ? -optflow_gyro.z : 0.0f; //change direction
+  sensor_msg.temperature = opticalFlow_message.temperature;
+  sensor_msg.quality = opticalFlow_message.quality;
+  sensor_msg.time_delta_distance_us = opticalFlow_message.time_delta_distance_us;
   sensor_msg.distance = optflow_distance;
 
   //reset gyro integral
@@ -854,12 +984,12 @@ void GazeboMavlinkInterface::OpticalFlowCallback(OpticalFlowPtr& opticalFlow_mes
   send_mavlink_message(&msg);
 }
 
-void GazeboMavlinkInterface::SonarCallback(SonarSensPtr& sonar_message) {
+void GazeboMavlinkInterface::SonarCallback(const RangeSample& sonar_message) {
   mavlink_distance_sensor_t sensor_msg;
   sensor_msg.time_boot_ms = world_->GetSimTime().Double() * 1e3;
-  sensor_msg.min_distance = sonar_message->min_distance() * 100.0;
-  sensor_msg.max_distance = sonar_message->max_distance() * 100.0;
-  sensor_msg.current_distance = sonar_message->current_distance() * 100.0;
+  sensor_msg.min_distance = sonar_message.min_distance * 100.0;
+  sensor_msg.max_distance = sonar_message.max_distance * 100.0;
+  sensor_msg.current_distance = sonar_message.current_distance * 100.0;
   sensor_msg.type = 1;
   sensor_msg.id = 1;
   sensor_msg.orientation = 0; // forward facing
@@ -870,16 +1000,16 @@ void GazeboMavlinkInterface::SonarCallback(SonarSensPtr& sonar_message) {
   send_mavlink_message(&msg);
 }
 
-void GazeboMavlinkInterface::IRLockCallback(IRLockPtr& irlock_message) {
+void GazeboMavlinkInterface::IRLockCallback(const IRLockSample& irlock_message) {
 
   mavlink_landing_target_t sensor_msg;
 
   sensor_msg.time_usec = world_->GetSimTime().Double() * 1e6;
-  sensor_msg.target_num = irlock_message->signature();
-  sensor_msg.angle_x = irlock_message->pos_x();
-  sensor_msg.angle_y = irlock_message->pos_y();
-  sensor_msg.size_x = irlock_message->size_x();
-  sensor_msg.size_y = irlock_message->size_y();
+  sensor_msg.target_num = irlock_message.signature;
+  sensor_msg.angle_x = irlock_message.pos_x;
+  sensor_msg.angle_y = irlock_message.pos_y;
+  sensor_msg.size_x = irlock_message.size_x;
+  sensor_msg.size_y = irlock_message.size_y;
   sensor_msg.position_valid = false;
   sensor_msg.type = LANDING_TARGET_TYPE_LIGHT_BEACON;
 
@@ -909,17 +1039,30 @@ void GazeboMavlinkInterface::IRLockCallback(IRLockPtr& irlock_message) {
 
 void GazeboMavlinkInterface::pollForMAVLinkMessages(double _dt, uint32_t _timeoutMs)
 {
-  // convert timeout in ms to timeval
-  struct timeval tv;
-  tv.tv_sec = _timeoutMs / 1000;
-  tv.tv_usec = (_timeoutMs % 1000) * 1000UL;
+  if (mavlink_link_) {
+    // the I/O thread already decoded everything, just empty its ring
+    if (_timeoutMs > 0) {
+      mavlink_link_->WaitForMessage(_timeoutMs);
+    }
 
-  // poll
-  ::poll(&fds[0], (sizeof(fds[0])/sizeof(fds[0])), 0);
+    mavlink_message_t msg;
+    while (mavlink_link_->Receive(&msg)) {
+      handle_message(&msg);
+    }
+    // like recvfrom() below, answer where PX4 sends from
+    mavlink_link_->RemoteAddress(&_srcaddr);
+  } else {
+    // poll, returns immediately for a zero timeout
+    ::poll(&fds[0], (sizeof(fds[0])/sizeof(fds[0])), _timeoutMs);
+
+    if (!(fds[0].revents & POLLIN)) {
+      return;
+    }
 
-  if (fds[0].revents & POLLIN) {
-    int len = recvfrom(_fd, _buf, sizeof(_buf), 0, (struct sockaddr *)&_srcaddr, &_addrlen);
-    if (len > 0) {
+    // Drain everything that queued up since the last step, otherwise bursts
+    // from PX4 add several steps of latency to the control loop.
+    int len;
+    while ((len = recvfrom(_fd, _buf, sizeof(_buf), MSG_DONTWAIT, (struct sockaddr *)&_srcaddr, &_addrlen)) > 0) {
       mavlink_message_t msg;
       mavlink_status_t status;
       for (unsigned i = 0; i < len; ++i)
@@ -932,44 +1075,182 @@ void GazeboMavlinkInterface::pollForMAVLinkMessages(double _dt, uint32_t _timeou
       }
     }
   }
+
+  // only the newest actuator controls are of interest
+  if (actuator_controls_pending_) {
+    handle_actuator_controls(actuator_controls_);
+    actuator_controls_pending_ = false;
+  }
+}
+
+void GazeboMavlinkInterface::waitForActuatorControls(uint32_t _timeoutMs)
+{
+  // Nothing to wait for until the first HIL_SENSOR of a step went out.
+  if (!hil_sensor_pending_) {
+    pollForMAVLinkMessages(0, 0);
+    return;
+  }
+
+  // The HIL_SENSOR might still be queued if it arrived after the last flush.
+  flushMAVLinkMessages();
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_timeoutMs);
+
+  while (hil_sensor_pending_) {
+    const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+
+    if (remaining <= 0) {
+      // Do not stall physics forever if PX4 went away, just fall back to
+      // free running for this step.
+      if (lockstep_timeouts_++ == 0) {
+        gzwarn << "Lockstep: no actuator controls from PX4 within " << _timeoutMs << " ms.\n";
+      }
+      hil_sensor_pending_ = false;
+      break;
+    }
+
+    pollForMAVLinkMessages(0, remaining);
+  }
+}
+
+// Sends the recorded packets one step at a time. With lockstep each step
+// waits for PX4 to answer its HIL_SENSOR, so the replay runs as fast as PX4
+// computes, otherwise it follows the recorded sim time at replay_speed_.
+void GazeboMavlinkInterface::ReplayThread()
+{
+  const uint64_t count = replay_reader_->Size();
+  const double first_time = count > 0 ? replay_reader_->Get<MavlinkRecord>(0)->sim_time : 0.0;
+  double step_time = first_time;
+
+  // Messages sent before PX4 listens would be lost and the replay would
+  // start somewhere else each time. PX4 may in turn wait for the simulator
+  // to connect, so it is probed with heartbeats, they are not recorded.
+  gzmsg << "[gazebo_mavlink_interface] Replay waits for PX4.\n";
+  auto next_probe = std::chrono::steady_clock::now();
+  while (!received_first_message_ && !replay_stop_) {
+    if (std::chrono::steady_clock::now() >= next_probe) {
+      mavlink_message_t msg;
+      mavlink_msg_heartbeat_pack_chan(1, 200, MAVLINK_COMM_0, &msg, MAV_TYPE_GENERIC,
+                                      MAV_AUTOPILOT_INVALID, 0, 0, 0);
+      send_mavlink_message(&msg);
+      flushMAVLinkMessages();
+      next_probe += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(kMavlinkReplayProbeInterval));
+    }
+    pollForMAVLinkMessages(0, 100);
+  }
+
+  // the recorded pace starts with PX4, not with Load
+  const auto wall_start = std::chrono::steady_clock::now();
+
+  uint64_t i = 0;
+  while (i < count && !replay_stop_) {
+    step_time = replay_reader_->Get<MavlinkRecord>(i)->sim_time;
+
+    if (!enable_lockstep_ && replay_speed_ > 0.0) {
+      std::this_thread::sleep_until(wall_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>((step_time - first_time) / replay_speed_)));
+    }
+
+    bool hil_sensor = false;
+    {
+      std::lock_guard<std::mutex> lock(tx_mutex_);
+      for (; i < count; ++i) {
+        const MavlinkRecord *record = replay_reader_->Get<MavlinkRecord>(i);
+        if (record->sim_time != step_time) {
+          break;
+        }
+        if (record->len > sizeof(tx_queue_[0].data)) {
+          continue;
+        }
+        if (tx_queue_len_ == n_tx_queue_max) {
+          sendQueuedMessages();
+        }
+        MavlinkTxPacket &packet = tx_queue_[tx_queue_len_++];
+        packet.len = record->len;
+        memcpy(packet.data, record->packet, record->len);
+        memcpy(&packet.dest_addr, &_srcaddr, sizeof(_srcaddr));
+        hil_sensor |= record->msgid == MAVLINK_MSG_ID_HIL_SENSOR;
+      }
+      sendQueuedMessages();
+    }
+
+    if (enable_lockstep_ && hil_sensor) {
+      hil_sensor_pending_ = true;
+      waitForActuatorControls(lockstep_timeout_ms_);
+    } else {
+      pollForMAVLinkMessages(0, 0);
+    }
+  }
+
+  const double wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+  gzmsg << "[gazebo_mavlink_interface] Replayed " << i << " messages, " << step_time - first_time
+        << " s of sim time in " << wall_time << " s.\n";
 }
 
 void GazeboMavlinkInterface::handle_message(mavlink_message_t *msg)
 {
+  received_first_message_ = true;
+
   switch(msg->msgid) {
   case MAVLINK_MSG_ID_HIL_ACTUATOR_CONTROLS:
     mavlink_hil_actuator_controls_t controls;
     mavlink_msg_hil_actuator_controls_decode(msg, &controls);
-    bool armed = false;
 
-    if ((controls.mode & MAV_MODE_FLAG_SAFETY_ARMED) > 0) {
-      armed = true;
+    // Reordered packets are older than what was already applied. A jump
+    // back of more than a second means PX4 restarted, accept it then.
+    if (controls.time_usec < last_actuator_controls_usec_
+        && last_actuator_controls_usec_ - controls.time_usec < 1000000) {
+      ++stale_actuator_controls_;
+      break;
     }
 
-    last_actuator_time_ = world_->GetSimTime();
-
-    for (unsigned i = 0; i < n_out_max; i++) {
-      input_index_[i] = i;
+    if (actuator_controls_pending_) {
+      ++dropped_actuator_controls_;
     }
 
-    // set rotor speeds, controller targets
-    input_reference_.resize(n_out_max);
-    for (int i = 0; i < input_reference_.size(); i++) {
-      if (armed) {
-        input_reference_[i] = (controls.controls[input_index_[i]] + input_offset_[i])
-          * input_scaling_[i] + zero_position_armed_[i];
-        // if (joints_[i])
-        //   gzerr << i << " : " << input_index_[i] << " : " << controls.controls[input_index_[i]] << " : " << input_reference_[i] << "\n";
-      } else {
-        input_reference_[i] = zero_position_disarmed_[i];
-      }
-    }
-
-    received_first_referenc_ = true;
+    last_actuator_controls_usec_ = controls.time_usec;
+    actuator_controls_ = controls;
+    actuator_controls_pending_ = true;
     break;
   }
 }
 
+void GazeboMavlinkInterface::handle_actuator_controls(const mavlink_hil_actuator_controls_t &controls)
+{
+  bool armed = false;
+
+  if ((controls.mode & MAV_MODE_FLAG_SAFETY_ARMED) > 0) {
+    armed = true;
+  }
+
+  if (actuator_timeout_) {
+    actuator_timed_out_ = false;
+    actuator_timeout_->Restart(kActuatorTimeout);
+  }
+
+  for (unsigned i = 0; i < n_out_max; i++) {
+    input_index_[i] = i;
+  }
+
+  // set rotor speeds, controller targets
+  input_reference_.resize(n_out_max);
+  for (int i = 0; i < input_reference_.size(); i++) {
+    if (armed) {
+      input_reference_[i] = (controls.controls[input_index_[i]] + input_offset_[i])
+        * input_scaling_[i] + zero_position_armed_[i];
+      // if (joints_[i])
+      //   gzerr << i << " : " << input_index_[i] << " : " << controls.controls[input_index_[i]] << " : " << input_reference_[i] << "\n";
+    } else {
+      input_reference_[i] = zero_position_disarmed_[i];
+    }
+  }
+
+  received_first_referenc_ = true;
+  hil_sensor_pending_ = false;
+}
+
 void GazeboMavlinkInterface::handle_control(double _dt)
 {
     // set joint positions
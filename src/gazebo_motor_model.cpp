@@ -31,8 +31,11 @@ GazeboMotorModel::~GazeboMotorModel() {
 void GazeboMotorModel::InitializeParams() {}
 
 void GazeboMotorModel::Publish() {
+  if (!motor_velocity_pub_.Ready(prev_sim_time_)) {
+    return;
+  }
   turning_velocity_msg_.set_data(joint_->GetVelocity(0));
-  motor_velocity_pub_->Publish(turning_velocity_msg_);
+  motor_velocity_pub_.Publish(turning_velocity_msg_, prev_sim_time_);
 }
 
 void GazeboMotorModel::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
@@ -96,6 +99,12 @@ void GazeboMotorModel::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
   link_ = model_->GetLink(link_name_);
   if (link_ == NULL)
     gzthrow("[gazebo_motor_model] Couldn't find specified link \"" << link_name_ << "\".");
+  // Getting the parent link, such that the resulting torques can be applied to it.
+  physics::Link_V parent_links = link_->GetParentJointsLinks();
+  if (parent_links.empty())
+    gzthrow("[gazebo_motor_model] Rotor link \"" << link_name_ << "\" has no parent link.");
+  parent_link_ = parent_links.at(0);
+  UpdateRotorAxis();
 
 
   if (_sdf->HasElement("motorNumber"))
@@ -118,6 +127,7 @@ void GazeboMotorModel::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
   getSdfParam<std::string>(_sdf, "commandSubTopic", command_sub_topic_, command_sub_topic_);
   getSdfParam<std::string>(_sdf, "motorSpeedPubTopic", motor_speed_pub_topic_,
                            motor_speed_pub_topic_);
+  getSdfParam<double>(_sdf, "motorSpeedPubRate", motor_speed_pub_rate_, motor_speed_pub_rate_);
 
   getSdfParam<double>(_sdf, "rotorDragCoefficient", rotor_drag_coefficient_, rotor_drag_coefficient_);
   getSdfParam<double>(_sdf, "rollingMomentCoefficient", rolling_moment_coefficient_,
@@ -142,9 +152,13 @@ void GazeboMotorModel::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
   // Listen to the update event. This event is broadcast every
   // simulation iteration.
   updateConnection_ = event::Events::ConnectWorldUpdateBegin(boost::bind(&GazeboMotorModel::OnUpdate, this, _1));
+  update_probe_ = StepProfiler::Instance().Register(model_->GetName() + "/" + GetHandle() + "/OnUpdate");
 
   command_sub_ = node_handle_->Subscribe<mav_msgs::msgs::CommandMotorSpeed>("~/" + model_->GetName() + command_sub_topic_, &GazeboMotorModel::VelocityCallback, this);
-  motor_velocity_pub_ = node_handle_->Advertise<std_msgs::msgs::Float>("~/" + model_->GetName() + motor_speed_pub_topic_, 1);
+  // Commands of an in-process writer (the mavlink interface) replace the subscription once they arrive.
+  actuator_commands_ = SensorBus::Instance().GetShared<ActuatorCommands>(
+      node_handle_->DecodeTopicName("~/" + model_->GetName() + command_sub_topic_));
+  motor_velocity_pub_.Advertise(node_handle_, "~/" + model_->GetName() + motor_speed_pub_topic_, motor_speed_pub_rate_);
 
   // Create the first order filter.
   rotor_velocity_filter_.reset(new FirstOrderFilter<double>(time_constant_up_, time_constant_down_, ref_motor_rot_vel_));
@@ -162,15 +176,38 @@ void GazeboMotorModel::testProto(MotorSpeedPtr &msg) {
 }
 */
 
+void GazeboMotorModel::Reset() {
+  UpdateRotorAxis();
+}
+
+void GazeboMotorModel::UpdateRotorAxis() {
+  // The tansformation from the parent_link to the link_.
+  math::Pose pose_difference = link_->GetWorldCoGPose() - parent_link_->GetWorldCoGPose();
+  rotor_axis_parent_ = pose_difference.rot.RotateVector(math::Vector3(0, 0, 1));
+}
+
 // This gets called by the world update start event.
 void GazeboMotorModel::OnUpdate(const common::UpdateInfo& _info) {
+  ScopedProbe probe(update_probe_.get());
   sampling_time_ = _info.simTime.Double() - prev_sim_time_;
   prev_sim_time_ = _info.simTime.Double();
+
+  double command;
+  if (actuator_commands_->Read(prev_sim_time_, motor_number_, &command)) {
+    ref_motor_rot_vel_ = std::min(command, max_rot_velocity_);
+    if (command_sub_) {
+      command_sub_.reset();
+    }
+  }
+
   UpdateForcesAndMoments();
   Publish();
 }
 
 void GazeboMotorModel::VelocityCallback(CommandMotorSpeedPtr &rot_velocities) {
+  if (actuator_commands_->Written()) {
+    return;
+  }
   if(rot_velocities->motor_speed_size() < motor_number_) {
     std::cout  << "You tried to access index " << motor_number_
       << " of the MotorSpeed message array which is of size " << rot_velocities->motor_speed_size() << "." << std::endl;
@@ -205,19 +242,15 @@ void GazeboMotorModel::UpdateForcesAndMoments() {
   // Apply air_drag to link.
   link_->AddForce(air_drag);
   // Moments
-  // Getting the parent link, such that the resulting torques can be applied to it.
-  physics::Link_V parent_links = link_->GetParentJointsLinks();
-  // The tansformation from the parent_link to the link_.
-  math::Pose pose_difference = link_->GetWorldCoGPose() - parent_links.at(0)->GetWorldCoGPose();
-  math::Vector3 drag_torque(0, 0, -turning_direction_ * force * moment_constant_);
-  // Transforming the drag torque into the parent frame to handle arbitrary rotor orientations.
-  math::Vector3 drag_torque_parent_frame = pose_difference.rot.RotateVector(drag_torque);
-  parent_links.at(0)->AddRelativeTorque(drag_torque_parent_frame);
+  // The drag torque acts along the rotor axis, expressed in the parent frame
+  // to handle arbitrary rotor orientations.
+  math::Vector3 drag_torque_parent_frame = rotor_axis_parent_ * (-turning_direction_ * force * moment_constant_);
+  parent_link_->AddRelativeTorque(drag_torque_parent_frame);
 
   math::Vector3 rolling_moment;
   // - \omega * \mu_1 * V_A^{\perp}
   rolling_moment = -std::abs(real_motor_velocity) * rolling_moment_coefficient_ * body_velocity_perpendicular;
-  parent_links.at(0)->AddTorque(rolling_moment);
+  parent_link_->AddTorque(rolling_moment);
   // Apply the filter on the motor's velocity.
   double ref_motor_rot_vel;
   ref_motor_rot_vel = rotor_velocity_filter_->updateFilter(ref_motor_rot_vel_, sampling_time_);
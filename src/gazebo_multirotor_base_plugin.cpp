@@ -38,11 +38,12 @@ void GazeboMultirotorBasePlugin::Load(physics::ModelPtr _model, sdf::ElementPtr
   getSdfParam<std::string>(_sdf, "motorPubTopic", motor_pub_topic_, motor_pub_topic_);
   getSdfParam<double>(_sdf, "rotorVelocitySlowdownSim", rotor_velocity_slowdown_sim_,
                       rotor_velocity_slowdown_sim_);
+  getSdfParam<double>(_sdf, "motorPubRate", motor_pub_rate_, motor_pub_rate_);
 
 
   node_handle_ = transport::NodePtr(new transport::Node());
   node_handle_->Init(namespace_);
-  motor_pub_ = node_handle_->Advertise<mav_msgs::msgs::MotorSpeed>("~/" + model_->GetName() + motor_pub_topic_, 1);
+  motor_pub_.Advertise(node_handle_, "~/" + model_->GetName() + motor_pub_topic_, motor_pub_rate_);
 
 
   frame_id_ = link_name_;
@@ -76,6 +77,10 @@ void GazeboMultirotorBasePlugin::Load(physics::ModelPtr _model, sdf::ElementPtr
 void GazeboMultirotorBasePlugin::OnUpdate(const common::UpdateInfo& _info) {
   // Get the current simulation time.
   common::Time now = world_->GetSimTime();
+  if (!motor_pub_.Ready(now.Double())) {
+    return;
+  }
+
   mav_msgs::msgs::MotorSpeed msg;
   MotorNumberToJointMap::iterator m;
   for (m = motor_joints_.begin(); m != motor_joints_.end(); ++m) {
@@ -84,7 +89,7 @@ void GazeboMultirotorBasePlugin::OnUpdate(const common::UpdateInfo& _info) {
   }
   // motor_pub_->WaitForConnection();
   // Add time header
-  motor_pub_->Publish(msg);
+  motor_pub_.Publish(msg, now.Double());
 }
 
 GZ_REGISTER_MODEL_PLUGIN(GazeboMultirotorBasePlugin);
@@ -0,0 +1,49 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gazebo_noise_plugin.h"
+
+#include <cstdlib>
+
+namespace gazebo {
+
+GZ_REGISTER_WORLD_PLUGIN(GazeboNoisePlugin)
+
+GazeboNoisePlugin::GazeboNoisePlugin()
+    : WorldPlugin()
+{
+}
+
+GazeboNoisePlugin::~GazeboNoisePlugin()
+{
+}
+
+void GazeboNoisePlugin::Load(physics::WorldPtr _world, sdf::ElementPtr _sdf)
+{
+  if (!_sdf->HasElement("seed")) {
+    gzmsg << "[gazebo_noise_plugin] No seed, using PX4_SIM_SEED " << NoiseStream::Seed() << "\n";
+    return;
+  }
+
+  // read as a string, sdf has no 64 bit unsigned parameters
+  const std::string seed = _sdf->GetElement("seed")->Get<std::string>();
+  NoiseStream::SetWorldSeed(_world->GetName(), std::strtoull(seed.c_str(), nullptr, 0));
+
+  gzmsg << "[gazebo_noise_plugin] Noise seed of world " << _world->GetName()
+        << ": " << NoiseStream::WorldSeed(_world->GetName()) << "\n";
+}
+
+}
@@ -124,6 +124,7 @@ this->camera = this->parentSensor->Camera();
   boost::replace_all(topicName, "::", "/");
 
   opticalFlow_pub_ = node_handle_->Advertise<opticalFlow_msgs::msgs::opticalFlow>(topicName, 10);
+  opticalFlow_bus_topic_ = SensorBus::Instance().GetTopic<OpticalFlowSample>(opticalFlow_pub_->GetTopic());
 
   this->newFrameConnection = this->camera->ConnectNewImageFrame(
       boost::bind(&OpticalFlowPlugin::OnNewFrame, this, _1, this->width, this->height, this->depth, this->format));
@@ -163,21 +164,39 @@ void OpticalFlowPlugin::OnNewFrame(const unsigned char * _image,
   int quality = optical_flow_->calcFlow((uchar*)_image, frame_time_us_, dt_us_, flow_x_ang, flow_y_ang);
 
   if (quality >= 0) { // calcFlow(...) returns -1 if data should not be published yet -> output_rate
-    //prepare optical flow message
-    opticalFlow_message.set_time_usec(0);//will be filled in simulator_mavlink.cpp
-    opticalFlow_message.set_sensor_id(2.0);
-    opticalFlow_message.set_integration_time_us(quality ? dt_us_ : 0);
-    opticalFlow_message.set_integrated_x(quality ? flow_x_ang : 0.0f);
-    opticalFlow_message.set_integrated_y(quality ? flow_y_ang : 0.0f);
-    opticalFlow_message.set_integrated_xgyro(0.0f); //get real values in gazebo_mavlink_interface.cpp
-    opticalFlow_message.set_integrated_ygyro(0.0f); //get real values in gazebo_mavlink_interface.cpp
-    opticalFlow_message.set_integrated_zgyro(0.0f); //get real values in gazebo_mavlink_interface.cpp
-    opticalFlow_message.set_temperature(20.0f);
-    opticalFlow_message.set_quality(quality);
-    opticalFlow_message.set_time_delta_distance_us(0);
-    opticalFlow_message.set_distance(0.0f); //get real values in gazebo_mavlink_interface.cpp
-    //send message
-    opticalFlow_pub_->Publish(opticalFlow_message);
+    //prepare optical flow sample
+    OpticalFlowSample sample;
+    sample.time_usec = 0;//will be filled in simulator_mavlink.cpp
+    sample.sensor_id = 2;
+    sample.integration_time_us = quality ? dt_us_ : 0;
+    sample.integrated_x = quality ? flow_x_ang : 0.0f;
+    sample.integrated_y = quality ? flow_y_ang : 0.0f;
+    sample.integrated_xgyro = 0.0f; //get real values in gazebo_mavlink_interface.cpp
+    sample.integrated_ygyro = 0.0f; //get real values in gazebo_mavlink_interface.cpp
+    sample.integrated_zgyro = 0.0f; //get real values in gazebo_mavlink_interface.cpp
+    sample.temperature = 20.0f;
+    sample.quality = quality;
+    sample.time_delta_distance_us = 0;
+    sample.distance = 0.0f; //get real values in gazebo_mavlink_interface.cpp
+    //send to in-process subscribers
+    opticalFlow_bus_topic_->Publish(sample);
+
+    //serialize only for subscribers outside the process
+    if (opticalFlow_pub_->HasConnections()) {
+      opticalFlow_message.set_time_usec(sample.time_usec);
+      opticalFlow_message.set_sensor_id(sample.sensor_id);
+      opticalFlow_message.set_integration_time_us(sample.integration_time_us);
+      opticalFlow_message.set_integrated_x(sample.integrated_x);
+      opticalFlow_message.set_integrated_y(sample.integrated_y);
+      opticalFlow_message.set_integrated_xgyro(sample.integrated_xgyro);
+      opticalFlow_message.set_integrated_ygyro(sample.integrated_ygyro);
+      opticalFlow_message.set_integrated_zgyro(sample.integrated_zgyro);
+      opticalFlow_message.set_temperature(sample.temperature);
+      opticalFlow_message.set_quality(sample.quality);
+      opticalFlow_message.set_time_delta_distance_us(sample.time_delta_distance_us);
+      opticalFlow_message.set_distance(sample.distance);
+      opticalFlow_pub_->Publish(opticalFlow_message);
+    }
     timer_.start();
   }
 }
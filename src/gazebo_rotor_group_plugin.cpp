@@ -0,0 +1,233 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gazebo_rotor_group_plugin.h"
+
+namespace gazebo {
+
+GZ_REGISTER_MODEL_PLUGIN(GazeboRotorGroupPlugin);
+
+GazeboRotorGroupPlugin::GazeboRotorGroupPlugin()
+    : ModelPlugin(),
+      command_sub_topic_(kDefaultCommandSubTopic),
+      prev_sim_time_(0.0),
+      aliasing_reported_(false)
+{
+}
+
+GazeboRotorGroupPlugin::~GazeboRotorGroupPlugin()
+{
+  event::Events::DisconnectWorldUpdateBegin(update_connection_);
+}
+
+void GazeboRotorGroupPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf)
+{
+  model_ = _model;
+
+  if (_sdf->HasElement("robotNamespace"))
+    namespace_ = _sdf->GetElement("robotNamespace")->Get<std::string>();
+  else
+    gzerr << "[gazebo_rotor_group] Please specify a robotNamespace.\n";
+  node_handle_ = transport::NodePtr(new transport::Node());
+  node_handle_->Init(namespace_);
+
+  getSdfParam<std::string>(_sdf, "commandSubTopic", command_sub_topic_, command_sub_topic_);
+
+  if (!_sdf->HasElement("rotor"))
+    gzthrow("[gazebo_rotor_group] Please specify at least one rotor.");
+
+  for (sdf::ElementPtr rotor = _sdf->GetElement("rotor"); rotor; rotor = rotor->GetNextElement("rotor")) {
+    LoadRotor(rotor);
+  }
+
+  update_connection_ = event::Events::ConnectWorldUpdateBegin(
+      boost::bind(&GazeboRotorGroupPlugin::OnUpdate, this, _1));
+  update_probe_ = StepProfiler::Instance().Register(model_->GetName() + "/" + GetHandle() + "/OnUpdate");
+
+  command_sub_ = node_handle_->Subscribe<mav_msgs::msgs::CommandMotorSpeed>(
+      "~/" + model_->GetName() + command_sub_topic_, &GazeboRotorGroupPlugin::VelocityCallback, this);
+  actuator_commands_ = SensorBus::Instance().GetShared<ActuatorCommands>(
+      node_handle_->DecodeTopicName("~/" + model_->GetName() + command_sub_topic_));
+}
+
+void GazeboRotorGroupPlugin::LoadRotor(sdf::ElementPtr _sdf)
+{
+  std::string joint_name;
+  if (!getSdfParam<std::string>(_sdf, "jointName", joint_name, ""))
+    gzthrow("[gazebo_rotor_group] Please specify a jointName for every rotor.");
+  physics::JointPtr joint = model_->GetJoint(joint_name);
+  if (joint == NULL)
+    gzthrow("[gazebo_rotor_group] Couldn't find specified joint \"" << joint_name << "\".");
+
+  std::string link_name;
+  if (!getSdfParam<std::string>(_sdf, "linkName", link_name, ""))
+    gzthrow("[gazebo_rotor_group] Please specify a linkName for every rotor.");
+  physics::LinkPtr link = model_->GetLink(link_name);
+  if (link == NULL)
+    gzthrow("[gazebo_rotor_group] Couldn't find specified link \"" << link_name << "\".");
+
+  // The geometry is resolved once against the common parent.
+  physics::Link_V parent_links = link->GetParentJointsLinks();
+  if (parent_links.empty())
+    gzthrow("[gazebo_rotor_group] Rotor link \"" << link_name << "\" has no parent link.");
+  if (!parent_) {
+    parent_ = parent_links.at(0);
+  } else if (parent_links.at(0) != parent_) {
+    gzthrow("[gazebo_rotor_group] Rotor link \"" << link_name << "\" is not attached to \""
+            << parent_->GetName() << "\" like the other rotors.");
+  }
+
+  int motor_number = 0;
+  if (!getSdfParam<int>(_sdf, "motorNumber", motor_number, 0))
+    gzerr << "[gazebo_rotor_group] Please specify a motorNumber.\n";
+
+  RotorGroupRotor rotor;
+  rotor.direction = turning_direction::CW;
+  std::string turning_direction;
+  if (getSdfParam<std::string>(_sdf, "turningDirection", turning_direction, "")) {
+    if (turning_direction == "cw")
+      rotor.direction = turning_direction::CW;
+    else if (turning_direction == "ccw")
+      rotor.direction = turning_direction::CCW;
+    else
+      gzerr << "[gazebo_rotor_group] Please only use 'cw' or 'ccw' as turningDirection.\n";
+  } else {
+    gzerr << "[gazebo_rotor_group] Please specify a turning direction ('cw' or 'ccw').\n";
+  }
+
+  getSdfParam<double>(_sdf, "maxRotVelocity", rotor.max_rot_velocity, kDefaulMaxRotVelocity);
+  getSdfParam<double>(_sdf, "motorConstant", rotor.motor_constant, kDefaultMotorConstant);
+  getSdfParam<double>(_sdf, "momentConstant", rotor.moment_constant, kDefaultMomentConstant);
+  getSdfParam<double>(_sdf, "rotorDragCoefficient", rotor.rotor_drag_coefficient,
+                      kDefaultRotorDragCoefficient);
+  getSdfParam<double>(_sdf, "rollingMomentCoefficient", rotor.rolling_moment_coefficient,
+                      kDefaultRollingMomentCoefficient);
+  getSdfParam<double>(_sdf, "rotorVelocitySlowdownSim", rotor.rotor_velocity_slowdown_sim,
+                      kDefaultRotorVelocitySlowdownSim);
+  getSdfParam<double>(_sdf, "timeConstantUp", rotor.time_constant_up, kDefaultTimeConstantUp);
+  getSdfParam<double>(_sdf, "timeConstantDown", rotor.time_constant_down, kDefaultTimeConstantDown);
+
+  // Rotor pose relative to the parent. Spinning about the joint axis moves
+  // neither the rotor origin nor its z axis, so this holds for the whole run.
+  const math::Pose &parent_pose = parent_->GetWorldPose();
+  const math::Pose rotor_pose = link->GetWorldPose() - parent_pose;
+  const math::Vector3 pos = rotor_pose.pos - parent_->GetInertial()->GetCoG();
+  const math::Vector3 thrust_axis = rotor_pose.rot.RotateVector(math::Vector3(0, 0, 1));
+  const math::Vector3 joint_axis = parent_pose.rot.RotateVectorReverse(joint->GetGlobalAxis(0));
+
+  rotor.position[0] = pos.x;
+  rotor.position[1] = pos.y;
+  rotor.position[2] = pos.z;
+  rotor.thrust_axis[0] = thrust_axis.x;
+  rotor.thrust_axis[1] = thrust_axis.y;
+  rotor.thrust_axis[2] = thrust_axis.z;
+  rotor.joint_axis[0] = joint_axis.x;
+  rotor.joint_axis[1] = joint_axis.y;
+  rotor.joint_axis[2] = joint_axis.z;
+  kernel_.AddRotor(rotor);
+
+  std::string motor_speed_pub_topic;
+  double motor_speed_pub_rate;
+  getSdfParam<double>(_sdf, "motorSpeedPubRate", motor_speed_pub_rate, kDefaultMotorSpeedPubRate);
+  ThrottledPublisher<std_msgs::msgs::Float> motor_velocity_pub;
+  if (getSdfParam<std::string>(_sdf, "motorSpeedPubTopic", motor_speed_pub_topic, "")) {
+    motor_velocity_pub.Advertise(node_handle_, "~/" + model_->GetName() + motor_speed_pub_topic,
+                                 motor_speed_pub_rate);
+  }
+
+  joints_.push_back(joint);
+  motor_velocity_pubs_.push_back(motor_velocity_pub);
+  motor_number_.push_back(motor_number);
+}
+
+void GazeboRotorGroupPlugin::Reset()
+{
+  kernel_.Reset();
+  prev_sim_time_ = 0.0;
+}
+
+void GazeboRotorGroupPlugin::VelocityCallback(CommandMotorSpeedPtr &_rot_velocities)
+{
+  if (actuator_commands_->Written()) {
+    return;
+  }
+
+  const int size = _rot_velocities->motor_speed_size();
+  for (size_t i = 0; i < motor_number_.size(); ++i) {
+    if (motor_number_[i] < size) {
+      kernel_.SetReference(i, _rot_velocities->motor_speed(motor_number_[i]));
+    }
+  }
+}
+
+void GazeboRotorGroupPlugin::OnUpdate(const common::UpdateInfo &_info)
+{
+  ScopedProbe probe(update_probe_.get());
+
+  const double sampling_time = _info.simTime.Double() - prev_sim_time_;
+  prev_sim_time_ = _info.simTime.Double();
+  if (sampling_time <= 0.0) {
+    return;
+  }
+
+  kernel_.SetSamplingTime(sampling_time);
+
+  // gather
+  if (actuator_commands_->Written()) {
+    double command;
+    for (size_t i = 0; i < joints_.size(); ++i) {
+      if (actuator_commands_->Read(prev_sim_time_, motor_number_[i], &command)) {
+        kernel_.SetReference(i, command);
+      }
+    }
+    if (command_sub_) {
+      command_sub_.reset();
+    }
+  }
+  const math::Pose &parent_pose = parent_->GetWorldPose();
+  const math::Vector3 linear_vel = parent_pose.rot.RotateVectorReverse(parent_->GetWorldCoGLinearVel());
+  const math::Vector3 angular_vel = parent_pose.rot.RotateVectorReverse(parent_->GetWorldAngularVel());
+  const double linear[3] = {linear_vel.x, linear_vel.y, linear_vel.z};
+  const double angular[3] = {angular_vel.x, angular_vel.y, angular_vel.z};
+  for (size_t i = 0; i < joints_.size(); ++i) {
+    kernel_.SetRotorVelocity(i, joints_[i]->GetVelocity(0));
+  }
+
+  double force[3];
+  double torque[3];
+  const bool aliasing = kernel_.Update(linear, angular, force, torque);
+  if (aliasing && !aliasing_reported_) {
+    gzerr << "[gazebo_rotor_group] Aliasing on a motor of " << model_->GetName() << " might occur. "
+          << "Consider making smaller simulation time steps or raising the rotorVelocitySlowdownSim param.\n";
+  }
+  aliasing_reported_ = aliasing;
+
+  // scatter
+  parent_->AddForce(parent_pose.rot.RotateVector(math::Vector3(force[0], force[1], force[2])));
+  parent_->AddTorque(parent_pose.rot.RotateVector(math::Vector3(torque[0], torque[1], torque[2])));
+  for (size_t i = 0; i < joints_.size(); ++i) {
+    joints_[i]->SetVelocity(0, kernel_.VelocityCommand(i));
+  }
+
+  for (size_t i = 0; i < joints_.size(); ++i) {
+    if (motor_velocity_pubs_[i].Ready(prev_sim_time_)) {
+      turning_velocity_msg_.set_data(kernel_.RotorVelocity(i));
+      motor_velocity_pubs_[i].Publish(turning_velocity_msg_, prev_sim_time_);
+    }
+  }
+}
+
+}
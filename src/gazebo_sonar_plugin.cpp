@@ -96,23 +96,33 @@ void SonarPlugin::Load(sensors::SensorPtr _parent, sdf::ElementPtr _sdf)
 
 
   sonar_pub_ = node_handle_->Advertise<sonarSens_msgs::msgs::sonarSens>(topicName, 10);
+  sonar_bus_topic_ = SensorBus::Instance().GetTopic<RangeSample>(sonar_pub_->GetTopic());
 }
 
 void SonarPlugin::OnNewScans()
 {
-  
-  sonar_message.set_time_msec(0);
+  RangeSample sample;
+  sample.time_msec = 0;
 #if GAZEBO_MAJOR_VERSION >= 7
-  sonar_message.set_min_distance(parentSensor->RangeMin());
-  sonar_message.set_max_distance(parentSensor->RangeMax());
-  sonar_message.set_current_distance(parentSensor->Range());
+  sample.min_distance = parentSensor->RangeMin();
+  sample.max_distance = parentSensor->RangeMax();
+  sample.current_distance = parentSensor->Range();
 #else
-  sonar_message.set_min_distance(parentSensor->GetRangeMin());
-  sonar_message.set_max_distance(parentSensor->GetRangeMax());
-  sonar_message.set_current_distance(parentSensor->GetRange());
+  sample.min_distance = parentSensor->GetRangeMin();
+  sample.max_distance = parentSensor->GetRangeMax();
+  sample.current_distance = parentSensor->GetRange();
 #endif
 
-  sonar_pub_->Publish(sonar_message);
+  sonar_bus_topic_->Publish(sample);
+
+  // serialize only for subscribers outside the process
+  if (sonar_pub_->HasConnections()) {
+    sonar_message.set_time_msec(sample.time_msec);
+    sonar_message.set_min_distance(sample.min_distance);
+    sonar_message.set_max_distance(sample.max_distance);
+    sonar_message.set_current_distance(sample.current_distance);
+    sonar_pub_->Publish(sonar_message);
+  }
 }
 
 
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gazebo_step_profiler_plugin.h"
+#include "common.h"
+
+#include <cstdio>
+
+namespace gazebo {
+
+GZ_REGISTER_WORLD_PLUGIN(GazeboStepProfilerPlugin)
+
+GazeboStepProfilerPlugin::GazeboStepProfilerPlugin()
+    : WorldPlugin(),
+      report_interval_(kDefaultProfilerReportInterval)
+{
+}
+
+GazeboStepProfilerPlugin::~GazeboStepProfilerPlugin()
+{
+  event::Events::DisconnectWorldUpdateBegin(update_begin_connection_);
+  event::Events::DisconnectWorldUpdateEnd(update_end_connection_);
+}
+
+void GazeboStepProfilerPlugin::Load(physics::WorldPtr _world, sdf::ElementPtr _sdf)
+{
+  world_ = _world;
+
+  getSdfParam<double>(_sdf, "report_interval", report_interval_, report_interval_);
+
+  std::string output_file;
+  if (getSdfParam<std::string>(_sdf, "output_file", output_file, "")) {
+    output_.open(output_file.c_str(), std::ios::out | std::ios::app);
+    if (output_.is_open()) {
+      // appending to the file of an earlier run, it has the header already
+      output_.seekp(0, std::ios::end);
+      if (output_.tellp() == 0) {
+        output_ << "sim_time,probe,calls,p50_us,p99_us,max_us,total_ms\n";
+      }
+    } else {
+      gzerr << "[step_profiler] Could not open " << output_file << ".\n";
+    }
+  }
+
+  update_probe_ = StepProfiler::Instance().Register("world/update");
+
+  last_report_sim_time_ = world_->GetSimTime();
+  last_report_wall_time_ = std::chrono::steady_clock::now();
+
+  update_begin_connection_ = event::Events::ConnectWorldUpdateBegin(
+      boost::bind(&GazeboStepProfilerPlugin::OnUpdateBegin, this, _1));
+  update_end_connection_ = event::Events::ConnectWorldUpdateEnd(
+      boost::bind(&GazeboStepProfilerPlugin::OnUpdateEnd, this));
+}
+
+void GazeboStepProfilerPlugin::OnUpdateBegin(const common::UpdateInfo &_info)
+{
+  if (_info.simTime < last_report_sim_time_) {
+    // a world reset moves the time backwards, start a new interval
+    last_report_sim_time_ = _info.simTime;
+    last_report_wall_time_ = std::chrono::steady_clock::now();
+  } else if ((_info.simTime - last_report_sim_time_).Double() >= report_interval_) {
+    Report(_info.simTime);
+  }
+
+  // after the report, so its output is not charged to the step
+  update_start_ = std::chrono::steady_clock::now();
+}
+
+void GazeboStepProfilerPlugin::OnUpdateEnd()
+{
+  const auto elapsed = std::chrono::steady_clock::now() - update_start_;
+  update_probe_->Record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+void GazeboStepProfilerPlugin::Report(const common::Time &_sim_time)
+{
+  const auto wall_time = std::chrono::steady_clock::now();
+  const double sim_elapsed = (_sim_time - last_report_sim_time_).Double();
+  const double wall_elapsed = std::chrono::duration<double>(wall_time - last_report_wall_time_).count();
+  last_report_sim_time_ = _sim_time;
+  last_report_wall_time_ = wall_time;
+
+  char line[256];
+  snprintf(line, sizeof(line), "[step_profiler] %.1f s sim in %.1f s wall, real time factor %.2f\n",
+           sim_elapsed, wall_elapsed, wall_elapsed > 0.0 ? sim_elapsed / wall_elapsed : 0.0);
+  gzmsg << line;
+  snprintf(line, sizeof(line), "  %-48s %9s %9s %9s %9s %6s\n",
+           "probe", "calls", "p50 [us]", "p99 [us]", "max [us]", "wall%");
+  gzmsg << line;
+
+  for (const ProfileProbePtr &probe : StepProfiler::Instance().Probes()) {
+    const LatencyStats stats = probe->Snapshot();
+    LatencyStats &last = last_stats_[probe->Name()];
+    const LatencyStats delta = stats - last;
+    last = stats;
+
+    if (delta.count == 0) {
+      continue;
+    }
+
+    const double p50 = delta.Percentile(0.5) * 1e-3;
+    const double p99 = delta.Percentile(0.99) * 1e-3;
+    const double max = delta.Max() * 1e-3;
+    const double total_ms = delta.total_ns * 1e-6;
+    const double share = wall_elapsed > 0.0 ? 0.1 * total_ms / wall_elapsed : 0.0;
+
+    snprintf(line, sizeof(line), "  %-48s %9llu %9.1f %9.1f %9.1f %6.1f\n",
+             probe->Name().c_str(), static_cast<unsigned long long>(delta.count), p50, p99, max, share);
+    gzmsg << line;
+
+    if (output_.is_open()) {
+      output_ << _sim_time.Double() << "," << probe->Name() << "," << delta.count << ","
+              << p50 << "," << p99 << "," << max << "," << total_ms << "\n";
+    }
+  }
+
+  if (output_.is_open()) {
+    output_.flush();
+  }
+}
+
+}
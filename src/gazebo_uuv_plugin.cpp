@@ -56,6 +56,8 @@ void GazeboUUVPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
   // subscribe to the commands (actuator outputs from the mixer from PX4)
   command_sub_ = node_handle_->Subscribe<mav_msgs::msgs::CommandMotorSpeed>(
     "~/" + _model->GetName() + command_sub_topic_, &GazeboUUVPlugin::CommandCallback, this);
+  actuator_commands_ = SensorBus::Instance().GetShared<ActuatorCommands>(
+    node_handle_->DecodeTopicName("~/" + _model->GetName() + command_sub_topic_));
 
   update_connection_ = event::Events::ConnectWorldUpdateBegin(
     boost::bind(&GazeboUUVPlugin::OnUpdate, this, _1));
@@ -103,6 +105,9 @@ void GazeboUUVPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
 
 // function to get the motor speed
 void GazeboUUVPlugin::CommandCallback(CommandMotorSpeedPtr &command) {
+  if (actuator_commands_->Written()) {
+    return;
+  }
   for (int i = 0; i < 4; i++) {
     command_[i] = command->motor_speed(i);
   }
@@ -122,6 +127,14 @@ void GazeboUUVPlugin::OnUpdate(const common::UpdateInfo& _info) {
   last_time_ = now;
   time_ = time_ + time_delta_;
 
+  // commands of the mavlink interface in this process
+  if (actuator_commands_->Written()) {
+    for (int i = 0; i < 4; i++) {
+      actuator_commands_->Read(now, i, &command_[i]);
+    }
+    command_sub_.reset();
+  }
+
   //std::cout << "UUV Update at " << now << ", delta " << time_delta_ << "\n";
   
   double forces[4];
@@ -52,6 +52,7 @@ void GazeboWindPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
     gzerr << "[gazebo_wind_plugin] Please specify a xyzOffset.\n";
 
   getSdfParam<std::string>(_sdf, "windPubTopic", wind_pub_topic_, "/" + namespace_ + wind_pub_topic_);
+  getSdfParam<double>(_sdf, "windPubRate", wind_pub_rate_, wind_pub_rate_);
   getSdfParam<std::string>(_sdf, "frameId", frame_id_, frame_id_);
   getSdfParam<std::string>(_sdf, "linkName", link_name_, link_name_);
   // Get the wind params from SDF.
@@ -79,7 +80,8 @@ void GazeboWindPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
   // simulation iteration.
   update_connection_ = event::Events::ConnectWorldUpdateBegin(boost::bind(&GazeboWindPlugin::OnUpdate, this, _1));
 
-  wind_pub_ = node_handle_->Advertise<wind_msgs::msgs::Wind>(wind_pub_topic_, 1);
+  wind_pub_.Advertise(node_handle_, wind_pub_topic_, wind_pub_rate_);
+  wind_msg_.set_frame_id(frame_id_);
 }
 
 // This gets called by the world update start event.
@@ -102,18 +104,18 @@ void GazeboWindPlugin::OnUpdate(const common::UpdateInfo& _info) {
     link_->AddForceAtRelativePosition(wind_gust, xyz_offset_);
   }
 
-  wind_msgs::msgs::Wind wind_msg;
+  if (!wind_pub_.Ready(now.Double())) {
+    return;
+  }
 
-  gazebo::msgs::Vector3d* force = new gazebo::msgs::Vector3d();
+  // reuses the message, the force and stamp are only allocated once
+  gazebo::msgs::Vector3d* force = wind_msg_.mutable_force();
   force->set_x(wind.x + wind_gust.x);
   force->set_y(wind.y + wind_gust.y);
   force->set_z(wind.z + wind_gust.z);
+  Set(wind_msg_.mutable_stamp(), now);
 
-  wind_msg.set_frame_id(frame_id_);
-  Set(wind_msg.mutable_stamp(), now);
-  wind_msg.set_allocated_force(force);
-  
-  wind_pub_->Publish(wind_msg);
+  wind_pub_.Publish(wind_msg_, now.Double());
 }
 
 GZ_REGISTER_MODEL_PLUGIN(GazeboWindPlugin);
@@ -0,0 +1,395 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "geo_mag_field.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace {
+
+struct WmmCoefficient {
+  int n;
+  int m;
+  double g;      ///< [nT]
+  double h;      ///< [nT]
+  double g_dot;  ///< [nT/year]
+  double h_dot;  ///< [nT/year]
+};
+
+// WMM2015 (NOAA NCEI), valid 2015.0 - 2020.0
+const WmmCoefficient kWmm2015[] = {
+  { 1,  0,  -29438.5,      0.0,  10.7,   0.0},
+  { 1,  1,   -1501.1,   4796.2,  17.9, -26.8},
+  { 2,  0,   -2445.3,      0.0,  -8.6,   0.0},
+  { 2,  1,    3012.5,  -2845.6,  -3.3, -27.1},
+  { 2,  2,    1676.6,   -642.0,   2.4, -13.3},
+  { 3,  0,    1351.1,      0.0,   3.1,   0.0},
+  { 3,  1,   -2352.3,   -115.3,  -6.2,   8.4},
+  { 3,  2,    1225.6,    245.0,  -0.4,  -0.4},
+  { 3,  3,     581.9,   -538.3, -10.4,   2.3},
+  { 4,  0,     907.2,      0.0,  -0.4,   0.0},
+  { 4,  1,     813.7,    283.4,   0.8,  -0.6},
+  { 4,  2,     120.3,   -188.6,  -9.2,   5.3},
+  { 4,  3,    -335.0,    180.9,   4.0,   3.0},
+  { 4,  4,      70.3,   -329.5,  -4.2,  -5.3},
+  { 5,  0,    -232.6,      0.0,  -0.2,   0.0},
+  { 5,  1,     360.1,     47.4,   0.1,   0.4},
+  { 5,  2,     192.4,    196.9,  -1.4,   1.6},
+  { 5,  3,    -141.0,   -119.4,   0.0,  -1.1},
+  { 5,  4,    -157.4,     16.1,   1.3,   3.3},
+  { 5,  5,       4.3,    100.1,   3.8,   0.1},
+  { 6,  0,      69.5,      0.0,  -0.5,   0.0},
+  { 6,  1,      67.4,    -20.7,  -0.2,   0.0},
+  { 6,  2,      72.8,     33.2,  -0.6,  -2.2},
+  { 6,  3,    -129.8,     58.8,   2.4,  -0.7},
+  { 6,  4,     -29.0,    -66.5,  -1.1,   0.1},
+  { 6,  5,      13.2,      7.3,   0.3,   1.0},
+  { 6,  6,     -70.9,     62.5,   1.5,   1.3},
+  { 7,  0,      81.6,      0.0,   0.2,   0.0},
+  { 7,  1,     -76.1,    -54.1,  -0.2,   0.7},
+  { 7,  2,      -6.8,    -19.4,  -0.4,   0.5},
+  { 7,  3,      51.9,      5.6,   1.3,  -0.2},
+  { 7,  4,      15.0,     24.4,   0.2,  -0.1},
+  { 7,  5,       9.3,      3.3,  -0.4,  -0.7},
+  { 7,  6,      -2.8,    -27.5,  -0.9,   0.1},
+  { 7,  7,       6.7,     -2.3,   0.3,   0.1},
+  { 8,  0,      24.0,      0.0,   0.0,   0.0},
+  { 8,  1,       8.6,     10.2,   0.1,  -0.3},
+  { 8,  2,     -16.9,    -18.1,  -0.5,   0.3},
+  { 8,  3,      -3.2,     13.2,   0.5,   0.3},
+  { 8,  4,     -20.6,    -14.6,  -0.2,   0.6},
+  { 8,  5,      13.3,     16.2,   0.4,  -0.1},
+  { 8,  6,      11.7,      5.7,   0.2,  -0.2},
+  { 8,  7,     -16.0,     -9.1,  -0.4,   0.3},
+  { 8,  8,      -2.0,      2.2,   0.3,   0.0},
+  { 9,  0,       5.4,      0.0,   0.0,   0.0},
+  { 9,  1,       8.8,    -21.6,  -0.1,  -0.2},
+  { 9,  2,       3.1,     10.8,  -0.1,  -0.1},
+  { 9,  3,      -3.1,     11.7,   0.4,  -0.2},
+  { 9,  4,       0.6,     -6.8,  -0.5,   0.1},
+  { 9,  5,     -13.3,     -6.9,  -0.2,   0.1},
+  { 9,  6,      -0.1,      7.8,   0.1,   0.0},
+  { 9,  7,       8.7,      1.0,   0.0,  -0.2},
+  { 9,  8,      -9.1,     -3.9,  -0.2,   0.4},
+  { 9,  9,     -10.5,      8.5,  -0.1,   0.3},
+  {10,  0,      -1.9,      0.0,   0.0,   0.0},
+  {10,  1,      -6.5,      3.3,   0.0,   0.1},
+  {10,  2,       0.2,     -0.3,  -0.1,  -0.1},
+  {10,  3,       0.6,      4.6,   0.3,   0.0},
+  {10,  4,      -0.6,      4.4,  -0.1,   0.0},
+  {10,  5,       1.7,     -7.9,  -0.1,  -0.2},
+  {10,  6,      -0.7,     -0.6,  -0.1,   0.1},
+  {10,  7,       2.1,     -4.1,   0.0,  -0.1},
+  {10,  8,       2.3,     -2.8,  -0.2,  -0.2},
+  {10,  9,      -1.8,     -1.1,  -0.1,   0.1},
+  {10, 10,      -3.6,     -8.7,  -0.2,  -0.1},
+  {11,  0,       3.1,      0.0,   0.0,   0.0},
+  {11,  1,      -1.5,     -0.1,   0.0,   0.0},
+  {11,  2,      -2.3,      2.1,  -0.1,   0.1},
+  {11,  3,       2.1,     -0.7,   0.1,   0.0},
+  {11,  4,      -0.9,     -1.1,   0.0,   0.1},
+  {11,  5,       0.6,      0.7,   0.0,   0.0},
+  {11,  6,      -0.7,     -0.2,   0.0,   0.0},
+  {11,  7,       0.2,     -2.1,   0.0,   0.1},
+  {11,  8,       1.7,     -1.5,   0.0,   0.0},
+  {11,  9,      -0.2,     -2.5,   0.0,  -0.1},
+  {11, 10,       0.4,     -2.0,  -0.1,  -0.1},
+  {11, 11,       3.5,     -2.3,  -0.1,  -0.1},
+  {12,  0,      -2.0,      0.0,   0.1,   0.0},
+  {12,  1,      -0.3,     -1.0,   0.0,   0.0},
+  {12,  2,       0.4,      0.5,   0.0,   0.0},
+  {12,  3,       1.3,      1.8,   0.1,  -0.1},
+  {12,  4,      -0.9,     -2.2,  -0.1,   0.0},
+  {12,  5,       0.9,      0.3,   0.0,   0.0},
+  {12,  6,       0.1,      0.7,   0.1,   0.0},
+  {12,  7,       0.5,     -0.1,   0.0,   0.0},
+  {12,  8,      -0.4,      0.3,   0.0,   0.0},
+  {12,  9,      -0.4,      0.2,   0.0,   0.0},
+  {12, 10,       0.2,     -0.9,   0.0,   0.0},
+  {12, 11,      -0.9,     -0.2,   0.0,   0.0},
+  {12, 12,       0.0,      0.7,   0.0,   0.0},
+};
+
+const int kMaxDegree = 12;
+
+// WGS84 ellipsoid and the geomagnetic reference radius [km]
+const double kWgs84A = 6378.137;
+const double kWgs84F = 1.0 / 298.257223563;
+const double kGeoMagRadius = 6371.2;
+
+// The model is singular at the geographic poles, keep grid points just off them.
+const double kMaxLatitude = 89.999 * M_PI / 180.0;
+
+/**
+ * Everything of the spherical harmonic expansion that only depends on
+ * latitude, so a grid row costs one Legendre recursion.
+ */
+class WmmRow {
+ public:
+  WmmRow(double _lat_rad, double _alt_km, double _year) {
+    // geodetic to geocentric spherical coordinates
+    const double e2 = kWgs84F * (2.0 - kWgs84F);
+    const double sin_lat = sin(_lat_rad);
+    const double rc = kWgs84A / sqrt(1.0 - e2 * sin_lat * sin_lat);
+    const double p = (rc + _alt_km) * cos(_lat_rad);
+    const double z = (rc * (1.0 - e2) + _alt_km) * sin_lat;
+    const double r = sqrt(p * p + z * z);
+    const double lat_c = asin(z / r);
+
+    // rotation from geocentric back to geodetic north / down
+    const double psi = lat_c - _lat_rad;
+    cos_psi_ = cos(psi);
+    sin_psi_ = sin(psi);
+
+    // Schmidt semi-normalized associated Legendre functions of the
+    // colatitude and their derivatives with respect to it
+    const double ct = sin(lat_c);
+    const double st = cos(lat_c);
+    st_ = st;
+
+    P_[0][0] = 1.0;
+    dP_[0][0] = 0.0;
+    for (int n = 1; n <= kMaxDegree; ++n) {
+      for (int m = 0; m <= n; ++m) {
+        if (n == m) {
+          const double k = (n > 1) ? sqrt(1.0 - 1.0 / (2.0 * n)) : 1.0;
+          P_[n][m] = k * st * P_[n - 1][m - 1];
+          dP_[n][m] = k * (st * dP_[n - 1][m - 1] + ct * P_[n - 1][m - 1]);
+        } else {
+          const double nm = sqrt(static_cast<double>(n * n - m * m));
+          const double k1 = (2.0 * n - 1.0) / nm;
+          P_[n][m] = k1 * ct * P_[n - 1][m];
+          dP_[n][m] = k1 * (ct * dP_[n - 1][m] - st * P_[n - 1][m]);
+          // P_[n - 2][m] only exists for m <= n - 2, for m == n - 1 the
+          // term's factor is zero anyway
+          if (n > 1 && m <= n - 2) {
+            const double k2 = sqrt(static_cast<double>((n - 1) * (n - 1) - m * m)) / nm;
+            P_[n][m] -= k2 * P_[n - 2][m];
+            dP_[n][m] -= k2 * dP_[n - 2][m];
+          }
+        }
+      }
+    }
+
+    // coefficients at _year, scaled by (a/r)^(n+2)
+    const double dt = _year - kWmmEpoch;
+    const double ratio = kGeoMagRadius / r;
+    double ar = ratio * ratio;
+    for (int n = 1; n <= kMaxDegree; ++n) {
+      ar *= ratio;
+      ar_[n] = ar;
+    }
+    for (const WmmCoefficient &c : kWmm2015) {
+      g_[c.n][c.m] = ar_[c.n] * (c.g + c.g_dot * dt);
+      h_[c.n][c.m] = ar_[c.n] * (c.h + c.h_dot * dt);
+    }
+  }
+
+  /// \brief North, east, down [nT] at _lon_rad on this row.
+  void Field(double _lon_rad, double _field[3]) const {
+    const double cos_lon = cos(_lon_rad);
+    const double sin_lon = sin(_lon_rad);
+
+    double x = 0.0;
+    double y = 0.0;
+    double z = 0.0;
+
+    // cos(m lon), sin(m lon) by the angle addition recursion
+    double cm = 1.0;
+    double sm = 0.0;
+    for (int m = 0; m <= kMaxDegree; ++m) {
+      for (int n = std::max(m, 1); n <= kMaxDegree; ++n) {
+        const double gh_c = g_[n][m] * cm + h_[n][m] * sm;
+        const double gh_s = g_[n][m] * sm - h_[n][m] * cm;
+        x += gh_c * dP_[n][m];
+        y += m * gh_s * P_[n][m];
+        z -= (n + 1) * gh_c * P_[n][m];
+      }
+      const double next_cm = cm * cos_lon - sm * sin_lon;
+      sm = sm * cos_lon + cm * sin_lon;
+      cm = next_cm;
+    }
+    y /= st_;
+
+    _field[0] = x * cos_psi_ - z * sin_psi_;
+    _field[1] = y;
+    _field[2] = x * sin_psi_ + z * cos_psi_;
+  }
+
+ private:
+  double P_[kMaxDegree + 1][kMaxDegree + 1];
+  double dP_[kMaxDegree + 1][kMaxDegree + 1];
+  double g_[kMaxDegree + 1][kMaxDegree + 1];
+  double h_[kMaxDegree + 1][kMaxDegree + 1];
+  double ar_[kMaxDegree + 1];
+  double st_;
+  double cos_psi_;
+  double sin_psi_;
+};
+
+GeoMagSample ToSample(const double _field[3]) {
+  const double horizontal = sqrt(_field[0] * _field[0] + _field[1] * _field[1]);
+
+  GeoMagSample sample;
+  sample.declination = atan2(_field[1], _field[0]);
+  sample.inclination = atan2(_field[2], horizontal);
+  sample.intensity = sqrt(horizontal * horizontal + _field[2] * _field[2]) * 1e-5;
+  sample.horizontal = horizontal * 1e-5;
+  sample.vertical = _field[2] * 1e-5;
+  return sample;
+}
+
+}  // namespace
+
+struct GeoMagField::Grid {
+  double resolution;  ///< [rad]
+  int rows;           ///< latitudes from -90 to 90 deg
+  int cols;           ///< longitudes from -180 to 180 deg, both ends stored
+  std::vector<GeoMagSample> samples;
+
+  const GeoMagSample &At(int _row, int _col) const {
+    return samples[_row * cols + _col];
+  }
+};
+
+GeoMagField::GeoMagField(double _year, double _resolution_deg)
+    : grid_(GetGrid(_year, _resolution_deg)),
+      cell_lat_(-1),
+      cell_lon_(-1),
+      cell_lat0_(0.0),
+      cell_lon0_(0.0)
+{
+  for (int i = 0; i < kChannels; ++i) {
+    std::fill(coeffs_[i], coeffs_[i] + 4, 0.0f);
+  }
+  sample_ = grid_->At(0, 0);
+}
+
+std::shared_ptr<const GeoMagField::Grid> GeoMagField::GetGrid(double _year, double _resolution_deg)
+{
+  static std::mutex mutex;
+  static std::map<std::pair<double, double>, std::weak_ptr<const Grid> > grids;
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  const std::pair<double, double> key(_year, _resolution_deg);
+  std::shared_ptr<const Grid> grid = grids[key].lock();
+  if (grid) {
+    return grid;
+  }
+
+  std::shared_ptr<Grid> new_grid = std::make_shared<Grid>();
+  new_grid->resolution = _resolution_deg * M_PI / 180.0;
+  new_grid->rows = static_cast<int>(std::lround(180.0 / _resolution_deg)) + 1;
+  new_grid->cols = 2 * new_grid->rows - 1;
+  new_grid->samples.resize(new_grid->rows * new_grid->cols);
+
+  for (int row = 0; row < new_grid->rows; ++row) {
+    double lat = -M_PI / 2 + row * new_grid->resolution;
+    lat = std::min(std::max(lat, -kMaxLatitude), kMaxLatitude);
+    const WmmRow wmm(lat, 0.0, _year);
+
+    for (int col = 0; col < new_grid->cols; ++col) {
+      double field[3];
+      wmm.Field(-M_PI + col * new_grid->resolution, field);
+      new_grid->samples[row * new_grid->cols + col] = ToSample(field);
+    }
+  }
+
+  grids[key] = new_grid;
+  return new_grid;
+}
+
+void GeoMagField::Evaluate(double _lat_rad, double _lon_rad, double _alt_km,
+                           double _year, double _field[3])
+{
+  _lat_rad = std::min(std::max(_lat_rad, -kMaxLatitude), kMaxLatitude);
+  WmmRow(_lat_rad, _alt_km, _year).Field(_lon_rad, _field);
+}
+
+const GeoMagSample &GeoMagField::Lookup(double _lat_rad, double _lon_rad)
+{
+  const Grid &grid = *grid_;
+
+  if (!std::isfinite(_lat_rad) || !std::isfinite(_lon_rad)) {
+    return sample_;
+  }
+
+  // wrap longitude to [-pi, pi)
+  _lon_rad = remainder(_lon_rad, 2.0 * M_PI);
+  if (_lon_rad >= M_PI) {
+    _lon_rad -= 2.0 * M_PI;
+  }
+  _lat_rad = std::min(std::max(_lat_rad, -M_PI / 2), M_PI / 2);
+
+  double u = (_lon_rad - cell_lon0_) / grid.resolution;
+  double v = (_lat_rad - cell_lat0_) / grid.resolution;
+
+  if (cell_lat_ < 0 || u < 0.0 || u > 1.0 || v < 0.0 || v > 1.0) {
+    const int row = std::min(static_cast<int>((_lat_rad + M_PI / 2) / grid.resolution), grid.rows - 2);
+    const int col = std::min(static_cast<int>((_lon_rad + M_PI) / grid.resolution), grid.cols - 2);
+
+    cell_lat_ = row;
+    cell_lon_ = col;
+    cell_lat0_ = -M_PI / 2 + row * grid.resolution;
+    cell_lon0_ = -M_PI + col * grid.resolution;
+
+    const GeoMagSample &sw = grid.At(row, col);
+    const GeoMagSample &se = grid.At(row, col + 1);
+    const GeoMagSample &nw = grid.At(row + 1, col);
+    const GeoMagSample &ne = grid.At(row + 1, col + 1);
+
+    const float corners[kChannels][4] = {
+      // declination wraps near the magnetic poles, unwrap it around sw
+      {sw.declination,
+       sw.declination + static_cast<float>(remainder(se.declination - sw.declination, 2.0 * M_PI)),
+       sw.declination + static_cast<float>(remainder(nw.declination - sw.declination, 2.0 * M_PI)),
+       sw.declination + static_cast<float>(remainder(ne.declination - sw.declination, 2.0 * M_PI))},
+      {sw.inclination, se.inclination, nw.inclination, ne.inclination},
+      {sw.intensity, se.intensity, nw.intensity, ne.intensity},
+      {sw.horizontal, se.horizontal, nw.horizontal, ne.horizontal},
+      {sw.vertical, se.vertical, nw.vertical, ne.vertical},
+    };
+
+    for (int i = 0; i < kChannels; ++i) {
+      coeffs_[i][0] = corners[i][0];
+      coeffs_[i][1] = corners[i][1] - corners[i][0];
+      coeffs_[i][2] = corners[i][2] - corners[i][0];
+      coeffs_[i][3] = corners[i][3] - corners[i][2] - corners[i][1] + corners[i][0];
+    }
+
+    u = (_lon_rad - cell_lon0_) / grid.resolution;
+    v = (_lat_rad - cell_lat0_) / grid.resolution;
+  }
+
+  const float fu = static_cast<float>(u);
+  const float fv = static_cast<float>(v);
+  float out[kChannels];
+  for (int i = 0; i < kChannels; ++i) {
+    out[i] = coeffs_[i][0] + coeffs_[i][1] * fu + (coeffs_[i][2] + coeffs_[i][3] * fu) * fv;
+  }
+
+  sample_.declination = out[0];
+  sample_.inclination = out[1];
+  sample_.intensity = out[2];
+  sample_.horizontal = out[3];
+  sample_.vertical = out[4];
+  return sample_;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "geo_projection.h"
+
+#include <cmath>
+#include <cstdlib>
+
+GeoHome GeoHomeFromEnvironment()
+{
+  GeoHome home;
+  home.lat_rad = 47.397742 * M_PI / 180;
+  home.lon_rad = 8.545594 * M_PI / 180;
+  home.alt = 488.0;
+
+  const char *env_lat = std::getenv("PX4_HOME_LAT");
+  const char *env_lon = std::getenv("PX4_HOME_LON");
+  const char *env_alt = std::getenv("PX4_HOME_ALT");
+  if (env_lat) {
+    home.lat_rad = std::strtod(env_lat, nullptr) * M_PI / 180.0;
+  }
+  if (env_lon) {
+    home.lon_rad = std::strtod(env_lon, nullptr) * M_PI / 180.0;
+  }
+  if (env_alt) {
+    home.alt = std::strtod(env_alt, nullptr);
+  }
+  return home;
+}
+
+GeoProjection::GeoProjection(double _lat_home_rad, double _lon_home_rad)
+{
+  SetHome(_lat_home_rad, _lon_home_rad);
+}
+
+void GeoProjection::SetHome(double _lat_home_rad, double _lon_home_rad)
+{
+  lat_home_ = _lat_home_rad;
+  lon_home_ = _lon_home_rad;
+  sin_lat_home_ = sin(_lat_home_rad);
+  cos_lat_home_ = cos(_lat_home_rad);
+}
+
+void GeoProjection::Reproject(double _east, double _north, double *_lat_rad, double *_lon_rad) const
+{
+  const double x_rad = _north / kGeoEarthRadius;
+  const double y_rad = _east / kGeoEarthRadius;
+  const double c = sqrt(x_rad * x_rad + y_rad * y_rad);
+
+  if (c == 0.0) {
+    *_lat_rad = lat_home_;
+    *_lon_rad = lon_home_;
+    return;
+  }
+
+  const double sin_c = sin(c);
+  const double cos_c = cos(c);
+  *_lat_rad = asin(cos_c * sin_lat_home_ + (x_rad * sin_c * cos_lat_home_) / c);
+  *_lon_rad = lon_home_ + atan2(y_rad * sin_c, c * cos_lat_home_ * cos_c - x_rad * sin_lat_home_ * sin_c);
+}
+
+void GeoProjection::Reproject(const double *_east, const double *_north, size_t _count,
+                              double *_lat_rad, double *_lon_rad) const
+{
+  for (size_t i = 0; i < _count; ++i) {
+    Reproject(_east[i], _north[i], &_lat_rad[i], &_lon_rad[i]);
+  }
+}
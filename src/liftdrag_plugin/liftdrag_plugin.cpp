@@ -140,6 +140,8 @@ void LiftDragPlugin::Load(physics::ModelPtr _model,
     {
       this->updateConnection = event::Events::ConnectWorldUpdateBegin(
           boost::bind(&LiftDragPlugin::OnUpdate, this));
+      this->updateProbe = StepProfiler::Instance().Register(
+          this->model->GetName() + "/" + this->GetHandle() + "/OnUpdate");
     }
   }
 
@@ -160,6 +162,7 @@ void LiftDragPlugin::Load(physics::ModelPtr _model,
 /////////////////////////////////////////////////
 void LiftDragPlugin::OnUpdate()
 {
+  ScopedProbe probe(this->updateProbe.get());
   GZ_ASSERT(this->link, "Link was NULL");
   // get linear velocity at cp in inertial frame
   math::Vector3 vel = this->link->GetWorldLinearVel(this->cp);
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mavlink_io_worker.h"
+
+#include <chrono>
+#include <cstring>
+
+#include <poll.h>
+
+// Keep spinning without blocking for this long after the last I/O, so a
+// lockstep simulation does not pay a scheduler wakeup per step.
+static const std::chrono::microseconds kSpinWindow(1000);
+static const int kIdlePollMs = 1;
+
+MavlinkIoWorker::MavlinkIoWorker()
+    : running_(false),
+      fd_(-1),
+      dropped_tx_(0),
+      dropped_rx_(0)
+{
+  memset(&rx_buffer_, 0, sizeof(rx_buffer_));
+  memset(&rx_status_, 0, sizeof(rx_status_));
+}
+
+MavlinkIoWorker::~MavlinkIoWorker()
+{
+  Stop();
+}
+
+void MavlinkIoWorker::Start(int _fd)
+{
+  Stop();
+  fd_ = _fd;
+  running_ = true;
+  thread_ = std::thread(&MavlinkIoWorker::Run, this);
+}
+
+void MavlinkIoWorker::Stop()
+{
+  running_ = false;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+bool MavlinkIoWorker::Send(const MavlinkTxPacket &_packet)
+{
+  if (!tx_ring_.Push(_packet)) {
+    ++dropped_tx_;
+    return false;
+  }
+  tx_wakeup_.Notify();
+  return true;
+}
+
+bool MavlinkIoWorker::Receive(mavlink_message_t *_msg)
+{
+  return rx_ring_.Pop(*_msg);
+}
+
+bool MavlinkIoWorker::WaitForMessage(uint32_t _timeoutMs)
+{
+  return rx_signal_.Wait(_timeoutMs, [this]() { return !rx_ring_.Empty(); });
+}
+
+void MavlinkIoWorker::Run()
+{
+  struct pollfd fds[2];
+  fds[0].fd = fd_;
+  fds[0].events = POLLIN;
+  fds[1].fd = tx_wakeup_.ReadFd();
+  fds[1].events = POLLIN;
+
+  auto last_activity = std::chrono::steady_clock::now();
+
+  while (running_) {
+    bool active = SendPending();
+
+    const auto now = std::chrono::steady_clock::now();
+    const bool idle = now - last_activity > kSpinWindow;
+    int timeout = 0;
+
+    if (idle) {
+      // a packet queued from now on wakes us up
+      tx_wakeup_.BeginWait();
+      timeout = tx_ring_.Empty() ? kIdlePollMs : 0;
+    }
+
+    const int nfds = fds[1].fd >= 0 ? 2 : 1;
+    const int ready = ::poll(&fds[0], nfds, timeout);
+    if (idle) {
+      tx_wakeup_.EndWait();
+    }
+    if (ready > 0 && (fds[0].revents & POLLIN)) {
+      active |= ReceivePending();
+    }
+
+    if (active) {
+      last_activity = std::chrono::steady_clock::now();
+    }
+  }
+}
+
+bool MavlinkIoWorker::SendPending()
+{
+  MavlinkTxPacket batch[kTxBatchSize];
+  unsigned count = 0;
+
+  while (count < kTxBatchSize && tx_ring_.Pop(batch[count])) {
+    ++count;
+  }
+
+  if (count > 0) {
+    send_mavlink_packets(fd_, batch, count);
+  }
+
+  return count > 0;
+}
+
+bool MavlinkIoWorker::ReceivePending()
+{
+  bool received = false;
+  int len;
+
+  struct sockaddr_in srcaddr;
+  socklen_t addrlen = sizeof(srcaddr);
+
+  while ((len = recvfrom(fd_, buf_, sizeof(buf_), MSG_DONTWAIT, (struct sockaddr *)&srcaddr, &addrlen)) > 0) {
+    received = true;
+    // PX4 may send from another address than configured, answer there
+    SetRemoteAddress(srcaddr);
+    addrlen = sizeof(srcaddr);
+    mavlink_message_t msg;
+    for (int i = 0; i < len; ++i) {
+      if (parse_mavlink_char(&rx_buffer_, &rx_status_, buf_[i], &msg)) {
+        if (!rx_ring_.Push(msg)) {
+          ++dropped_rx_;
+        }
+      }
+    }
+  }
+  if (received) {
+    rx_signal_.Notify();
+  }
+
+  return received;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mavlink_link.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+MavlinkWakeupPipe::MavlinkWakeupPipe()
+    : waiting_(false)
+{
+  fds_[0] = -1;
+  fds_[1] = -1;
+  if (pipe(fds_) != 0) {
+    printf("MAVLink wakeup pipe failed\n");
+    fds_[0] = -1;
+    fds_[1] = -1;
+    return;
+  }
+  fcntl(fds_[0], F_SETFL, fcntl(fds_[0], F_GETFL) | O_NONBLOCK);
+  fcntl(fds_[1], F_SETFL, fcntl(fds_[1], F_GETFL) | O_NONBLOCK);
+}
+
+MavlinkWakeupPipe::~MavlinkWakeupPipe()
+{
+  if (fds_[0] >= 0) {
+    close(fds_[0]);
+    close(fds_[1]);
+  }
+}
+
+void MavlinkWakeupPipe::Write()
+{
+  const char c = 0;
+  if (fds_[1] >= 0 && write(fds_[1], &c, 1) < 0) {
+    // full, the reader wakes up anyway
+  }
+}
+
+void MavlinkWakeupPipe::EndWait()
+{
+  waiting_.store(false, std::memory_order_relaxed);
+  char buf[64];
+  while (fds_[0] >= 0 && read(fds_[0], buf, sizeof(buf)) > 0) {
+  }
+}
+
+unsigned send_mavlink_packets(int _fd, MavlinkTxPacket *_packets, unsigned _count)
+{
+  unsigned sent = 0;
+
+#ifdef __linux__
+  static const unsigned kMaxBatch = 64;
+  struct iovec iov[kMaxBatch];
+  struct mmsghdr msgs[kMaxBatch];
+
+  while (sent < _count) {
+    const unsigned batch = std::min(_count - sent, kMaxBatch);
+    memset(msgs, 0, sizeof(msgs[0]) * batch);
+
+    for (unsigned i = 0; i < batch; ++i) {
+      MavlinkTxPacket &packet = _packets[sent + i];
+      iov[i].iov_base = packet.data;
+      iov[i].iov_len = packet.len;
+      msgs[i].msg_hdr.msg_name = &packet.dest_addr;
+      msgs[i].msg_hdr.msg_namelen = sizeof(packet.dest_addr);
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int ret = sendmmsg(_fd, msgs, batch, 0);
+    if (ret <= 0) {
+      printf("Failed sending mavlink message\n");
+      break;
+    }
+    sent += ret;
+  }
+#else
+  for (unsigned i = 0; i < _count; ++i) {
+    ssize_t len = sendto(_fd, _packets[i].data, _packets[i].len, 0,
+        (struct sockaddr *)&_packets[i].dest_addr, sizeof(_packets[i].dest_addr));
+
+    if (len <= 0) {
+      printf("Failed sending mavlink message\n");
+    } else {
+      ++sent;
+    }
+  }
+#endif
+
+  return sent;
+}
+
+bool parse_mavlink_char(mavlink_message_t *_rx_buffer, mavlink_status_t *_rx_status,
+                        uint8_t _c, mavlink_message_t *_msg)
+{
+  mavlink_status_t status;
+  uint8_t ret = mavlink_frame_char_buffer(_rx_buffer, _rx_status, _c, _msg, &status);
+
+  if (ret == MAVLINK_FRAMING_BAD_CRC || ret == MAVLINK_FRAMING_BAD_SIGNATURE) {
+    // same recovery as mavlink_parse_char()
+    _rx_status->msg_received = MAVLINK_FRAMING_INCOMPLETE;
+    _rx_status->parse_state = MAVLINK_PARSE_STATE_IDLE;
+    if (_c == MAVLINK_STX) {
+      _rx_status->parse_state = MAVLINK_PARSE_STATE_GOT_STX;
+      _rx_buffer->len = 0;
+      mavlink_start_checksum(_rx_buffer);
+    }
+    return false;
+  }
+
+  return ret == MAVLINK_FRAMING_OK;
+}
@@ -0,0 +1,468 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mavlink_multiplexer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+// Same pacing as the per-vehicle I/O thread: spin right after traffic,
+// block for at most a millisecond when the link is idle.
+static const std::chrono::microseconds kSpinWindow(1000);
+static const int kIdlePollMs = 1;
+static const int kMaxEvents = 64;
+
+MavlinkMultiplexer::Channel::Channel(int _fd, uint16_t _remote_port, uint8_t _system_id,
+                                     MavlinkWakeupPipe *_tx_wakeup)
+    : fd_(_fd),
+      remote_port_(_remote_port),
+      system_id_(_system_id),
+      tx_wakeup_(_tx_wakeup),
+      dropped_tx_(0),
+      dropped_rx_(0)
+{
+  memset(&rx_buffer_, 0, sizeof(rx_buffer_));
+  memset(&rx_status_, 0, sizeof(rx_status_));
+}
+
+bool MavlinkMultiplexer::Channel::Send(const MavlinkTxPacket &_packet)
+{
+  if (!tx_ring_.Push(_packet)) {
+    ++dropped_tx_;
+    return false;
+  }
+  tx_wakeup_->Notify();
+  return true;
+}
+
+bool MavlinkMultiplexer::Channel::Receive(mavlink_message_t *_msg)
+{
+  return rx_ring_.Pop(*_msg);
+}
+
+bool MavlinkMultiplexer::Channel::WaitForMessage(uint32_t _timeoutMs)
+{
+  return rx_signal_.Wait(_timeoutMs, [this]() { return !rx_ring_.Empty(); });
+}
+
+void MavlinkMultiplexer::Channel::Deliver(const mavlink_message_t &_msg)
+{
+  if (!rx_ring_.Push(_msg)) {
+    ++dropped_rx_;
+    return;
+  }
+  rx_signal_.Notify();
+}
+
+MavlinkMultiplexer &MavlinkMultiplexer::Instance()
+{
+  static MavlinkMultiplexer instance;
+  return instance;
+}
+
+MavlinkMultiplexer::MavlinkMultiplexer()
+    : shared_fd_(-1),
+      epoll_fd_(-1),
+      running_(false),
+      unrouted_(0)
+{
+  memset(&rx_buffer_, 0, sizeof(rx_buffer_));
+  memset(&rx_status_, 0, sizeof(rx_status_));
+
+#ifdef __linux__
+  epoll_fd_ = epoll_create1(0);
+  if (epoll_fd_ < 0) {
+    printf("MAVLink multiplexer: epoll_create1 failed\n");
+  } else if (tx_wakeup_.ReadFd() >= 0) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = tx_wakeup_.ReadFd();
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, tx_wakeup_.ReadFd(), &event);
+  }
+#endif
+}
+
+MavlinkMultiplexer::~MavlinkMultiplexer()
+{
+  running_ = false;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+
+  for (int fd : fds_) {
+    close(fd);
+  }
+  if (epoll_fd_ >= 0) {
+    close(epoll_fd_);
+  }
+}
+
+int MavlinkMultiplexer::OpenSocket(uint16_t _local_port)
+{
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    printf("create socket failed\n");
+    return -1;
+  }
+
+  struct sockaddr_in addr;
+  memset((char *)&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  // port 0 lets the OS pick one
+  addr.sin_port = htons(_local_port);
+
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    printf("bind failed\n");
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+// Must be called with mutex_ held.
+bool MavlinkMultiplexer::Watch(int _fd)
+{
+#ifdef __linux__
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = _fd;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, _fd, &event) < 0) {
+    printf("MAVLink multiplexer: epoll_ctl failed\n");
+    return false;
+  }
+#endif
+  fds_.push_back(_fd);
+  return true;
+}
+
+// Must be called with mutex_ held.
+void MavlinkMultiplexer::Unwatch(int _fd)
+{
+#ifdef __linux__
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, _fd, nullptr);
+#endif
+  fds_.erase(std::remove(fds_.begin(), fds_.end(), _fd), fds_.end());
+}
+
+MavlinkMultiplexer::ChannelPtr MavlinkMultiplexer::Register(uint16_t _remote_port, uint8_t _system_id)
+{
+  std::lock_guard<std::mutex> lifecycle(lifecycle_mutex_);
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (shared_fd_ < 0) {
+    int fd = OpenSocket(0);
+    if (fd < 0) {
+      return nullptr;
+    }
+    if (!Watch(fd)) {
+      close(fd);
+      return nullptr;
+    }
+    shared_fd_ = fd;
+  }
+
+  if (by_port_.count(_remote_port) > 0) {
+    printf("MAVLink multiplexer: port %u already registered\n", _remote_port);
+    return nullptr;
+  }
+  if (_system_id != 0 && by_system_id_.count(_system_id) > 0) {
+    printf("MAVLink multiplexer: system ID %u already registered\n", _system_id);
+    return nullptr;
+  }
+
+  ChannelPtr channel(new Channel(shared_fd_, _remote_port, _system_id, &tx_wakeup_));
+  channels_.push_back(channel);
+  by_port_[_remote_port] = channel.get();
+  if (_system_id != 0) {
+    by_system_id_[_system_id] = channel.get();
+  }
+
+  StartLocked();
+  return channel;
+}
+
+MavlinkMultiplexer::ChannelPtr MavlinkMultiplexer::RegisterBound(uint16_t _local_port)
+{
+  std::lock_guard<std::mutex> lifecycle(lifecycle_mutex_);
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  int fd = OpenSocket(_local_port);
+  if (fd < 0) {
+    return nullptr;
+  }
+  if (!Watch(fd)) {
+    close(fd);
+    return nullptr;
+  }
+
+  ChannelPtr channel(new Channel(fd, 0, 0, &tx_wakeup_));
+  channels_.push_back(channel);
+  by_fd_[fd] = channel.get();
+
+  StartLocked();
+  return channel;
+}
+
+void MavlinkMultiplexer::Unregister(const ChannelPtr &_channel)
+{
+  if (!_channel) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lifecycle(lifecycle_mutex_);
+  bool stop = false;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = std::find(channels_.begin(), channels_.end(), _channel);
+    if (it == channels_.end()) {
+      return;
+    }
+
+    if (_channel->fd_ == shared_fd_) {
+      by_port_.erase(_channel->remote_port_);
+      if (_channel->system_id_ != 0) {
+        by_system_id_.erase(_channel->system_id_);
+      }
+    } else {
+      Unwatch(_channel->fd_);
+      by_fd_.erase(_channel->fd_);
+      close(_channel->fd_);
+    }
+
+    channels_.erase(it);
+    stop = channels_.empty();
+  }
+
+  // The thread takes mutex_ itself, so it has to be joined without it.
+  if (stop) {
+    running_ = false;
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+}
+
+// Must be called with lifecycle_mutex_ held.
+void MavlinkMultiplexer::StartLocked()
+{
+  if (!thread_.joinable()) {
+    running_ = true;
+    thread_ = std::thread(&MavlinkMultiplexer::Run, this);
+  }
+}
+
+void MavlinkMultiplexer::Run()
+{
+  std::vector<int> ready;
+  ready.reserve(kMaxEvents);
+
+#ifndef __linux__
+  std::vector<struct pollfd> pfds;
+#endif
+
+  auto last_activity = std::chrono::steady_clock::now();
+
+  while (running_) {
+    bool active;
+    const bool idle = std::chrono::steady_clock::now() - last_activity > kSpinWindow;
+    int timeout = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      active = SendPending();
+
+      if (idle) {
+        // a packet queued from now on wakes us up
+        tx_wakeup_.BeginWait();
+        timeout = kIdlePollMs;
+        for (const ChannelPtr &channel : channels_) {
+          if (!channel->tx_ring_.Empty()) {
+            timeout = 0;
+          }
+        }
+      }
+    }
+
+    ready.clear();
+
+#ifdef __linux__
+    struct epoll_event events[kMaxEvents];
+    const int n = epoll_wait(epoll_fd_, events, kMaxEvents, timeout);
+    for (int i = 0; i < n; ++i) {
+      ready.push_back(events[i].data.fd);
+    }
+#else
+    pfds.clear();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (int fd : fds_) {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        pfds.push_back(pfd);
+      }
+    }
+    if (tx_wakeup_.ReadFd() >= 0) {
+      struct pollfd pfd;
+      pfd.fd = tx_wakeup_.ReadFd();
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      pfds.push_back(pfd);
+    }
+    if (::poll(pfds.data(), pfds.size(), timeout) > 0) {
+      for (const struct pollfd &pfd : pfds) {
+        if (pfd.revents & POLLIN) {
+          ready.push_back(pfd.fd);
+        }
+      }
+    }
+#endif
+
+    if (idle) {
+      tx_wakeup_.EndWait();
+    }
+
+    if (!ready.empty()) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (int fd : ready) {
+        if (fd != tx_wakeup_.ReadFd()) {
+          active |= ReceivePending(fd);
+        }
+      }
+    }
+
+    if (active) {
+      last_activity = std::chrono::steady_clock::now();
+    }
+  }
+}
+
+// Must be called with mutex_ held.
+bool MavlinkMultiplexer::SendPending()
+{
+  MavlinkTxPacket *batch = tx_batch_;
+  unsigned count = 0;
+  bool sent = false;
+
+  // all vehicles on the shared socket go out in common batches
+  for (const ChannelPtr &channel : channels_) {
+    if (channel->fd_ != shared_fd_) {
+      continue;
+    }
+    while (channel->tx_ring_.Pop(batch[count])) {
+      if (++count == kTxBatchSize) {
+        send_mavlink_packets(shared_fd_, batch, count);
+        count = 0;
+        sent = true;
+      }
+    }
+  }
+
+  if (count > 0) {
+    send_mavlink_packets(shared_fd_, batch, count);
+    sent = true;
+  }
+
+  // bound sockets have to send from their own port
+  for (const ChannelPtr &channel : channels_) {
+    if (channel->fd_ == shared_fd_) {
+      continue;
+    }
+    count = 0;
+    while (count < kTxBatchSize && channel->tx_ring_.Pop(batch[count])) {
+      ++count;
+    }
+    if (count > 0) {
+      send_mavlink_packets(channel->fd_, batch, count);
+      sent = true;
+    }
+  }
+
+  return sent;
+}
+
+// Must be called with mutex_ held.
+bool MavlinkMultiplexer::ReceivePending(int _fd)
+{
+  Channel *bound = nullptr;
+  auto it = by_fd_.find(_fd);
+  if (it != by_fd_.end()) {
+    bound = it->second;
+  } else if (_fd != shared_fd_) {
+    // unregistered while we were waiting
+    return false;
+  }
+
+  bool received = false;
+  struct sockaddr_in srcaddr;
+  socklen_t addrlen = sizeof(srcaddr);
+  int len;
+
+  while ((len = recvfrom(_fd, buf_, sizeof(buf_), MSG_DONTWAIT, (struct sockaddr *)&srcaddr, &addrlen)) > 0) {
+    received = true;
+    addrlen = sizeof(srcaddr);
+
+    Channel *channel = bound;
+    if (!channel) {
+      auto port = by_port_.find(ntohs(srcaddr.sin_port));
+      if (port != by_port_.end()) {
+        channel = port->second;
+      }
+    }
+
+    mavlink_message_t msg;
+
+    if (channel) {
+      channel->SetRemoteAddress(srcaddr);
+      for (int i = 0; i < len; ++i) {
+        if (parse_mavlink_char(&channel->rx_buffer_, &channel->rx_status_, buf_[i], &msg)) {
+          channel->Deliver(msg);
+        }
+      }
+    } else {
+      // unknown sender, fall back to the system ID of each message
+      for (int i = 0; i < len; ++i) {
+        if (parse_mavlink_char(&rx_buffer_, &rx_status_, buf_[i], &msg)) {
+          auto system = by_system_id_.find(msg.sysid);
+          if (system != by_system_id_.end()) {
+            system->second->SetRemoteAddress(srcaddr);
+            system->second->Deliver(msg);
+          } else {
+            ++unrouted_;
+          }
+        }
+      }
+    }
+  }
+
+  return received;
+}
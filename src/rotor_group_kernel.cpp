@@ -0,0 +1,143 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "rotor_group_kernel.h"
+
+#include <algorithm>
+#include <cmath>
+
+RotorGroupKernel::RotorGroupKernel()
+    : sampling_time_(0.0)
+{
+}
+
+void RotorGroupKernel::AddRotor(const RotorGroupRotor &_rotor)
+{
+  direction_.push_back(_rotor.direction);
+  max_rot_velocity_.push_back(_rotor.max_rot_velocity);
+  motor_constant_.push_back(_rotor.motor_constant);
+  moment_constant_.push_back(_rotor.moment_constant);
+  rotor_drag_coefficient_.push_back(_rotor.rotor_drag_coefficient);
+  rolling_moment_coefficient_.push_back(_rotor.rolling_moment_coefficient);
+  rotor_velocity_slowdown_sim_.push_back(_rotor.rotor_velocity_slowdown_sim);
+  time_constant_up_.push_back(_rotor.time_constant_up);
+  time_constant_down_.push_back(_rotor.time_constant_down);
+
+  pos_x_.push_back(_rotor.position[0]);
+  pos_y_.push_back(_rotor.position[1]);
+  pos_z_.push_back(_rotor.position[2]);
+  thrust_x_.push_back(_rotor.thrust_axis[0]);
+  thrust_y_.push_back(_rotor.thrust_axis[1]);
+  thrust_z_.push_back(_rotor.thrust_axis[2]);
+  axis_x_.push_back(_rotor.joint_axis[0]);
+  axis_y_.push_back(_rotor.joint_axis[1]);
+  axis_z_.push_back(_rotor.joint_axis[2]);
+
+  ref_rot_vel_.push_back(0.0);
+  rot_vel_.push_back(0.0);
+  filter_state_.push_back(0.0);
+  alpha_up_.push_back(0.0);
+  alpha_down_.push_back(0.0);
+  velocity_command_.push_back(0.0);
+}
+
+void RotorGroupKernel::Reset()
+{
+  std::fill(ref_rot_vel_.begin(), ref_rot_vel_.end(), 0.0);
+  std::fill(filter_state_.begin(), filter_state_.end(), 0.0);
+  sampling_time_ = 0.0;
+}
+
+void RotorGroupKernel::SetSamplingTime(double _sampling_time)
+{
+  if (_sampling_time == sampling_time_) {
+    return;
+  }
+  sampling_time_ = _sampling_time;
+  for (size_t i = 0; i < Size(); ++i) {
+    alpha_up_[i] = exp(-sampling_time_ / time_constant_up_[i]);
+    alpha_down_[i] = exp(-sampling_time_ / time_constant_down_[i]);
+  }
+}
+
+void RotorGroupKernel::SetReference(size_t _i, double _rot_vel)
+{
+  ref_rot_vel_[_i] = std::min(_rot_vel, max_rot_velocity_[_i]);
+}
+
+bool RotorGroupKernel::Update(const double _linear_vel[3], const double _angular_vel[3],
+                              double _force[3], double _torque[3])
+{
+  const double vx = _linear_vel[0], vy = _linear_vel[1], vz = _linear_vel[2];
+  const double wx = _angular_vel[0], wy = _angular_vel[1], wz = _angular_vel[2];
+  const double max_aliasing_vel = M_PI / sampling_time_;
+
+  double fx = 0.0, fy = 0.0, fz = 0.0;
+  double tx = 0.0, ty = 0.0, tz = 0.0;
+  bool aliasing = false;
+
+  for (size_t i = 0; i < Size(); ++i) {
+    aliasing |= rot_vel_[i] > max_aliasing_vel;
+
+    const double real_motor_velocity = rot_vel_[i] * rotor_velocity_slowdown_sim_[i];
+    const double thrust = real_motor_velocity * real_motor_velocity * motor_constant_[i];
+    const double abs_velocity = std::abs(real_motor_velocity);
+
+    // velocity of the rotor: v + w x r
+    const double rvx = vx + wy * pos_z_[i] - wz * pos_y_[i];
+    const double rvy = vy + wz * pos_x_[i] - wx * pos_z_[i];
+    const double rvz = vz + wx * pos_y_[i] - wy * pos_x_[i];
+
+    // scale down force linearly with forward speed
+    // XXX this has to be modelled better
+    const double speed = std::sqrt(rvx * rvx + rvy * rvy + rvz * rvz);
+    const double scalar = std::min(std::max(1.0 - speed / 25.0, 0.0), 1.0);
+
+    // rotor drag (Martin and Salaun, 2010): - \omega * \lambda_1 * V_A^{\perp}
+    const double along = rvx * axis_x_[i] + rvy * axis_y_[i] + rvz * axis_z_[i];
+    const double px = rvx - along * axis_x_[i];
+    const double py = rvy - along * axis_y_[i];
+    const double pz = rvz - along * axis_z_[i];
+    const double drag = -abs_velocity * rotor_drag_coefficient_[i];
+
+    const double rfx = thrust * scalar * thrust_x_[i] + drag * px;
+    const double rfy = thrust * scalar * thrust_y_[i] + drag * py;
+    const double rfz = thrust * scalar * thrust_z_[i] + drag * pz;
+    fx += rfx;
+    fy += rfy;
+    fz += rfz;
+
+    // moment of the rotor force about the parent CoG, drag torque about
+    // the rotor axis and rolling moment - \omega * \mu_1 * V_A^{\perp}
+    const double drag_torque = -direction_[i] * thrust * moment_constant_[i];
+    const double rolling = -abs_velocity * rolling_moment_coefficient_[i];
+    tx += pos_y_[i] * rfz - pos_z_[i] * rfy + drag_torque * thrust_x_[i] + rolling * px;
+    ty += pos_z_[i] * rfx - pos_x_[i] * rfz + drag_torque * thrust_y_[i] + rolling * py;
+    tz += pos_x_[i] * rfy - pos_y_[i] * rfx + drag_torque * thrust_z_[i] + rolling * pz;
+
+    // first order motor response, faster when spinning up
+    const double alpha = ref_rot_vel_[i] > filter_state_[i] ? alpha_up_[i] : alpha_down_[i];
+    filter_state_[i] = alpha * filter_state_[i] + (1.0 - alpha) * ref_rot_vel_[i];
+    velocity_command_[i] = direction_[i] * filter_state_[i] / rotor_velocity_slowdown_sim_[i];
+  }
+
+  _force[0] = fx;
+  _force[1] = fy;
+  _force[2] = fz;
+  _torque[0] = tx;
+  _torque[1] = ty;
+  _torque[2] = tz;
+  return aliasing;
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sensor_bus.h"
+
+SensorBus &SensorBus::Instance()
+{
+  static SensorBus instance;
+  return instance;
+}
+
+std::shared_ptr<void> SensorBus::Lookup(const std::string &_key,
+                                        const std::function<std::shared_ptr<void>()> &_create)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = topics_.find(_key);
+  if (it != topics_.end()) {
+    return it->second;
+  }
+
+  std::shared_ptr<void> topic = _create();
+  topics_[_key] = topic;
+  return topic;
+}
@@ -0,0 +1,308 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sim_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <gazebo/common/Events.hh>
+#include <gazebo/common/UpdateInfo.hh>
+
+namespace {
+
+int64_t ToNanoseconds(double _seconds)
+{
+  return static_cast<int64_t>(std::llround(_seconds * 1e9));
+}
+
+}
+
+SimTimer::SimTimer(SimScheduler *_scheduler, int64_t _period_ns, const Callback &_callback)
+    : scheduler_(_scheduler),
+      period_ns_(_period_ns),
+      callback_(_callback),
+      due_ns_(0)
+{
+}
+
+SimTimer::~SimTimer()
+{
+  scheduler_->Destroy(this);
+}
+
+void SimTimer::Cancel()
+{
+  std::lock_guard<std::recursive_mutex> lock(scheduler_->mutex_);
+  scheduler_->Disarm(this);
+}
+
+void SimTimer::Restart(double _delay)
+{
+  std::lock_guard<std::recursive_mutex> lock(scheduler_->mutex_);
+  scheduler_->Arm(this, scheduler_->now_ns_ + ToNanoseconds(_delay));
+}
+
+bool SimTimer::Armed() const
+{
+  std::lock_guard<std::recursive_mutex> lock(scheduler_->mutex_);
+  return prev != nullptr;
+}
+
+SimScheduler &SimScheduler::Instance()
+{
+  static SimScheduler instance;
+  return instance;
+}
+
+SimScheduler::SimScheduler()
+    : now_ns_(0),
+      tick_(0),
+      started_(false),
+      timer_count_(0)
+{
+  for (int level = 0; level < kLevels; ++level) {
+    for (int slot = 0; slot < kSlots; ++slot) {
+      wheel_[level][slot].prev = &wheel_[level][slot];
+      wheel_[level][slot].next = &wheel_[level][slot];
+    }
+  }
+}
+
+SimTimerPtr SimScheduler::SchedulePeriodic(double _period, const SimTimer::Callback &_callback)
+{
+  const int64_t period_ns = ToNanoseconds(_period);
+  if (period_ns <= 0) {
+    return nullptr;
+  }
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  SimTimerPtr timer = Create(period_ns, _callback);
+  Arm(timer.get(), now_ns_ + period_ns);
+  return timer;
+}
+
+SimTimerPtr SimScheduler::ScheduleAfter(double _delay, const SimTimer::Callback &_callback)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  SimTimerPtr timer = Create(0, _callback);
+  Arm(timer.get(), now_ns_ + ToNanoseconds(_delay));
+  return timer;
+}
+
+SimTimerPtr SimScheduler::CreateOneShot(const SimTimer::Callback &_callback)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  return Create(0, _callback);
+}
+
+double SimScheduler::Now() const
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  return now_ns_ * 1e-9;
+}
+
+SimTimerPtr SimScheduler::Create(int64_t _period_ns, const SimTimer::Callback &_callback)
+{
+  if (timer_count_++ == 0) {
+    Connect();
+  }
+  return SimTimerPtr(new SimTimer(this, _period_ns, _callback));
+}
+
+void SimScheduler::Destroy(SimTimer *_timer)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  Disarm(_timer);
+  if (--timer_count_ == 0) {
+    Disconnect();
+  }
+}
+
+void SimScheduler::Arm(SimTimer *_timer, int64_t _due_ns)
+{
+  Unlink(_timer);
+  _timer->due_ns_ = _due_ns;
+  Insert(_timer);
+}
+
+void SimScheduler::Disarm(SimTimer *_timer)
+{
+  Unlink(_timer);
+}
+
+void SimScheduler::Insert(SimTimer *_timer)
+{
+  // overdue timers go to the current slot, it is run first on every update
+  int64_t tick = std::max(_timer->due_ns_ >> kTickBits, tick_);
+  const int64_t horizon = (int64_t(1) << (kSlotBits * kLevels)) - 1;
+  if (tick - tick_ > horizon) {
+    // beyond the wheel, parked in the last slot and reinserted from there
+    tick = tick_ + horizon;
+  }
+
+  int level = 0;
+  while (level < kLevels - 1 && tick - tick_ >= (int64_t(1) << (kSlotBits * (level + 1)))) {
+    ++level;
+  }
+  const int slot = (tick >> (kSlotBits * level)) & (kSlots - 1);
+  Link(&wheel_[level][slot], _timer);
+}
+
+void SimScheduler::Link(SimTimerLink *_head, SimTimerLink *_node)
+{
+  _node->prev = _head->prev;
+  _node->next = _head;
+  _head->prev->next = _node;
+  _head->prev = _node;
+}
+
+void SimScheduler::Unlink(SimTimerLink *_node)
+{
+  if (_node->prev) {
+    _node->prev->next = _node->next;
+    _node->next->prev = _node->prev;
+    _node->prev = nullptr;
+    _node->next = nullptr;
+  }
+}
+
+void SimScheduler::Advance(int64_t _sim_time_ns)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+  if (!started_ || _sim_time_ns < now_ns_) {
+    // timers armed before the first update count from the time of the
+    // world, after a reset they keep their remaining delay
+    Rebase(_sim_time_ns - now_ns_);
+    started_ = true;
+  }
+
+  now_ns_ = _sim_time_ns;
+  const int64_t target = _sim_time_ns >> kTickBits;
+  for (;;) {
+    RunSlot(_sim_time_ns);
+    if (tick_ >= target) {
+      break;
+    }
+    ++tick_;
+    for (int level = 1; level < kLevels; ++level) {
+      if ((tick_ & ((int64_t(1) << (kSlotBits * level)) - 1)) != 0) {
+        break;
+      }
+      Cascade(level, tick_);
+    }
+  }
+}
+
+void SimScheduler::Cascade(int _level, int64_t _tick)
+{
+  SimTimerLink *head = &wheel_[_level][(_tick >> (kSlotBits * _level)) & (kSlots - 1)];
+  if (head->next == head) {
+    return;
+  }
+
+  SimTimerLink pending;
+  pending.prev = head->prev;
+  pending.next = head->next;
+  pending.prev->next = &pending;
+  pending.next->prev = &pending;
+  head->prev = head;
+  head->next = head;
+
+  while (pending.next != &pending) {
+    SimTimer *timer = static_cast<SimTimer *>(pending.next);
+    Unlink(timer);
+    Insert(timer);
+  }
+}
+
+void SimScheduler::RunSlot(int64_t _now_ns)
+{
+  SimTimerLink *head = &wheel_[0][tick_ & (kSlots - 1)];
+
+  // callbacks may arm timers into this slot again, e.g. a periodic timer
+  // with a period shorter than the step, so repeat until nothing is due
+  bool fired = true;
+  while (fired && head->next != head) {
+    fired = false;
+
+    SimTimerLink pending;
+    pending.prev = head->prev;
+    pending.next = head->next;
+    pending.prev->next = &pending;
+    pending.next->prev = &pending;
+    head->prev = head;
+    head->next = head;
+
+    while (pending.next != &pending) {
+      SimTimer *timer = static_cast<SimTimer *>(pending.next);
+      Unlink(timer);
+      if (timer->due_ns_ > _now_ns) {
+        Link(head, timer);
+        continue;
+      }
+
+      const int64_t due_ns = timer->due_ns_;
+      if (timer->period_ns_ > 0) {
+        Arm(timer, due_ns + timer->period_ns_);
+      }
+      timer->callback_(due_ns * 1e-9);
+      fired = true;
+    }
+  }
+}
+
+void SimScheduler::Rebase(int64_t _offset_ns)
+{
+  std::vector<SimTimer *> timers;
+  for (int level = 0; level < kLevels; ++level) {
+    for (int slot = 0; slot < kSlots; ++slot) {
+      SimTimerLink *head = &wheel_[level][slot];
+      while (head->next != head) {
+        SimTimer *timer = static_cast<SimTimer *>(head->next);
+        Unlink(timer);
+        timers.push_back(timer);
+      }
+    }
+  }
+
+  now_ns_ += _offset_ns;
+  tick_ = now_ns_ >> kTickBits;
+  for (SimTimer *timer : timers) {
+    timer->due_ns_ += _offset_ns;
+    Insert(timer);
+  }
+}
+
+void SimScheduler::Connect()
+{
+  started_ = false;
+  update_connection_ = std::make_shared<gazebo::event::ConnectionPtr>(
+      gazebo::event::Events::ConnectWorldUpdateBegin([this](const gazebo::common::UpdateInfo &_info) {
+        Advance(static_cast<int64_t>(_info.simTime.sec) * 1000000000 + _info.simTime.nsec);
+      }));
+}
+
+void SimScheduler::Disconnect()
+{
+  std::shared_ptr<gazebo::event::ConnectionPtr> connection =
+      std::static_pointer_cast<gazebo::event::ConnectionPtr>(update_connection_);
+  if (connection) {
+    gazebo::event::Events::DisconnectWorldUpdateBegin(*connection);
+  }
+  update_connection_.reset();
+}
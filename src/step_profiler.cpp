@@ -0,0 +1,141 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "step_profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+int LatencyHistogram::Index(uint64_t _value_ns)
+{
+  if (_value_ns < static_cast<uint64_t>(kSubBuckets)) {
+    return static_cast<int>(_value_ns);
+  }
+
+  // position of the highest set bit selects the power of two, the next
+  // kSubBucketBits bits the linear bucket within it
+#if defined(__GNUC__)
+  const int msb = 63 - __builtin_clzll(_value_ns);
+#else
+  int msb = 63;
+  while (!(_value_ns >> msb)) {
+    --msb;
+  }
+#endif
+  const int shift = msb - kSubBucketBits;
+  const int index = (shift + 1) * kSubBuckets + static_cast<int>((_value_ns >> shift) - kSubBuckets);
+  return std::min(index, kBuckets - 1);
+}
+
+uint64_t LatencyHistogram::UpperBound(int _index)
+{
+  if (_index < kSubBuckets) {
+    return _index;
+  }
+  const int shift = _index / kSubBuckets - 1;
+  const uint64_t lower = static_cast<uint64_t>(kSubBuckets + _index % kSubBuckets) << shift;
+  return lower + (uint64_t(1) << shift) - 1;
+}
+
+LatencyStats::LatencyStats()
+    : count(0),
+      total_ns(0)
+{
+  std::fill(buckets, buckets + LatencyHistogram::kBuckets, 0);
+}
+
+LatencyStats LatencyStats::operator-(const LatencyStats &_earlier) const
+{
+  LatencyStats delta;
+  for (int i = 0; i < LatencyHistogram::kBuckets; ++i) {
+    delta.buckets[i] = buckets[i] - _earlier.buckets[i];
+  }
+  delta.count = count - _earlier.count;
+  delta.total_ns = total_ns - _earlier.total_ns;
+  return delta;
+}
+
+uint64_t LatencyStats::Percentile(double _quantile) const
+{
+  if (count == 0) {
+    return 0;
+  }
+
+  const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(_quantile * count)));
+  uint64_t seen = 0;
+  int last = 0;
+  for (int i = 0; i < LatencyHistogram::kBuckets; ++i) {
+    if (buckets[i] == 0) {
+      continue;
+    }
+    seen += buckets[i];
+    last = i;
+    if (seen >= rank) {
+      break;
+    }
+  }
+  return LatencyHistogram::UpperBound(last);
+}
+
+ProfileProbe::ProfileProbe(const std::string &_name)
+    : name_(_name),
+      count_(0),
+      total_ns_(0)
+{
+  for (std::atomic<uint64_t> &bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+LatencyStats ProfileProbe::Snapshot() const
+{
+  LatencyStats stats;
+  for (int i = 0; i < LatencyHistogram::kBuckets; ++i) {
+    stats.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+  }
+  stats.count = count_.load(std::memory_order_relaxed);
+  stats.total_ns = total_ns_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+StepProfiler &StepProfiler::Instance()
+{
+  static StepProfiler instance;
+  return instance;
+}
+
+ProfileProbePtr StepProfiler::Register(const std::string &_name)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  ProfileProbePtr &probe = probes_[_name];
+  if (!probe) {
+    probe.reset(new ProfileProbe(_name));
+  }
+  return probe;
+}
+
+std::vector<ProfileProbePtr> StepProfiler::Probes() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::vector<ProfileProbePtr> probes;
+  probes.reserve(probes_.size());
+  for (const auto &entry : probes_) {
+    probes.push_back(entry.second);
+  }
+  return probes;
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright 2017 PX4 Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "video_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(VideoShmHeader) <= kVideoShmHeaderSize, "header too large");
+static_assert(sizeof(VideoShmSlot) == kVideoShmSlotHeaderSize, "slot header size");
+
+std::unique_ptr<VideoShmWriter> VideoShmWriter::Create(const std::string &_name,
+                                                       uint32_t _width,
+                                                       uint32_t _height,
+                                                       uint32_t _slot_count)
+{
+  if (_width == 0 || _height == 0 || _slot_count == 0) {
+    return nullptr;
+  }
+
+  const uint64_t stride = static_cast<uint64_t>(_width) * 3;
+  const uint64_t frame_size = stride * _height;
+  // page aligned slots, a frame never shares a page with the next slot's header
+  const long page = sysconf(_SC_PAGESIZE) > 0 ? sysconf(_SC_PAGESIZE) : 4096;
+  const uint64_t slot_size = (kVideoShmSlotHeaderSize + frame_size + page - 1) / page * page;
+  const size_t map_size = kVideoShmHeaderSize + _slot_count * slot_size;
+
+  const int fd = shm_open(_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    printf("video shm: can't create %s: %s\n", _name.c_str(), strerror(errno));
+    return nullptr;
+  }
+  if (ftruncate(fd, map_size) != 0) {
+    printf("video shm: can't size %s to %zu bytes: %s\n", _name.c_str(), map_size, strerror(errno));
+    close(fd);
+    shm_unlink(_name.c_str());
+    return nullptr;
+  }
+
+  int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE;  // no page faults in the rendering thread
+#endif
+  void *map = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    printf("video shm: can't map %s: %s\n", _name.c_str(), strerror(errno));
+    shm_unlink(_name.c_str());
+    return nullptr;
+  }
+
+  std::unique_ptr<VideoShmWriter> writer(new VideoShmWriter(_name, map, map_size));
+
+  VideoShmHeader *header = writer->header_;
+  memset(header, 0, kVideoShmHeaderSize);
+  header->version = kVideoShmVersion;
+  header->header_size = kVideoShmHeaderSize;
+  header->width = _width;
+  header->height = _height;
+  header->stride = stride;
+  header->slot_count = _slot_count;
+  header->slot_size = slot_size;
+  header->frame_size = frame_size;
+  header->written = 0;
+  strncpy(header->format, "RGB", sizeof(header->format) - 1);
+  // the magic last, readers of a half initialized ring reject it
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(header->magic, kVideoShmMagic, sizeof(header->magic));
+  return writer;
+}
+
+VideoShmWriter::VideoShmWriter(const std::string &_name, void *_map, size_t _map_size)
+    : name_(_name),
+      map_(_map),
+      map_size_(_map_size),
+      header_(static_cast<VideoShmHeader *>(_map))
+{
+}
+
+VideoShmWriter::~VideoShmWriter()
+{
+  munmap(map_, map_size_);
+  shm_unlink(name_.c_str());
+}
+
+void VideoShmWriter::Write(const void *_rgb, double _sim_time)
+{
+  const uint64_t frame = header_->written;
+  char *slot_base = static_cast<char *>(map_) + header_->header_size +
+                    (frame % header_->slot_count) * header_->slot_size;
+  VideoShmSlot *slot = reinterpret_cast<VideoShmSlot *>(slot_base);
+
+  // seqlock, readers discard what they copied while the sequence is odd
+  __atomic_store_n(&slot->sequence, 2 * frame + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  slot->frame = frame;
+  slot->sim_time = _sim_time;
+  memcpy(slot_base + kVideoShmSlotHeaderSize, _rgb, header_->frame_size);
+  __atomic_store_n(&slot->sequence, 2 * (frame + 1), __ATOMIC_RELEASE);
+
+  __atomic_store_n(&header_->written, frame + 1, __ATOMIC_RELEASE);
+}
+
+VideoShmReader::VideoShmReader()
+    : map_(nullptr),
+      map_size_(0),
+      header_(nullptr)
+{
+}
+
+VideoShmReader::~VideoShmReader()
+{
+  Close();
+}
+
+bool VideoShmReader::Open(const std::string &_name)
+{
+  Close();
+
+  const int fd = shm_open(_name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    printf("video shm: can't open %s: %s\n", _name.c_str(), strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(kVideoShmHeaderSize)) {
+    printf("video shm: %s is not a video ring\n", _name.c_str());
+    close(fd);
+    return false;
+  }
+
+  void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    printf("video shm: can't map %s: %s\n", _name.c_str(), strerror(errno));
+    return false;
+  }
+
+  const VideoShmHeader *header = static_cast<const VideoShmHeader *>(map);
+  if (memcmp(header->magic, kVideoShmMagic, sizeof(header->magic)) != 0 ||
+      header->version != kVideoShmVersion ||
+      header->slot_count == 0 ||
+      header->slot_size < kVideoShmSlotHeaderSize + header->frame_size ||
+      header->header_size + header->slot_count * header->slot_size > static_cast<uint64_t>(st.st_size)) {
+    printf("video shm: %s is not a video ring of version %u\n", _name.c_str(), kVideoShmVersion);
+    munmap(map, st.st_size);
+    return false;
+  }
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+  map_ = map;
+  map_size_ = st.st_size;
+  header_ = header;
+  return true;
+}
+
+void VideoShmReader::Close()
+{
+  if (map_) {
+    munmap(map_, map_size_);
+  }
+  map_ = nullptr;
+  map_size_ = 0;
+  header_ = nullptr;
+}
+
+bool VideoShmReader::Read(uint64_t _frame, void *_rgb, VideoShmSlot *_info) const
+{
+  const char *slot_base = static_cast<const char *>(map_) + header_->header_size +
+                          (_frame % header_->slot_count) * header_->slot_size;
+  const VideoShmSlot *slot = reinterpret_cast<const VideoShmSlot *>(slot_base);
+
+  const uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+  if (sequence != 2 * (_frame + 1)) {
+    return false;
+  }
+  if (_info) {
+    *_info = *slot;
+  }
+  memcpy(_rgb, slot_base + kVideoShmSlotHeaderSize, header_->frame_size);
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == sequence;
+}
+
+bool VideoShmReader::ReadLatest(void *_rgb, VideoShmSlot *_info) const
+{
+  // the writer may lap us while copying, try the then newest frame again
+  for (int attempt = 0; attempt < 3; ++attempt) {
+    const uint64_t written = Written();
+    if (written == 0) {
+      return false;
+    }
+    if (Read(written - 1, _rgb, _info)) {
+      return true;
+    }
+  }
+  return false;
+}